@@ -0,0 +1,159 @@
+/* Benchmark devBusMapped against a simulated register file.
+ *
+ * Usage: busMappedBench <st-script> [n_records [n_scans [rd_latency_us]]]
+ *
+ * Creates a simulated device 'bench' with one 32-bit register per
+ * record, writes a database with 'n_records' longin records reading
+ * these registers (SCAN = I/O Intr on the device's scan list) to
+ * 'busMappedBench.db' and runs the st-script (which must load the dbd,
+ * register the record/device/driver support and load 'busMappedBench.db'
+ * but NOT call iocInit -- see 'stBusBench').
+ *
+ * Then it measures
+ *   - iocInit (init_record) time,
+ *   - parsing the records' links alone (devBusVmeLinkInit()),
+ *   - 'n_scans' I/O Intr scans of all records (scan throughput through
+ *     the callback threads),
+ *   - processing all records directly from this thread (per-record
+ *     overhead of record + device support without scan tasks).
+ */
+#include <epicsExit.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <iocsh.h>
+#include <iocInit.h>
+#include <errlog.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <link.h>
+
+#include <devBusMappedSim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DB_NAME "busMappedBench.db"
+
+static void
+scanDone(void *arg, IOSCANPVT scan, int prio)
+{
+	epicsEventSignal( (epicsEventId)arg );
+}
+
+static void
+report(const char *what, unsigned long n, epicsUInt64 ns)
+{
+double dt = (double)ns * 1.0E-9;
+
+	printf("%-20s %lu records in %.3fs (%.0f records/s, %.3fus/record)\n",
+	       what, n, dt, (double)n/dt, dt*1.0E6/(double)n);
+}
+
+int
+main(int argc, char **argv)
+{
+unsigned long    n = 10000, scans = 100, i, k;
+double           lat = 0.;
+DevBusMappedSim  sim;
+dbCommon       **recs;
+DBADDR           addr;
+epicsEventId     done;
+char             nm[40];
+FILE            *f;
+epicsUInt64      then;
+char           **parms;
+DBLINK           lnk;
+DevBusMappedPvtRec pvt;
+
+	if ( argc < 2 ) {
+		fprintf(stderr, "Usage: %s <st-script> [n_records [n_scans [rd_latency_us]]]\n", argv[0]);
+		return 1;
+	}
+
+	if ( argc > 2 )
+		n = strtoul( argv[2], 0, 0 );
+	if ( argc > 3 )
+		scans = strtoul( argv[3], 0, 0 );
+	if ( argc > 4 )
+		lat = strtod( argv[4], 0 );
+
+	if ( ! (sim = devBusMappedSimCreate( "bench", 4*n, lat, lat )) )
+		return 1;
+
+	if (    ! (recs  = (dbCommon**)malloc( sizeof(*recs)  * n ))
+	     || ! (parms = (char**)    malloc( sizeof(*parms) * n ))
+	     || ! (done  = epicsEventCreate( epicsEventEmpty )) ) {
+		fprintf(stderr, "No memory\n");
+		return 1;
+	}
+
+	if ( ! (f = fopen( DB_NAME, "w" )) ) {
+		perror("Unable to create " DB_NAME);
+		return 1;
+	}
+	for ( i = 0; i < n; i++ ) {
+		fprintf(f, "record(longin, \"bbench:%lu\") {\n", i);
+		fprintf(f, "\tfield(DTYP, \"BusAddress\")\n");
+		fprintf(f, "\tfield(INP,  \"#C0S0@bench+0x%lx,sim32,bench\")\n", 4*i);
+		fprintf(f, "\tfield(SCAN, \"I/O Intr\")\n");
+		fprintf(f, "}\n");
+	}
+	fclose( f );
+
+	iocsh( argv[1] );
+
+	then = epicsMonotonicGet();
+	iocInit();
+	report( "iocInit:", n, epicsMonotonicGet() - then );
+
+	for ( i = 0; i < n; i++ ) {
+		sprintf( nm, "bbench:%lu", i );
+		if ( dbNameToAddr( nm, &addr ) ) {
+			fprintf(stderr, "Record %s not found\n", nm);
+			return 1;
+		}
+		recs[i] = addr.precord;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		sprintf( nm, "bench+0x%lx,sim32,bench", 4*i );
+		if ( ! (parms[i] = (char*)malloc( strlen(nm) + 1 )) ) {
+			fprintf(stderr, "No memory\n");
+			return 1;
+		}
+		strcpy( parms[i], nm );
+	}
+
+	lnk.type               = VME_IO;
+	lnk.value.vmeio.card   = 0;
+	lnk.value.vmeio.signal = 0;
+	then = epicsMonotonicGet();
+	for ( i = 0; i < n; i++ ) {
+		lnk.value.vmeio.parm = parms[i];
+		devBusVmeLinkInit( &lnk, &pvt, recs[i] );
+	}
+	report( "link init:", n, epicsMonotonicGet() - then );
+
+	scanIoSetComplete( devBusMappedSimGetScan( sim ), scanDone, done );
+
+	then = epicsMonotonicGet();
+	for ( k = 0; k < scans; k++ ) {
+		devBusMappedSimRaiseIrq( sim );
+		epicsEventMustWait( done );
+	}
+	report( "I/O Intr scan:", n*scans, epicsMonotonicGet() - then );
+
+	then = epicsMonotonicGet();
+	for ( k = 0; k < scans; k++ ) {
+		for ( i = 0; i < n; i++ ) {
+			dbScanLock( recs[i] );
+			dbProcess( recs[i] );
+			dbScanUnlock( recs[i] );
+		}
+	}
+	report( "dbProcess:", n*scans, epicsMonotonicGet() - then );
+
+	epicsExit( 0 );
+	return( 0 );
+}
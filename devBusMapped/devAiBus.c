@@ -46,6 +46,8 @@
 #include	"recSup.h"
 #include	"devSup.h"
 #include	"aiRecord.h"
+#include	"dbStaticLib.h"
+#include	"errlog.h"
 #include        "epicsExport.h"
 
 #define DEV_BUS_MAPPED_PVT
@@ -75,8 +77,26 @@ struct {
 epicsExportAddress(dset, devAiBus);
 
 
+/* Look up the linearization table named by info tag 'BusLinTable' */
+static DevBusMappedLin findLinTable(aiRecord *prec)
+{
+DBENTRY         ent;
+const char      *name = 0;
+DevBusMappedLin t     = 0;
+
+	dbInitEntry(pdbbase, &ent);
+	if ( 0 == dbFindRecord(&ent, prec->name) )
+		name = dbGetInfo(&ent, "BusLinTable");
+	if ( name && *name && ! (t = devBusMappedLinFind(name)) )
+		errlogPrintf("devAiBus (%s): linearization table '%s' not found\n", prec->name, name);
+	dbFinishEntry(&ent);
+
+	return t;
+}
+
 static long init_record(aiRecord *prec)
 {
+DevBusMappedPvt pvt;
 
    	if ( devBusVmeLinkInit(&prec->inp, 0, (dbCommon*)prec) ) {
 		recGblRecordError(S_db_badField,(void *)prec,
@@ -84,16 +104,54 @@ static long init_record(aiRecord *prec)
 		return(S_db_badField);
 	}
 
+	pvt      = prec->dpvt;
+	pvt->lin = findLinTable(prec);
+
     return(0);
 }
 
+/* Apply the linearization table and ASLO/AOFF */
+static long lin_convert(aiRecord *pai, double raw)
+{
+DevBusMappedPvt pvt = pai->dpvt;
+int             oor;
+double          d;
+
+	d = devBusMappedLinEval1(pvt->lin, raw, &oor);
+	if ( oor )
+		recGblSetSevr(pai, HW_LIMIT_ALARM, INVALID_ALARM);
+	if ( 0. != pai->aslo )
+		d *= pai->aslo;
+	pai->val = d + pai->aoff;
+	pai->udf = FALSE;
+	return 2;
+}
+
 static long read_ai(aiRecord *pai)
 {
 DevBusMappedPvt pvt = pai->dpvt;
 long            rval;
 epicsUInt32     v;
+double          d;
+
+	if ( devBusMappedDirectVal(pvt) ) {
+		/* float or 64-bit register; bypass RVAL/conversion
+		 * but still apply ASLO/AOFF
+		 */
+		if ( (rval = devBusMappedGetDouble(pvt, &d, (dbCommon*)pai)) )
+			return rval;
+		if ( pvt->lin )
+			return lin_convert(pai, d);
+		if ( 0. != pai->aslo )
+			d *= pai->aslo;
+		pai->val = d + pai->aoff;
+		pai->udf = FALSE;
+		return 2;
+	}
 
 	rval = devBusMappedGetVal(pvt, &v, (dbCommon*)pai);
 	pai->rval = (epicsInt32)v;
+	if ( pvt->lin && 0 == rval )
+		return lin_convert(pai, (double)pai->rval + (double)pai->roff);
 	return rval;
 }
@@ -86,6 +86,19 @@ epicsUInt32 v;
 	}
 
 
+	if ( devBusMappedDirectVal((DevBusMappedPvt)prec->dpvt) ) {
+		/* float or 64-bit register; VAL is read/written directly */
+		if (!prec->pini) {
+			double d = 0.;
+			if ( devBusMappedGetDouble(prec->dpvt, &d, (dbCommon*)prec) )
+				recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+			if ( 0. != prec->aslo )
+				d *= prec->aslo;
+			prec->val = d + prec->aoff;
+			recGblResetAlarms(prec);
+		}
+		rval = 2;
+	} else
 	if (!prec->pini) {
 		DevBusMappedPvt pvt = prec->dpvt;
 		if ( devBusMappedGetVal(pvt, &v, (dbCommon*)prec) )
@@ -107,9 +120,18 @@ static long write_ao(aoRecord	*pao)
 {
 DevBusMappedPvt pvt = pao->dpvt;
 long			rval;
-epicsMutexLock(pvt->dev->mutex);
-	rval = devBusMappedPutVal(pvt,pao->rval, (dbCommon*)pao);
-epicsMutexUnlock(pvt->dev->mutex);
+double			d;
+devBusMappedLock(pvt);
+	if ( devBusMappedDirectVal(pvt) ) {
+		/* undo ASLO/AOFF only */
+		d = pao->oval - pao->aoff;
+		if ( 0. != pao->aslo )
+			d /= pao->aslo;
+		rval = devBusMappedPutDouble(pvt, d, (dbCommon*)pao);
+	} else {
+		rval = devBusMappedPutVal(pvt,pao->rval, (dbCommon*)pao);
+	}
+devBusMappedUnlock(pvt);
 	return rval;
 }
 
@@ -87,20 +87,12 @@ static long write_bo(boRecord *pbo)
 {
 long			rval;
 DevBusMappedPvt pvt = pbo->dpvt;
-epicsUInt32 	v;
 
-epicsMutexLock(pvt->dev->mutex);
-	if ( pbo->mask ) {
-		if ( (rval = devBusMappedGetVal(pvt, &v, (dbCommon*)pbo) ) < 0 )
-			goto leave;
-		v &= ~pbo->mask;
-		v |= pbo->rval & pbo->mask;
-	} else {
-		v = pbo->rval;
-	}
-	rval =  devBusMappedPutVal(pvt, v, (dbCommon*)pbo);
+	if ( pbo->mask )
+		return devBusMappedModify(pvt, pbo->mask, pbo->rval, 0, (dbCommon*)pbo);
 
-leave:
-epicsMutexUnlock(pvt->dev->mutex);
+devBusMappedLock(pvt);
+	rval =  devBusMappedPutVal(pvt, pbo->rval, (dbCommon*)pbo);
+devBusMappedUnlock(pvt);
 	return rval;
 }
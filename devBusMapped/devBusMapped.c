@@ -6,6 +6,7 @@
 #include <inttypes.h>
 
 #include <epicsMutex.h>
+#include <epicsThread.h>
 #include <registry.h>
 #include <alarm.h>
 #include <dbAccess.h>
@@ -72,36 +73,428 @@ DECL_OUT(outm16)
 DECL_OUT(outm8)
 	{ *(uint8_t  *)pvt->addr = v & 0xff;				return 0; }
 
-static DevBusMappedAccessRec m32   = { inm32, outm32 };
-static DevBusMappedAccessRec be32  = { inbe32, outbe32 };
-static DevBusMappedAccessRec le32  = { inle32, outle32 };
-static DevBusMappedAccessRec m16   = { inm16, outm16 };
-static DevBusMappedAccessRec be16  = { inbe16, outbe16 };
-static DevBusMappedAccessRec le16  = { inle16, outle16 };
-static DevBusMappedAccessRec m8    = { inm8, outm8 };
-static DevBusMappedAccessRec io8   = { in8, out8 };
-static DevBusMappedAccessRec m16s  = { inm16s, outm16 };
-static DevBusMappedAccessRec be16s = { inbe16s, outbe16 };
-static DevBusMappedAccessRec le16s = { inle16s, outle16 };
-static DevBusMappedAccessRec m8s   = { inm8s, outm8 };
-static DevBusMappedAccessRec io8s  = { in8s, out8 };
+/* 'posted' writes (no barrier) for write-combining; the
+ * byte order is set up in memory so this works on any CPU.
+ */
+typedef union {
+	uint32_t u;
+	uint8_t  c[4];
+} BusMappedB32U;
+
+typedef union {
+	uint16_t u;
+	uint8_t  c[2];
+} BusMappedB16U;
+
+DECL_OUT(pstbe32)
+	{
+	BusMappedB32U x;
+		x.c[0] = v>>24; x.c[1] = v>>16; x.c[2] = v>>8; x.c[3] = v;
+		*(volatile uint32_t *)pvt->addr = x.u;			return 0;
+	}
+DECL_OUT(pstle32)
+	{
+	BusMappedB32U x;
+		x.c[3] = v>>24; x.c[2] = v>>16; x.c[1] = v>>8; x.c[0] = v;
+		*(volatile uint32_t *)pvt->addr = x.u;			return 0;
+	}
+DECL_OUT(pstbe16)
+	{
+	BusMappedB16U x;
+		x.c[0] = v>>8; x.c[1] = v;
+		*(volatile uint16_t *)pvt->addr = x.u;			return 0;
+	}
+DECL_OUT(pstle16)
+	{
+	BusMappedB16U x;
+		x.c[1] = v>>8; x.c[0] = v;
+		*(volatile uint16_t *)pvt->addr = x.u;			return 0;
+	}
+DECL_OUT(pst8)
+	{ *(volatile uint8_t *)pvt->addr = v & 0xff;		return 0; }
+
+DECL_OUT(pstm32)
+	{ *(volatile uint32_t *)pvt->addr = v;				return 0; }
+DECL_OUT(pstm16)
+	{ *(volatile uint16_t *)pvt->addr = v & 0xffff;		return 0; }
+
+/* Lock-free masked update of CPU-endian memory; only where the
+ * compiler provides lock-free atomics of the respective size.
+ */
+#define DECL_MOD(name) static int name(DevBusMappedPvt pvt, epicsUInt32 msk, epicsUInt32 v, epicsUInt32 *pold, dbCommon *prec)
+
+#define DEF_MOD(name, type)											\
+DECL_MOD(name)														\
+	{																\
+	volatile type *a = (volatile type *)pvt->addr;					\
+	type          o  = *a, n;										\
+		do {														\
+			n = (type)((o & ~(type)msk) | ((type)v & (type)msk));	\
+		} while ( ! __atomic_compare_exchange_n( a, &o, n, 1,		\
+		              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );		\
+		*pold = o;												return 0; \
+	}
+
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && 2 == __GCC_ATOMIC_INT_LOCK_FREE
+DEF_MOD(modm32, uint32_t)
+#define MODM32	modm32
+#else
+#define MODM32	0
+#endif
+
+#if defined(__GCC_ATOMIC_SHORT_LOCK_FREE) && 2 == __GCC_ATOMIC_SHORT_LOCK_FREE
+DEF_MOD(modm16,  uint16_t)
+DEF_MOD(modm16s, int16_t)
+#define MODM16	modm16
+#define MODM16S	modm16s
+#else
+#define MODM16	0
+#define MODM16S	0
+#endif
+
+#if defined(__GCC_ATOMIC_CHAR_LOCK_FREE) && 2 == __GCC_ATOMIC_CHAR_LOCK_FREE
+DEF_MOD(modm8,  uint8_t)
+DEF_MOD(modm8s, int8_t)
+#define MODM8	modm8
+#define MODM8S	modm8s
+#else
+#define MODM8	0
+#define MODM8S	0
+#endif
+
+/* 'flush' method: writing is an ordering point for write-combining */
+DECL_INP(inflush)
+	{ *pv = 0;											return 0; }
+DECL_OUT(outflush)
+	{ devBusMappedFlush(pvt->dev);						return 0; }
+
+#define DECL_INP64(name) static int name(DevBusMappedPvt pvt, epicsUInt64 *pv, dbCommon *prec)
+#define DECL_OUT64(name) static int name(DevBusMappedPvt pvt, epicsUInt64 v, dbCommon *prec)
+
+/* 64-bit registers are accessed as two 32-bit words. Reading
+ * is made tear-free by reading the high word again and retrying
+ * if it changed (e.g., a counter carried into the high word).
+ * 'hi' and 'lo' are the offsets (in words) of the high and low word.
+ */
+static __inline__ epicsUInt64
+rd64hlh(volatile void *addr, int hi, int lo, int le)
+{
+volatile uint32_t *a = addr;
+uint32_t           h, l, h1;
+
+	h = le ? in_le32(a + hi) : in_be32(a + hi);
+	for (;;) {
+		l  = le ? in_le32(a + lo) : in_be32(a + lo);
+		h1 = le ? in_le32(a + hi) : in_be32(a + hi);
+		if ( h1 == h )
+			break;
+		h = h1;
+	}
+	return ((epicsUInt64)h << 32) | l;
+}
+
+/* Write both words in ascending address order */
+static __inline__ void
+wr64(volatile void *addr, int hi, int lo, int le, epicsUInt64 v)
+{
+volatile uint32_t *a = addr;
+uint32_t           w[2];
+
+	w[hi] = (uint32_t)(v >> 32);
+	w[lo] = (uint32_t)v;
+	if ( le ) {
+		out_le32(a + 0, w[0]);
+		out_le32(a + 1, w[1]);
+	} else {
+		out_be32(a + 0, w[0]);
+		out_be32(a + 1, w[1]);
+	}
+}
+
+DECL_INP64(inbe64)
+	{ *pv = rd64hlh(pvt->addr, 0, 1, 0);				return 0; }
+DECL_INP64(inle64)
+	{ *pv = rd64hlh(pvt->addr, 1, 0, 1);				return 0; }
+DECL_OUT64(outbe64)
+	{ wr64(pvt->addr, 0, 1, 0, v);						return 0; }
+DECL_OUT64(outle64)
+	{ wr64(pvt->addr, 1, 0, 1, v);						return 0; }
+
+/* memory; a single (atomic) access where the CPU has lock-free 64-bit
+ * atomics (no libatomic calls on 32-bit CPUs), two words otherwise
+ */
+#if defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && 2 == __GCC_ATOMIC_LLONG_LOCK_FREE
+DECL_INP64(inm64)
+	{ *pv = __atomic_load_n((volatile uint64_t*)pvt->addr, __ATOMIC_RELAXED);	return 0; }
+DECL_OUT64(outm64)
+	{ __atomic_store_n((volatile uint64_t*)pvt->addr, v, __ATOMIC_RELAXED);		return 0; }
+#else
+DECL_INP64(inm64)
+	{ *pv = ENDIAN_TEST_IS_LITTLE ? rd64hlh(pvt->addr, 1, 0, 1) : rd64hlh(pvt->addr, 0, 1, 0);	return 0; }
+DECL_OUT64(outm64)
+	{
+		if ( ENDIAN_TEST_IS_LITTLE )
+			wr64(pvt->addr, 1, 0, 1, v);
+		else
+			wr64(pvt->addr, 0, 1, 0, v);
+		return 0;
+	}
+#endif
+
+/* records with 32-bit values access the low word (devBusMappedGetVal()) */
+static DevBusMappedAccessRec m64   = { 0, 0, inm64,  outm64,  0 };
+static DevBusMappedAccessRec be64  = { 0, 0, inbe64, outbe64, 0 };
+static DevBusMappedAccessRec le64  = { 0, 0, inle64, outle64, 0 };
+static DevBusMappedAccessRec m64s  = { 0, 0, inm64,  outm64,  DEV_BUS_MAPPED_ACC_SIGNED };
+static DevBusMappedAccessRec be64s = { 0, 0, inbe64, outbe64, DEV_BUS_MAPPED_ACC_SIGNED };
+static DevBusMappedAccessRec le64s = { 0, 0, inle64, outle64, DEV_BUS_MAPPED_ACC_SIGNED };
+
+/* IEEE-754; bit patterns are transferred by the integer methods */
+static DevBusMappedAccessRec f32be = { inbe32, outbe32, 0, 0, DEV_BUS_MAPPED_ACC_FLOAT, pstbe32 };
+static DevBusMappedAccessRec f32le = { inle32, outle32, 0, 0, DEV_BUS_MAPPED_ACC_FLOAT, pstle32 };
+static DevBusMappedAccessRec f64be = { 0, 0, inbe64, outbe64, DEV_BUS_MAPPED_ACC_FLOAT };
+static DevBusMappedAccessRec f64le = { 0, 0, inle64, outle64, DEV_BUS_MAPPED_ACC_FLOAT };
+
+static DevBusMappedAccessRec m32   = { inm32, outm32, 0, 0, 0, pstm32 };
+static DevBusMappedAccessRec be32  = { inbe32, outbe32, 0, 0, 0, pstbe32 };
+static DevBusMappedAccessRec le32  = { inle32, outle32, 0, 0, 0, pstle32 };
+static DevBusMappedAccessRec m16   = { inm16, outm16, 0, 0, 0, pstm16 };
+static DevBusMappedAccessRec be16  = { inbe16, outbe16, 0, 0, 0, pstbe16 };
+static DevBusMappedAccessRec le16  = { inle16, outle16, 0, 0, 0, pstle16 };
+static DevBusMappedAccessRec m8    = { inm8, outm8, 0, 0, 0, pst8 };
+static DevBusMappedAccessRec io8   = { in8, out8, 0, 0, 0, pst8 };
+static DevBusMappedAccessRec m16s  = { inm16s, outm16, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pstm16 };
+static DevBusMappedAccessRec be16s = { inbe16s, outbe16, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pstbe16 };
+static DevBusMappedAccessRec le16s = { inle16s, outle16, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pstle16 };
+static DevBusMappedAccessRec m8s   = { inm8s, outm8, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pst8 };
+static DevBusMappedAccessRec io8s  = { in8s, out8, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pst8 };
+static DevBusMappedAccessRec flush = { inflush, outflush };
+
+/* opt-in: masked updates with compare-and-swap rather than under the
+ * device mutex (other drivers must update these words atomically, too)
+ */
+static DevBusMappedAccessRec m32a  = { inm32, outm32, 0, 0, 0, pstm32, MODM32 };
+static DevBusMappedAccessRec m16a  = { inm16, outm16, 0, 0, 0, pstm16, MODM16 };
+static DevBusMappedAccessRec m8a   = { inm8, outm8, 0, 0, 0, pst8, MODM8 };
+static DevBusMappedAccessRec m16as = { inm16s, outm16, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pstm16, MODM16S };
+static DevBusMappedAccessRec m8as  = { inm8s, outm8, 0, 0, DEV_BUS_MAPPED_ACC_SIGNED, pst8, MODM8S };
+
+/* built-in methods; matched by prefix ('s' suffix: signed variant),
+ * longer names first
+ */
+typedef struct AccTblEntRec_ {
+	const char         *name;
+	DevBusMappedAccess  acc;
+	DevBusMappedAccess  accSigned;
+} AccTblEntRec;
+
+static const AccTblEntRec accTbl[] = {
+	{ "m64",   &m64,   &m64s  },
+	{ "be64",  &be64,  &be64s },
+	{ "le64",  &le64,  &le64s },
+	{ "f32be", &f32be, 0      },
+	{ "f32le", &f32le, 0      },
+	{ "f64be", &f64be, 0      },
+	{ "f64le", &f64le, 0      },
+	{ "m32a",  &m32a,  0      },
+	{ "m32",   &m32,   0      },
+	{ "be32",  &be32,  0      },
+	{ "le32",  &le32,  0      },
+	{ "m16a",  &m16a,  &m16as },
+	{ "m16",   &m16,   &m16s  },
+	{ "be16",  &be16,  &be16s },
+	{ "le16",  &le16,  &le16s },
+	{ "m8a",   &m8a,   &m8as  },
+	{ "m8",    &m8,    &m8s   },
+	{ "be8",   &io8,   &io8s  },
+};
+
+/* Records' DevBusMappedPvtRecs are carved out of big chunks (never
+ * freed) rather than malloc()ed one by one.
+ */
+#define PVT_CHUNK_SZ 1024
+
+static DevBusMappedPvt pvtChunk = 0;
+static unsigned        pvtAvail = 0;
+
+/* Names resolved by devBusVmeLinkInit() (device, method, scan list)
+ * are kept in a small direct-mapped cache; the records of a register
+ * map mostly use the same few names. Registry entries are never
+ * removed, hence cached (successful) lookups never become stale.
+ */
+#define NAME_CACHE_LD_SZ  6
+#define NAME_CACHE_MAXLEN 31
+
+typedef struct NameCacheEntRec_ {
+	void               *id;		/* registry id; NULL if unused */
+	void               *val;
+	char               name[NAME_CACHE_MAXLEN + 1];
+} NameCacheEntRec, *NameCacheEnt;
+
+static NameCacheEntRec   nameCache[1 << NAME_CACHE_LD_SZ];
+static epicsMutexId      linkMtx  = 0;
+static epicsThreadOnceId linkOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+linkOnceFn(void *unused)
+{
+	linkMtx = epicsMutexMustCreate();
+}
+
+static DevBusMappedPvt
+pvtAlloc(void)
+{
+DevBusMappedPvt rval = 0;
+
+	epicsMutexMustLock( linkMtx );
+
+	if ( 0 == pvtAvail ) {
+		if ( (pvtChunk = calloc( PVT_CHUNK_SZ, sizeof(*pvtChunk) )) )
+			pvtAvail = PVT_CHUNK_SZ;
+	}
+
+	if ( pvtAvail ) {
+		rval = pvtChunk++;
+		pvtAvail--;
+	}
+
+	epicsMutexUnlock( linkMtx );
+
+	return rval;
+}
+
+/* resolve a device name; numeric 'names' are registered on the fly */
+static void *
+resolveDev(void *id, const char *name)
+{
+uintptr_t       a;
+char            *endp;
+char            buf[20];
+DevBusMappedDev dev;
+
+	a = strtoul(name, &endp, 0);
+	if ( ! *name || *endp )
+		return registryFind(registryId, name);
+
+	/* they specified a number; create a registry entry on the fly... */
+
+	/* make a canonical name */
+	sprintf(buf,"0x%"PRIXPTR,a);
+
+	/* try to find; if that fails, try to create; if this fails, try
+	 * to find again - someone else might have created in the meantime...
+	 */
+	if ( ! (dev = registryFind(registryId, buf)) ) {
+		if ( ! (dev = devBusMappedRegister(buf, (volatile void *)a)) )
+			dev = registryFind(registryId, buf);
+	}
+	return dev;
+}
+
+/* resolve a method name: user-registered methods first, then built-ins */
+static void *
+resolveAcc(void *id, const char *name)
+{
+void     *found;
+unsigned i;
+size_t   l;
+
+	if ( (found = registryFind( ioRegistryId, name )) ) {
+	} else if ( !strcmp(name, "flush") ) {
+		found = &flush;
+	} else {
+		for ( i = 0; i < sizeof(accTbl)/sizeof(accTbl[0]); i++ ) {
+			l = strlen( accTbl[i].name );
+			if ( !strncmp( name, accTbl[i].name, l ) ) {
+				found = ( accTbl[i].accSigned && 's' == name[l] ) ? accTbl[i].accSigned : accTbl[i].acc;
+				break;
+			}
+		}
+	}
+
+	/* name the method's counters */
+	if ( found )
+		devBusMappedStatsCreate( found, name );
+
+	return found;
+}
+
+static void *
+resolveScan(void *id, const char *name)
+{
+	return registryFind( ioscanRegistryId, name );
+}
+
+/* Look up 'len' chars at 'name' (not NUL-terminated) in the cache;
+ * call 'resolve' on a miss.
+ */
+static void *
+cachedFind(void *id, const char *name, size_t len, void *(*resolve)(void*, const char*))
+{
+char         buf[128];
+char         *nm = buf;
+uint32_t     h   = 2166136261U;
+size_t       i;
+NameCacheEnt e;
+void         *rval;
+
+	/* FNV-1a */
+	for ( i = 0; i < len; i++ ) {
+		h ^= (unsigned char)name[i];
+		h *= 16777619U;
+	}
+	h ^= (uint32_t)(uintptr_t)id;
+	e  = &nameCache[ (h ^ (h >> 16)) & ((1 << NAME_CACHE_LD_SZ) - 1) ];
+
+	epicsMutexMustLock( linkMtx );
+	if ( e->id == id && len <= NAME_CACHE_MAXLEN && !strncmp( e->name, name, len ) && 0 == e->name[len] ) {
+		rval = e->val;
+		epicsMutexUnlock( linkMtx );
+		return rval;
+	}
+	epicsMutexUnlock( linkMtx );
+
+	if ( len >= sizeof(buf) && ! (nm = malloc( len + 1 )) )
+		return 0;
+	memcpy( nm, name, len );
+	nm[len] = 0;
+
+	if ( (rval = resolve( id, nm )) && len <= NAME_CACHE_MAXLEN ) {
+		epicsMutexMustLock( linkMtx );
+			e->id  = id;
+			e->val = rval;
+			strcpy( e->name, nm );
+		epicsMutexUnlock( linkMtx );
+	}
+
+	if ( nm != buf )
+		free( nm );
+
+	return rval;
+}
 
 unsigned long
 devBusVmeLinkInit(DBLINK *l, DevBusMappedPvt pvt, dbCommon *prec)
 {
-char          *plus,*comma,*comma1,*cp;
-unsigned long offset = 0;
-uintptr_t     rval   = 0;
-char          *base  = 0;
-char          *endp;
+const char    *p, *name, *endp;
+size_t        len;
+unsigned long offset   = 0;
+uintptr_t     rval     = 0;
+const char    *pollSpec = 0;
+void          *found;
+
+	epicsThreadOnce( &linkOnce, linkOnceFn, 0 );
 
 	if ( !pvt ) {
-		assert( pvt = malloc( sizeof(*pvt) ) );
+		assert( pvt = pvtAlloc() );
 		prec->dpvt = pvt;
 	}
 
 	pvt->prec = prec;
-	pvt->acc = &be32;
+	pvt->acc  = &be32;
+	pvt->dev  = 0;
+	pvt->scan = 0;
+	pvt->lin  = 0;
 
     switch (l->type) {
 
@@ -125,101 +518,47 @@ char          *endp;
 
     case (VME_IO) :
 
-			base = cp = malloc(strlen(l->value.vmeio.parm) + 1);
-			strcpy(cp,l->value.vmeio.parm);
-
-			if ( (plus=strchr(cp,'+')) ) {
-				*plus++=0;
-				cp = plus;
-			}
-			if ( (comma=strchr(cp,',')) ) {
-				*comma++=0;
-				cp = comma;
-			}
-			if ( (comma1=strchr(cp,',')) ) {
-				*comma1++=0;
-				cp = comma1;
-			}
-
-			if ( plus ) {
-				offset = strtoul(plus, &endp, 0);
-				if ( !*plus || *endp ) {
+			/* single pass over <device>[+<offset>][,<method>[,<scan>]]
+			 * without copying the string
+			 */
+			p    = l->value.vmeio.parm;
+			name = p;
+			len  = strcspn(p, "+,");
+			p   += len;
+
+			if ( '+' == *p ) {
+				p++;
+				offset = strtoul(p, (char**)&endp, 0);
+				if ( endp == p || (*endp && ',' != *endp) ) {
 					recGblRecordError(S_db_badField, (void*)prec,
 									  "devXXBus (init_record) Invalid OFFSET string");
 					break;
 				}
+				p = endp;
 			}
 
-			rval = strtoul(base, &endp, 0);
-			if ( *base && !*endp ) {
-				int  i;
-				char buf[15];
-				/* they specified a number; create a registry entry on the fly... */
-
-				/* make a canonical name */
-				sprintf(buf,"0x%"PRIXPTR,rval);
-
-				/* try to find; if that fails, try to create; if this fails, try
-				 * to find again - someone else might have created in the meantime...
-				 */
-				for ( i = 0;  ! (pvt->dev = (DevBusMappedDev)registryFind(registryId, buf)) && i < 1; i++ ) {
-					if ( (pvt->dev = devBusMappedRegister(buf, (volatile void *)rval)) )
-						break;
-				}
-			} else {
-				pvt->dev = (DevBusMappedDev)registryFind(registryId, base);
-			}
-
-			if ( pvt->dev ) {
+			if ( (pvt->dev = cachedFind( registryId, name, len, resolveDev )) ) {
 				rval  = (uintptr_t)pvt->dev->baseAddr;
 				rval += l->value.vmeio.card << l->value.vmeio.signal;
-			} else {
-				rval = 0;
 			}
 
-			if ( comma ) {
-				void *found;
-				if ( (found = registryFind( ioRegistryId, comma )) ) {
-					pvt->acc = found;
-				} else
-				if ( !strncmp(comma,"m32",3) ) {
-					pvt->acc = &m32;
-				} else
-				if ( !strncmp(comma,"be32",4) ) {
-					pvt->acc = &be32;
-				} else
-				if ( !strncmp(comma,"le32",4) ) {
-					pvt->acc = &le32;
-				} else
-				if ( !strncmp(comma,"m16",3) ) {
-					pvt->acc = ('s'==comma[3] ? &m16s : &m16);
-				} else
-				if ( !strncmp(comma,"be16",4) ) {
-					pvt->acc = ('s'==comma[4] ? &be16s : &be16);
-				} else
-				if ( !strncmp(comma,"le16",4) ) {
-					pvt->acc = ('s'==comma[4] ? &le16s : &le16);
-				} else
-				if ( !strncmp(comma,"m8",2) ) {
-					pvt->acc = ('s'==comma[2] ? &m8s : &m8);
-				} else
-				if ( !strncmp(comma,"be8",3) ) {
-					pvt->acc = ('s'==comma[3] ? &io8s : &io8);
-				} else {
+			if ( ',' == *p ) {
+				name = ++p;
+				len  = strcspn(p, ",");
+				p   += len;
+				if ( ! (found = cachedFind( ioRegistryId, name, len, resolveAcc )) ) {
 					recGblRecordError(S_db_badField, (void*)prec,
 									  "devXXBus (init_record) Invalid ACCESS string");
 					break;
 				}
+				pvt->acc = found;
 			}
 
-			pvt->scan = 0;
-			if ( comma1 ) {
-				void *found;
-				if ( (found = registryFind( ioscanRegistryId, comma1 )) ) {
-					pvt->scan = found;
-				} else {
-					recGblRecordError(S_db_badField, (void*)prec,
-									  "devXXBus (init_record) Invalid IOSCANPVT string");
+			if ( ',' == *p ) {
+				name = ++p;
+				if ( ! (pvt->scan = cachedFind( ioscanRegistryId, name, strlen(name), resolveScan )) ) {
+					/* maybe a poller; need the address first */
+					pollSpec = name;
 				}
 			}
 
@@ -227,12 +566,23 @@ char          *endp;
 		break;
     }
 
-	free(base);
-
 	if (rval)
 		rval += offset;
 
-	pvt->addr = (volatile void*)rval;
+	pvt->addr     = (volatile void*)rval;
+	pvt->accStats = devBusMappedStatsCreate( pvt->acc, &be32 == pvt->acc ? "be32" : 0 );
+
+	/* e.g., the sim methods refuse devices which are not simulated */
+	if ( rval && pvt->acc->init && pvt->acc->init( pvt ) ) {
+		recGblRecordError(S_db_badField, (void*)prec,
+						  "devXXBus (init_record) ACCESS method not applicable to this device");
+		rval = 0;
+	}
+
+	if ( rval && pollSpec && ! (pvt->scan = devBusMappedPollerAttach(pollSpec, pvt)) ) {
+		recGblRecordError(S_db_badField, (void*)prec,
+						  "devXXBus (init_record) Invalid IOSCANPVT or poller string");
+	}
 
 	if ( 0 == rval )
 		prec->pact = TRUE;
@@ -240,14 +590,42 @@ char          *endp;
 	return !rval;
 }
 
+#ifndef DEV_BUS_MAPPED_NO_STATS
+#define statsBeg() ( devBusMappedStatsOn ? epicsMonotonicGet() : (epicsUInt64)0 )
+
+static __inline__ void
+statsEnd(DevBusMappedPvt pvt, int isWrite, int err, epicsUInt64 t)
+{
+	if ( t )
+		devBusMappedStatsAdd( pvt, isWrite, err, epicsMonotonicGet() - t );
+}
+#else
+#define statsBeg()             ((epicsUInt64)0)
+#define statsEnd(pvt,w,e,t)    ((void)(t))
+#endif
+
 /* invoke the access method and do common work
  * (raise alarms)
  */
 int
 devBusMappedGetVal(DevBusMappedPvt pvt, epicsUInt32 *pvalue, dbCommon *prec)
 {
-int rval = pvt->acc->rd(pvt, pvalue, prec);
-	if ( rval )
+int         rval;
+epicsUInt64 v, t;
+
+	if ( pvt->dev && pvt->dev->wc )
+		devBusMappedFlush(pvt->dev);
+
+	t = statsBeg();
+	if ( pvt->acc->rd ) {
+		rval = pvt->acc->rd(pvt, pvalue, prec);
+	} else {
+		/* 64-bit only method; use the low word */
+		rval = pvt->acc->rd64(pvt, &v, prec);
+		*pvalue = (epicsUInt32)v;
+	}
+	statsEnd(pvt, 0, rval, t);
+	if ( rval && prec )
 		recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
 	return rval;
 }
@@ -255,12 +633,166 @@ int rval = pvt->acc->rd(pvt, pvalue, prec);
 int
 devBusMappedPutVal(DevBusMappedPvt pvt, epicsUInt32 value, dbCommon *prec)
 {
-int rval = pvt->acc->wr(pvt, value, prec);
+int         rval;
+epicsUInt64 v, t;
+
+	t = statsBeg();
+	if ( pvt->dev && pvt->dev->wc ) {
+		if ( pvt->acc->wrp && 0 == devBusMappedWcPost(pvt, value) ) {
+			statsEnd(pvt, 1, 0, t);
+			return 0;
+		}
+		/* not posted; order after queued writes */
+		devBusMappedFlush(pvt->dev);
+		t = statsBeg();
+	}
+
+	if ( pvt->acc->wr ) {
+		rval = pvt->acc->wr(pvt, value, prec);
+	} else {
+		/* 64-bit only method; merge into the low word. The
+		 * caller holds the device mutex.
+		 */
+		if ( 0 == (rval = pvt->acc->rd64(pvt, &v, prec)) ) {
+			v = (v & ~(epicsUInt64)0xffffffff) | value;
+			rval = pvt->acc->wr64(pvt, v, prec);
+		}
+	}
+	statsEnd(pvt, 1, rval, t);
+	if ( rval )
+		recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+	return rval;
+}
+
+int
+devBusMappedModify(DevBusMappedPvt pvt, epicsUInt32 mask, epicsUInt32 value, epicsUInt32 *pold, dbCommon *prec)
+{
+int         rval;
+epicsUInt32 o;
+epicsUInt64 t;
+
+	/* queued (posted) writes are computed under the mutex; mixing in
+	 * lock-free updates could lose them
+	 */
+	if ( pvt->acc->mod && ! (pvt->dev && pvt->dev->wc) ) {
+		t    = statsBeg();
+		rval = pvt->acc->mod(pvt, mask, value, &o, prec);
+		statsEnd(pvt, 1, rval, t);
+		if ( rval ) {
+			recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+		} else if ( pold ) {
+			*pold = o;
+		}
+		return rval;
+	}
+
+devBusMappedLock(pvt);
+	if ( 0 == (rval = devBusMappedGetVal(pvt, &o, prec)) ) {
+		if ( pold )
+			*pold = o;
+		rval = devBusMappedPutVal(pvt, (o & ~mask) | (value & mask), prec);
+	}
+devBusMappedUnlock(pvt);
+
+	return rval;
+}
+
+int
+devBusMappedGetVal64(DevBusMappedPvt pvt, epicsUInt64 *pvalue, dbCommon *prec)
+{
+int         rval;
+epicsUInt32 v;
+epicsUInt64 t;
+
+	if ( pvt->dev && pvt->dev->wc )
+		devBusMappedFlush(pvt->dev);
+
+	t = statsBeg();
+	if ( pvt->acc->rd64 ) {
+		rval = pvt->acc->rd64(pvt, pvalue, prec);
+	} else {
+		rval = pvt->acc->rd(pvt, &v, prec);
+		*pvalue = (pvt->acc->flags & DEV_BUS_MAPPED_ACC_SIGNED) ?
+		              (epicsUInt64)(epicsInt64)(epicsInt32)v : (epicsUInt64)v;
+	}
+	statsEnd(pvt, 0, rval, t);
+	if ( rval && prec )
+		recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+	return rval;
+}
+
+int
+devBusMappedPutVal64(DevBusMappedPvt pvt, epicsUInt64 value, dbCommon *prec)
+{
+int         rval;
+epicsUInt64 t;
+	if ( ! pvt->acc->wr64 )
+		return devBusMappedPutVal(pvt, (epicsUInt32)value, prec);
+	if ( pvt->dev && pvt->dev->wc )
+		devBusMappedFlush(pvt->dev);
+	t    = statsBeg();
+	rval = pvt->acc->wr64(pvt, value, prec);
+	statsEnd(pvt, 1, rval, t);
 	if ( rval )
 		recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
 	return rval;
 }
 
+typedef union {
+	epicsUInt32  u;
+	epicsFloat32 f;
+} BusMappedF32U;
+
+typedef union {
+	epicsUInt64  u;
+	epicsFloat64 f;
+} BusMappedF64U;
+
+int
+devBusMappedGetDouble(DevBusMappedPvt pvt, double *pvalue, dbCommon *prec)
+{
+int           rval;
+BusMappedF32U u32;
+BusMappedF64U u64;
+
+	if ( (pvt->acc->flags & DEV_BUS_MAPPED_ACC_FLOAT) && ! pvt->acc->rd64 ) {
+		if ( 0 == (rval = devBusMappedGetVal(pvt, &u32.u, prec)) )
+			*pvalue = u32.f;
+	} else {
+		if ( 0 == (rval = devBusMappedGetVal64(pvt, &u64.u, prec)) ) {
+			if ( (pvt->acc->flags & DEV_BUS_MAPPED_ACC_FLOAT) )
+				*pvalue = u64.f;
+			else if ( (pvt->acc->flags & DEV_BUS_MAPPED_ACC_SIGNED) )
+				*pvalue = (double)(epicsInt64)u64.u;
+			else
+				*pvalue = (double)u64.u;
+		}
+	}
+	return rval;
+}
+
+int
+devBusMappedPutDouble(DevBusMappedPvt pvt, double value, dbCommon *prec)
+{
+BusMappedF32U u32;
+BusMappedF64U u64;
+
+	if ( (pvt->acc->flags & DEV_BUS_MAPPED_ACC_FLOAT) ) {
+		if ( ! pvt->acc->wr64 ) {
+			u32.f = (epicsFloat32)value;
+			return devBusMappedPutVal(pvt, u32.u, prec);
+		}
+		u64.f = value;
+	} else if ( value >= 0. && ! (pvt->acc->flags & DEV_BUS_MAPPED_ACC_SIGNED) ) {
+		/* round to nearest; unsigned values may exceed 2^63 */
+		u64.u = (epicsUInt64)( value + .5 );
+	} else {
+		/* round to nearest */
+		u64.u = (epicsUInt64)(epicsInt64)( value < 0. ? value - .5 : value + .5 );
+	}
+	return devBusMappedPutVal64(pvt, u64.u, prec);
+}
+
 
 /* Register a device's base address and return a pointer to a
  * freshly allocated 'DevBusMappedDev' struct or NULL on failure.
@@ -275,6 +807,9 @@ DevBusMappedDev	rval = 0, d;
 		 * is atomical...
 		 */
 		d->baseAddr = baseAddress;
+		d->udata    = 0;
+		d->wc       = 0;
+		d->stats    = 0;
 		strcpy((char*)d->name, name);
 		if ( (d->mutex = epicsMutexCreate()) ) {
 			/* NOTE: the registry keeps a pointer to the name and
@@ -283,6 +818,7 @@ DevBusMappedDev	rval = 0, d;
 			 */
 			if ( registryAdd( registryId, d->name, d ) ) {
 				rval = d; d = 0;
+				rval->stats = devBusMappedStatsCreate( 0, rval->name );
 			}
 		}
 	}
@@ -31,6 +31,10 @@
  *  The 'm' methods are appropriate to access variables in memory
  *  (cpu endianness).
  *
+ *  64-bit registers are accessed with 'be64', 'le64' or 'm64' and
+ *  IEEE-754 floating-point registers with 'f32be', 'f32le', 'f64be'
+ *  or 'f64le'.
+ *
  *  In addition, user supported access methods are supported. A driver
  *  can register its own DevBusMappedAccessRec with a call to
  *  'devBusMappedRegisterIO()' which is then free to do any kind
@@ -49,6 +53,7 @@
 #include <epicsMutex.h>
 #include <epicsTypes.h>
 #include <link.h>
+#include <epicsTime.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,6 +61,8 @@ extern "C" {
 
 typedef struct DevBusMappedPvtRec_ *DevBusMappedPvt;
 typedef struct DevBusMappedAccessRec_ *DevBusMappedAccess;
+typedef struct DevBusMappedStatsRec_ *DevBusMappedStats;
+typedef struct DevBusMappedLinRec_ *DevBusMappedLin;
 
 /* Read and write methods which are used by the device support 'read' and 'write'
  * routines.
@@ -63,13 +70,50 @@ typedef struct DevBusMappedAccessRec_ *DevBusMappedAccess;
 typedef int (*DevBusMappedRead)(DevBusMappedPvt pvt, epicsUInt32 *pvalue, dbCommon *prec);
 typedef int (*DevBusMappedWrite)(DevBusMappedPvt pvt, epicsUInt32 value, dbCommon *prec);
 
+/* 64-bit variants */
+typedef int (*DevBusMappedRead64)(DevBusMappedPvt pvt, epicsUInt64 *pvalue, dbCommon *prec);
+typedef int (*DevBusMappedWrite64)(DevBusMappedPvt pvt, epicsUInt64 value, dbCommon *prec);
+
+/* Atomic masked read-modify-write: replace the bits in 'mask' by those
+ * of 'value' and return the previous register contents in *pold.
+ */
+typedef int (*DevBusMappedModify)(DevBusMappedPvt pvt, epicsUInt32 mask, epicsUInt32 value, epicsUInt32 *pold, dbCommon *prec);
+
+/* Check that the method may be used on the record's device/register
+ * and set up 'udata'; RETURNS: 0 if OK.
+ */
+typedef int (*DevBusMappedInit)(DevBusMappedPvt pvt);
+
+/* The 64-bit routines and flags are optional (older code which only
+ * initializes 'rd' and 'wr' keeps working). A method may provide
+ * 32-bit and/or 64-bit routines. If 'DEV_BUS_MAPPED_ACC_FLOAT' is set
+ * then the routines transfer the bit pattern of an IEEE-754 'float'
+ * (rd/wr) or 'double' (rd64/wr64), respectively.
+ */
+#define DEV_BUS_MAPPED_ACC_FLOAT	(1<<0)	/* raw data are IEEE-754 floats      */
+#define DEV_BUS_MAPPED_ACC_SIGNED	(1<<1)	/* data are signed (rd64 emulation, ai/ao) */
+
 typedef struct DevBusMappedAccessRec_ {
 	DevBusMappedRead	rd;		/* read access routine				 */
 	DevBusMappedWrite	wr;		/* read access routine				 */
+	DevBusMappedRead64	rd64;	/* 64-bit read access routine (may be NULL)  */
+	DevBusMappedWrite64	wr64;	/* 64-bit write access routine (may be NULL) */
+	unsigned			flags;
+	DevBusMappedWrite	wrp;	/* 'posted' write without barrier (may be NULL);
+								 * needed for write-combining (see below).
+								 */
+	DevBusMappedModify	mod;	/* lock-free masked update (may be NULL);
+								 * see devBusMappedModify().
+								 */
+	DevBusMappedInit	init;	/* called by devBusVmeLinkInit() (may be NULL);
+								 * nonzero fails the record's initialization.
+								 */
 } DevBusMappedAccessRec;
 
 /* invoke the access methods and raise alarms if the access
- * fails.
+ * fails. The 'get' routines may be called with a NULL 'prec'
+ * outside of record processing (e.g., by pollers); no alarm is
+ * raised then (and the method is passed the NULL 'prec').
  */
 int
 devBusMappedGetVal(DevBusMappedPvt pvt, epicsUInt32 *pvalue, dbCommon *prec);
@@ -77,6 +121,46 @@ devBusMappedGetVal(DevBusMappedPvt pvt, epicsUInt32 *pvalue, dbCommon *prec);
 int
 devBusMappedPutVal(DevBusMappedPvt pvt, epicsUInt32 value, dbCommon *prec);
 
+/* Replace the bits in 'mask' by those of 'value'; the previous
+ * contents are stored in *pold (if non-NULL).
+ *
+ * By default this is a read-modify-write under the device mutex.
+ * Methods with a 'mod' routine (only the opt-in CPU-endian memory
+ * methods m8a/m16a/m32a, where the CPU has lock-free atomics of that
+ * size) use compare-and-swap instead and don't take the mutex; devices
+ * with write-combining enabled always use the mutex.
+ *
+ * NOTE: drivers which modify registers accessed through the 'a'
+ *       methods must themselves use atomic operations (or
+ *       devBusMappedModify()) rather than rely on the device mutex.
+ */
+int
+devBusMappedModify(DevBusMappedPvt pvt, epicsUInt32 mask, epicsUInt32 value, epicsUInt32 *pold, dbCommon *prec);
+
+/* Same for 64-bit values. If the method has no 64-bit routines then
+ * the 32-bit ones are used (sign-extending if the method is signed).
+ */
+int
+devBusMappedGetVal64(DevBusMappedPvt pvt, epicsUInt64 *pvalue, dbCommon *prec);
+
+int
+devBusMappedPutVal64(DevBusMappedPvt pvt, epicsUInt64 value, dbCommon *prec);
+
+/* Read/write a value as a 'double', converting from/to float or
+ * (signed) integer representation as the method requires.
+ */
+int
+devBusMappedGetDouble(DevBusMappedPvt pvt, double *pvalue, dbCommon *prec);
+
+int
+devBusMappedPutDouble(DevBusMappedPvt pvt, double value, dbCommon *prec);
+
+/* Records with a RVAL field (ai/ao) bypass RVAL and read/write VAL
+ * directly if the method transfers floats or more than 32 bits.
+ */
+#define devBusMappedDirectVal(pvt) \
+	( ((pvt)->acc->flags & DEV_BUS_MAPPED_ACC_FLOAT) || (pvt)->acc->rd64 )
+
 /* "per-device" information kept in the registry */
 typedef struct DevBusMappedDevRec_ {
 	volatile void *baseAddr;
@@ -85,6 +169,9 @@ typedef struct DevBusMappedDevRec_ {
                                  * performing modifications or non-atomical reads.
 								 */
 	void          *udata;		/* for use by the driver / user */
+	struct DevBusMappedWcRec_
+	              *wc;			/* write-combining queue (NULL if disabled) */
+	DevBusMappedStats stats;	/* performance counters                     */
 	const char    name[1];		/* space for the terminating NULL; the entire string
 								 * is appended here, however.
 								 */
@@ -107,12 +194,78 @@ typedef struct DevBusMappedPvtRec_ {
 	IOSCANPVT			scan;	/* io intr scan list for 'prec'      */
 	void				*udata;	/* private data for access methods   */
 	volatile void		*addr;	/* reg. address (offset from base)   */
+	DevBusMappedStats	accStats; /* counters of the access method   */
+	DevBusMappedLin		lin;	/* ai linearization table or NULL    */
 } DevBusMappedPvtRec;
 
+/*
+ * Performance counters
+ *
+ * If enabled (devBusMappedStatsEnable()) devBusMapped counts reads,
+ * writes and errors and measures the (cumulative and max) access time
+ * per device and per access method as well as the time spent waiting
+ * for a device's mutex (contended acquisitions only) if the mutex is
+ * taken with devBusMappedLock(). The counters may be printed with
+ * devBusMappedReport() (also 'dbior') or read by ai records
+ * (DTYP "BusAddress Stats").
+ *
+ * Compiling with -DDEV_BUS_MAPPED_NO_STATS removes the overhead
+ * entirely.
+ */
+extern volatile int devBusMappedStatsOn;
+
+/* Enable (nonzero) or disable counting */
+void
+devBusMappedStatsEnable(int on);
+
+/* Zero all counters */
+void
+devBusMappedStatsReset(void);
+
+/* Print counters of all devices (level > 0: also of all methods) */
+void
+devBusMappedReport(int level);
+
+/* Used internally */
+void
+devBusMappedStatsLockWait(DevBusMappedDev dev, epicsUInt64 ns);
+
+void
+devBusMappedStatsAdd(DevBusMappedPvt pvt, int isWrite, int err, epicsUInt64 ns);
+
+DevBusMappedStats
+devBusMappedStatsCreate(DevBusMappedAccess acc, const char *name);
+
+/* Lock/unlock the device mutex (recording contention if enabled) */
+static __inline__ void
+devBusMappedLock(DevBusMappedPvt pvt)
+{
+#ifndef DEV_BUS_MAPPED_NO_STATS
+epicsUInt64 t;
+
+	if ( devBusMappedStatsOn ) {
+		if ( epicsMutexLockOK == epicsMutexTryLock( pvt->dev->mutex ) )
+			return;
+		t = epicsMonotonicGet();
+		epicsMutexLock( pvt->dev->mutex );
+		devBusMappedStatsLockWait( pvt->dev, epicsMonotonicGet() - t );
+		return;
+	}
+#endif
+	epicsMutexLock( pvt->dev->mutex );
+}
+
+static __inline__ void
+devBusMappedUnlock(DevBusMappedPvt pvt)
+{
+	epicsMutexUnlock( pvt->dev->mutex );
+}
+
 /* Parse the link in *l and setup the pvt structure; the
  * caller may pass a preallocated pvt struct.
- * If she passes 'pvt==NULL' a PvtRec is allocated and attached
- * to prec->dpvt. If pvt is non-NULL, it is _not_ attached.
+ * If she passes 'pvt==NULL' a PvtRec is allocated (from a pool;
+ * it must not be free()d) and attached to prec->dpvt. If pvt is
+ * non-NULL, it is _not_ attached.
  *
  * (Reason for passing 'l' is that we don't know whether prec has
  * 'inp' or 'out'...)
@@ -134,6 +287,129 @@ devBusVmeLinkInit(DBLINK *l, DevBusMappedPvt pvt, dbCommon *prec);
 DevBusMappedDev
 devBusMappedRegister(const char *name, volatile void * baseAddress);
 
+/*
+ * Map 'size' bytes at 'offset' of file 'path' (linux only) and register
+ * the result as device 'name'. Useful for
+ *
+ *  - PCI BARs: /sys/bus/pci/devices/<domain:bus:dev.fn>/resource<N>
+ *    (mapped uncached; the 'wc' option maps 'resource<N>_wc' instead,
+ *    i.e., write-combining which is available for prefetchable BARs),
+ *  - UIO devices: /dev/uio<N>; 'offset' is relative to the start of the
+ *    region described by the map selected by the 'map=<n>' option
+ *    (default 0) and must be within the map,
+ *  - /dev/mem (opened with O_SYNC, i.e., uncached),
+ *  - plain files (e.g., to test without hardware).
+ *
+ * A 'size' of zero maps the entire file/UIO map. 'opts' is a
+ * comma-separated list (may be NULL) of
+ *
+ *   ro          map read-only,
+ *   wc          write-combining (PCI resource files),
+ *   map=<n>     UIO map number,
+ *   irq[=<nm>]  UIO only: register a scan list (named <nm>, the device
+ *               name by default) processed on every interrupt
+ *               (see devBusMappedUioIrq()).
+ *
+ * RETURNS: the new device or NULL on failure.
+ */
+DevBusMappedDev
+devBusMappedMapFile(const char *name, const char *path, unsigned long offset, unsigned long size, const char *opts);
+
+/*
+ * Register a scan list 'scanName' and start a thread which requests
+ * it to be scanned whenever a 32-bit interrupt count can be read from
+ * 'path' (a UIO device, or e.g. a FIFO for testing). UIO interrupts are
+ * re-enabled (by writing 1) before waiting.
+ *
+ * RETURNS: 0 on success, nonzero on failure.
+ */
+int
+devBusMappedUioIrq(const char *scanName, const char *path);
+
+/*
+ * Interrupt demultiplexer
+ *
+ * Many boards raise a single interrupt and indicate the source(s) in
+ * a status register. A demultiplexer reads the status register (once
+ * per interrupt), optionally acknowledges the pending bits and requests
+ * only the scan lists of the bits which are set. The scan lists are
+ * registered (devBusMappedRegisterIOScan()) as "<name>:<bit>", e.g.
+ *
+ *   #C0 S0 @myDevice+0x20,be32,myIrq:5
+ *
+ * The status (and acknowledge) register is given as
+ * "<device>+<offset>[,<method>]"; 'mask' selects the bits to handle
+ * (0: all).
+ */
+#define DEV_BUS_MAPPED_IRQ_ACK_NONE  0	/* status clears on read / driver acks      */
+#define DEV_BUS_MAPPED_IRQ_ACK_W1C   1	/* write pending bits (write-one-to-clear)  */
+#define DEV_BUS_MAPPED_IRQ_ACK_W0C   2	/* write ~pending bits (write-zero-to-clear) */
+#define DEV_BUS_MAPPED_IRQ_ACK_CONST 3	/* write 'ackVal'                           */
+
+typedef struct DevBusMappedIrqDemuxRec_ *DevBusMappedIrqDemux;
+
+/* Create demultiplexer 'name'; 'ackReg' may be NULL (use the status
+ * register). RETURNS: handle or NULL on failure.
+ */
+DevBusMappedIrqDemux
+devBusMappedIrqDemuxCreate(const char *name, const char *statusReg, epicsUInt32 mask, int ackMode, epicsUInt32 ackVal, const char *ackReg);
+
+/* RETURNS: demultiplexer registered under 'name' or NULL */
+DevBusMappedIrqDemux
+devBusMappedIrqDemuxFind(const char *name);
+
+/*
+ * Handle an interrupt; may be called from an ISR (if the access methods
+ * may) or an IRQ thread. Interrupts of UIO devices (devBusMappedUioIrq())
+ * are dispatched automatically to the demultiplexer with the same name
+ * as the UIO scan list.
+ *
+ * RETURNS: the bits which were handled.
+ */
+epicsUInt32
+devBusMappedIrqDemux(DevBusMappedIrqDemux d);
+
+/* Print counters (level > 0: per bit) */
+void
+devBusMappedIrqDemuxReport(const char *name, int level);
+
+/*
+ * Linearization tables
+ *
+ * A table is a list of (raw, value) points with strictly ascending raw
+ * values; it is loaded once and shared by all records referring to it.
+ * ai records select a table with the info tag
+ *
+ *   info(BusLinTable, "myTable")
+ *
+ * The raw register value (after sign extension/conversion) is then
+ * interpolated piecewise linearly; ASLO/AOFF are applied to the result.
+ * Raw values outside of the table are clamped and raise a HW_LIMIT alarm.
+ * Tables with equidistant raw values are evaluated in constant time.
+ */
+
+/* Create table 'name' from 'n' points. RETURNS: handle or NULL on failure */
+DevBusMappedLin
+devBusMappedLinCreate(const char *name, const double *x, const double *y, unsigned n);
+
+/* Load table 'name' from a file of '<raw> <value>' lines ('#' starts a comment) */
+DevBusMappedLin
+devBusMappedLinLoad(const char *name, const char *fileName);
+
+/* RETURNS: table registered under 'name' or NULL */
+DevBusMappedLin
+devBusMappedLinFind(const char *name);
+
+/* Evaluate a single value; '*pOutOfRange' (may be NULL) is set if 'raw' was clamped */
+double
+devBusMappedLinEval1(DevBusMappedLin t, double raw, int *pOutOfRange);
+
+/* Evaluate 'n' values (e.g., a block read by a driver); written so
+ * the compiler can vectorize it. RETURNS: number of clamped values.
+ */
+unsigned
+devBusMappedLinEval(DevBusMappedLin t, const double *raw, double *out, unsigned n);
+
 /* Register an IO access method; returns 0 on success, nonzero on failure */
 int
 devBusMappedRegisterIO(const char *name, DevBusMappedAccess accessMethods);
@@ -142,10 +418,83 @@ devBusMappedRegisterIO(const char *name, DevBusMappedAccess accessMethods);
 int
 devBusMappedRegisterIOScan(const char *name, IOSCANPVT scan);
 
+/*
+ * Pollers
+ *
+ * A poller thread reads registers at a fixed rate and requests an
+ * I/O Intr scan of the records attached to a register only if the
+ * (masked) value changed (by more than a deadband). Records select
+ * a poller instead of a registered IOSCANPVT:
+ *
+ *   #C<inst> S<shift> @<theDevice>+<offset>,<method>,<poller>[:<mask>[:<deadband>]]
+ *
+ * Records with identical register, method, mask and deadband share a
+ * single read and scan list.
+ */
+
+/* Create a poller thread running at 'hz'; returns 0 on success */
+int
+devBusMappedPollerCreate(const char *name, double hz);
+
+/* Used by devBusVmeLinkInit(): attach the register described by 'pvt'
+ * to the poller specified by 'spec' (<poller>[:<mask>[:<deadband>]]).
+ *
+ * RETURNS: scan list or NULL if no such poller exists / error.
+ */
+IOSCANPVT
+devBusMappedPollerAttach(const char *spec, DevBusMappedPvt pvt);
+
+/* Print the registers, polls, changes and read errors of all pollers
+ * (level > 0: also per register)
+ */
+void
+devBusMappedPollerReport(int level);
+
 /* Find the 'devBusMappedDev' of a registered device by name */
 DevBusMappedDev
 devBusMappedFind(const char *name);
 
+/*
+ * Write-combining
+ *
+ * Every write through the standard methods is followed by a barrier.
+ * If write-combining is enabled for a device then writes by methods
+ * with a 'posted' routine (all built-in 8/16/32-bit methods) are
+ * queued instead (a later write to the same register replaces a queued
+ * one) and the queue is flushed in ascending address order followed by
+ * a single barrier
+ *
+ *  - from a low-priority callback (i.e., once the scan tasks are idle)
+ *    'delay' seconds after the first write was queued (no callback if
+ *    'delay' < 0),
+ *  - before any other access (read or non-posted write) to the device
+ *    through devBusMapped,
+ *  - when the queue holds 'depth' entries,
+ *  - when a record writes to the device using the 'flush' method
+ *    (e.g., "#C0S0@myDevice,flush" at the end of a FLNK chain),
+ *  - when devBusMappedFlush() is called.
+ *
+ * Do not use for devices where the order of writes to different
+ * registers matters (or use explicit flushes) or where each write has
+ * side effects (FIFOs). Write-combining cannot be disabled once enabled.
+ *
+ * RETURNS: 0 on success, nonzero on error.
+ */
+int
+devBusMappedWriteCombine(const char *name, unsigned depth, double delay);
+
+/* Write out the device's queue (no-op if write-combining is disabled).
+ * Drivers accessing registers directly should call this first.
+ */
+void
+devBusMappedFlush(DevBusMappedDev dev);
+
+/* Used by devBusMappedPutVal(): queue a write (takes the device
+ * mutex). RETURNS: 0 if the write was queued.
+ */
+int
+devBusMappedWcPost(DevBusMappedPvt pvt, epicsUInt32 value);
+
 /* Helper to retrieve the 'scan' (IOSCANPVT) field of a DevBusMappedPvtRec
  * attached to a record's DPVT field.
  */
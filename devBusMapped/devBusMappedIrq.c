@@ -0,0 +1,253 @@
+/* Interrupt demultiplexer: status-register bits -> scan lists */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <registry.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+
+typedef struct DevBusMappedIrqDemuxRec_ {
+	DevBusMappedPvtRec  st;        /* status register      */
+	DevBusMappedPvtRec  ack;       /* acknowledge register */
+	epicsUInt32         mask;
+	int                 ackMode;
+	epicsUInt32         ackVal;
+	unsigned long       nIrq, nSpurious, nErr;
+	unsigned long       nBit[32];
+	IOSCANPVT           scan[32];
+	dbCommon            dummy;     /* for devBusVmeLinkInit() */
+	char                name[];
+} DevBusMappedIrqDemuxRec;
+
+/* just any unique address */
+static void	*demuxRegistryId = (void*)&demuxRegistryId;
+
+static __inline__ unsigned
+ctz32(epicsUInt32 v)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz( v );
+#else
+unsigned b;
+	for ( b = 0; ! (v & 1); b++ )
+		v >>= 1;
+	return b;
+#endif
+}
+
+epicsUInt32
+devBusMappedIrqDemux(DevBusMappedIrqDemux d)
+{
+epicsUInt32 st, pend;
+unsigned    b;
+
+	d->nIrq++;
+
+	/* call the methods directly; devBusMappedGetVal() may lock */
+	if ( d->st.acc->rd( &d->st, &st, &d->dummy ) ) {
+		d->nErr++;
+		return 0;
+	}
+
+	if ( ! (pend = st & d->mask) ) {
+		d->nSpurious++;
+		return 0;
+	}
+
+	switch ( d->ackMode ) {
+		case DEV_BUS_MAPPED_IRQ_ACK_W1C:   d->ack.acc->wr( &d->ack,  pend,     &d->dummy ); break;
+		case DEV_BUS_MAPPED_IRQ_ACK_W0C:   d->ack.acc->wr( &d->ack, ~pend,     &d->dummy ); break;
+		case DEV_BUS_MAPPED_IRQ_ACK_CONST: d->ack.acc->wr( &d->ack, d->ackVal, &d->dummy ); break;
+		default:                                                                           break;
+	}
+
+	/* only scan lists of bits which are set */
+	for ( st = pend; st; st &= st - 1 ) {
+		b = ctz32( st );
+		d->nBit[b]++;
+		scanIoRequest( d->scan[b] );
+	}
+
+	return pend;
+}
+
+DevBusMappedIrqDemux
+devBusMappedIrqDemuxFind(const char *name)
+{
+	return registryFind( demuxRegistryId, name );
+}
+
+static int
+linkInit(DevBusMappedIrqDemux d, DevBusMappedPvt pvt, const char *spec)
+{
+DBLINK lnk;
+
+	memset( &lnk, 0, sizeof(lnk) );
+	lnk.type             = VME_IO;
+	lnk.value.vmeio.parm = (char*)spec;
+
+	if ( devBusVmeLinkInit( &lnk, pvt, &d->dummy ) || ! pvt->acc->rd || ! pvt->acc->wr ) {
+		errlogPrintf("devBusMappedIrqDemuxCreate: invalid register '%s' (need <device>+<offset>,<32-bit method>)\n", spec);
+		return -1;
+	}
+	return 0;
+}
+
+DevBusMappedIrqDemux
+devBusMappedIrqDemuxCreate(const char *name, const char *statusReg, epicsUInt32 mask, int ackMode, epicsUInt32 ackVal, const char *ackReg)
+{
+DevBusMappedIrqDemux d;
+unsigned             b;
+char                 *nm;
+
+	if ( ! name || ! statusReg ) {
+		errlogPrintf("devBusMappedIrqDemuxCreate: need name and status register\n");
+		return 0;
+	}
+
+	if ( ! (d = calloc( 1, sizeof(*d) + strlen(name) + 1 )) ) {
+		errlogPrintf("devBusMappedIrqDemuxCreate: no memory\n");
+		return 0;
+	}
+
+	strcpy( d->name, name );
+	strncpy( d->dummy.name, name, sizeof(d->dummy.name) - 1 );
+	d->mask    = mask ? mask : 0xffffffff;
+	d->ackMode = ackMode;
+	d->ackVal  = ackVal;
+
+	if ( linkInit( d, &d->st, statusReg ) || linkInit( d, &d->ack, ackReg ? ackReg : statusReg ) )
+		goto bail;
+
+	/* registry keeps a pointer to the name; pass our copy */
+	if ( ! registryAdd( demuxRegistryId, d->name, d ) ) {
+		errlogPrintf("devBusMappedIrqDemuxCreate: '%s' exists already\n", name);
+		goto bail;
+	}
+
+	/* from here on we may no longer free 'd' */
+	if ( ! (nm = malloc( strlen(name) + 4 )) ) {
+		errlogPrintf("devBusMappedIrqDemuxCreate: no memory\n");
+		return d;
+	}
+
+	for ( b = 0; b < 32; b++ ) {
+		if ( ! (d->mask & (1u << b)) )
+			continue;
+		scanIoInit( &d->scan[b] );
+		sprintf( nm, "%s:%u", name, b );
+		if ( devBusMappedRegisterIOScan( nm, d->scan[b] ) )
+			errlogPrintf("devBusMappedIrqDemuxCreate: unable to register scan list '%s'\n", nm);
+	}
+	free( nm );
+
+	return d;
+
+bail:
+	free( d );
+	return 0;
+}
+
+void
+devBusMappedIrqDemuxReport(const char *name, int level)
+{
+DevBusMappedIrqDemux d;
+unsigned             b;
+
+	if ( ! name || ! (d = devBusMappedIrqDemuxFind( name )) ) {
+		errlogPrintf("devBusMappedIrqDemuxReport: '%s' not found\n", name ? name : "<NULL>");
+		return;
+	}
+
+	printf("IRQ demultiplexer '%s': %lu interrupts, %lu spurious, %lu read errors\n",
+	       d->name, d->nIrq, d->nSpurious, d->nErr);
+	if ( level > 0 ) {
+		for ( b = 0; b < 32; b++ ) {
+			if ( d->nBit[b] )
+				printf("  %s:%-2u %lu\n", d->name, b, d->nBit[b]);
+		}
+	}
+}
+
+static const iocshArg devBusMappedIrqDemuxCreateArg0 = { "name",                             iocshArgString };
+static const iocshArg devBusMappedIrqDemuxCreateArg1 = { "status register (<dev>+<off>,<method>)", iocshArgString };
+static const iocshArg devBusMappedIrqDemuxCreateArg2 = { "mask (0: all bits)",               iocshArgString };
+static const iocshArg devBusMappedIrqDemuxCreateArg3 = { "ack (none|w1c|w0c|<value>)",       iocshArgString };
+static const iocshArg devBusMappedIrqDemuxCreateArg4 = { "ack register (default: status)",   iocshArgString };
+
+static const iocshArg *devBusMappedIrqDemuxCreateArgs[] = {
+	&devBusMappedIrqDemuxCreateArg0,
+	&devBusMappedIrqDemuxCreateArg1,
+	&devBusMappedIrqDemuxCreateArg2,
+	&devBusMappedIrqDemuxCreateArg3,
+	&devBusMappedIrqDemuxCreateArg4,
+};
+
+static const iocshFuncDef devBusMappedIrqDemuxCreateDef = {
+	"devBusMappedIrqDemuxCreate",
+	sizeof(devBusMappedIrqDemuxCreateArgs)/sizeof(devBusMappedIrqDemuxCreateArgs[0]),
+	devBusMappedIrqDemuxCreateArgs
+};
+
+static void
+devBusMappedIrqDemuxCreateCall(const iocshArgBuf *args)
+{
+const char  *ack     = args[3].sval;
+int          ackMode = DEV_BUS_MAPPED_IRQ_ACK_NONE;
+epicsUInt32  ackVal  = 0;
+epicsUInt32  mask    = args[2].sval ? strtoul( args[2].sval, 0, 0 ) : 0;
+char        *endp;
+
+	if ( ! ack || ! *ack || ! strcmp( ack, "none" ) ) {
+		ackMode = DEV_BUS_MAPPED_IRQ_ACK_NONE;
+	} else if ( ! strcmp( ack, "w1c" ) ) {
+		ackMode = DEV_BUS_MAPPED_IRQ_ACK_W1C;
+	} else if ( ! strcmp( ack, "w0c" ) ) {
+		ackMode = DEV_BUS_MAPPED_IRQ_ACK_W0C;
+	} else {
+		ackVal  = strtoul( ack, &endp, 0 );
+		if ( endp == ack || *endp ) {
+			errlogPrintf("devBusMappedIrqDemuxCreate: invalid 'ack' argument\n");
+			return;
+		}
+		ackMode = DEV_BUS_MAPPED_IRQ_ACK_CONST;
+	}
+
+	devBusMappedIrqDemuxCreate( args[0].sval, args[1].sval, mask, ackMode, ackVal,
+	                            args[4].sval && *args[4].sval ? args[4].sval : 0 );
+}
+
+static const iocshArg devBusMappedIrqDemuxReportArg0 = { "name",  iocshArgString };
+static const iocshArg devBusMappedIrqDemuxReportArg1 = { "level", iocshArgInt    };
+
+static const iocshArg *devBusMappedIrqDemuxReportArgs[] = {
+	&devBusMappedIrqDemuxReportArg0,
+	&devBusMappedIrqDemuxReportArg1,
+};
+
+static const iocshFuncDef devBusMappedIrqDemuxReportDef = {
+	"devBusMappedIrqDemuxReport",
+	sizeof(devBusMappedIrqDemuxReportArgs)/sizeof(devBusMappedIrqDemuxReportArgs[0]),
+	devBusMappedIrqDemuxReportArgs
+};
+
+static void
+devBusMappedIrqDemuxReportCall(const iocshArgBuf *args)
+{
+	devBusMappedIrqDemuxReport( args[0].sval, args[1].ival );
+}
+
+static void
+devBusMappedIrqRegistrar(void)
+{
+	iocshRegister( &devBusMappedIrqDemuxCreateDef, devBusMappedIrqDemuxCreateCall );
+	iocshRegister( &devBusMappedIrqDemuxReportDef, devBusMappedIrqDemuxReportCall );
+}
+
+epicsExportRegistrar(devBusMappedIrqRegistrar);
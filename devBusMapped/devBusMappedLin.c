@@ -0,0 +1,282 @@
+/* Linearization tables for devBusMapped analog inputs */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <registry.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+
+/* Tables with equidistant raw values are evaluated without searching
+ * (index = (raw - x0)/dx); others by bisection.
+ */
+typedef struct DevBusMappedLinRec_ {
+	unsigned   n;
+	int        uniform;
+	double     x0, invDx;
+	double     *x;       /* raw values (ascending)          */
+	double     *y;       /* engineering values              */
+	double     *dy;      /* slope per segment (uniform: per index step) */
+	char       name[];
+} DevBusMappedLinRec;
+
+/* just any unique address */
+static void	*linRegistryId = (void*)&linRegistryId;
+
+#define UNIFORM_TOL 1.0E-9
+
+DevBusMappedLin
+devBusMappedLinFind(const char *name)
+{
+	return registryFind( linRegistryId, name );
+}
+
+DevBusMappedLin
+devBusMappedLinCreate(const char *name, const double *x, const double *y, unsigned n)
+{
+DevBusMappedLin t;
+unsigned        i;
+double          dx;
+
+	if ( ! name || n < 2 ) {
+		errlogPrintf("devBusMappedLinCreate: need name and at least 2 points\n");
+		return 0;
+	}
+
+	for ( i = 1; i < n; i++ ) {
+		if ( ! (x[i] > x[i-1]) ) {
+			errlogPrintf("devBusMappedLinCreate: raw values of '%s' must be strictly ascending\n", name);
+			return 0;
+		}
+	}
+
+	if ( ! (t = calloc( 1, sizeof(*t) + strlen(name) + 1 ))
+	     || ! (t->x  = malloc( sizeof(double) * n ))
+	     || ! (t->y  = malloc( sizeof(double) * n ))
+	     || ! (t->dy = malloc( sizeof(double) * n )) ) {
+		errlogPrintf("devBusMappedLinCreate: no memory\n");
+		goto bail;
+	}
+
+	strcpy( t->name, name );
+	t->n  = n;
+	memcpy( t->x, x, sizeof(double) * n );
+	memcpy( t->y, y, sizeof(double) * n );
+
+	dx         = (x[n-1] - x[0]) / (double)(n - 1);
+	t->uniform = 1;
+	for ( i = 1; i < n; i++ ) {
+		if ( fabs( (x[i] - x[i-1]) - dx ) > UNIFORM_TOL * fabs( dx ) )
+			t->uniform = 0;
+	}
+	t->x0    = x[0];
+	t->invDx = 1./dx;
+
+	for ( i = 0; i < n - 1; i++ ) {
+		t->dy[i] = t->uniform ? y[i+1] - y[i] : (y[i+1] - y[i])/(x[i+1] - x[i]);
+	}
+	/* the last point uses the last segment's slope (only hit at x[n-1]) */
+	t->dy[n-1] = t->dy[n-2];
+
+	/* registry keeps a pointer to the name; pass our copy */
+	if ( ! registryAdd( linRegistryId, t->name, t ) ) {
+		errlogPrintf("devBusMappedLinCreate: table '%s' exists already\n", name);
+		goto bail;
+	}
+	return t;
+
+bail:
+	if ( t ) {
+		free( t->x );
+		free( t->y );
+		free( t->dy );
+		free( t );
+	}
+	return 0;
+}
+
+DevBusMappedLin
+devBusMappedLinLoad(const char *name, const char *fileName)
+{
+FILE            *f;
+char            buf[256], *cp;
+double          *x = 0, *y = 0, *p, a, b;
+unsigned        n = 0, cap = 0, line = 0;
+DevBusMappedLin rval = 0;
+
+	if ( ! name || ! fileName ) {
+		errlogPrintf("devBusMappedLinLoad: need table name and file name\n");
+		return 0;
+	}
+
+	if ( ! (f = fopen( fileName, "r" )) ) {
+		errlogPrintf("devBusMappedLinLoad: unable to open '%s'\n", fileName);
+		return 0;
+	}
+
+	while ( fgets( buf, sizeof(buf), f ) ) {
+		line++;
+		if ( (cp = strchr( buf, '#' )) )
+			*cp = 0;
+		for ( cp = buf; ' ' == *cp || '\t' == *cp; cp++ )
+			/* skip white space */;
+		if ( ! *cp || '\n' == *cp || '\r' == *cp )
+			continue;
+		if ( 2 != sscanf( cp, "%lf %lf", &a, &b ) ) {
+			errlogPrintf("devBusMappedLinLoad: %s:%u: expected '<raw> <value>'\n", fileName, line);
+			goto bail;
+		}
+		if ( n == cap ) {
+			cap = cap ? 2*cap : 256;
+			if ( ! (p = realloc( x, sizeof(*x) * cap )) )
+				goto nomem;
+			x = p;
+			if ( ! (p = realloc( y, sizeof(*y) * cap )) )
+				goto nomem;
+			y = p;
+		}
+		x[n]   = a;
+		y[n++] = b;
+	}
+
+	rval = devBusMappedLinCreate( name, x, y, n );
+	goto bail;
+
+nomem:
+	errlogPrintf("devBusMappedLinLoad: no memory\n");
+
+bail:
+	fclose( f );
+	free( x );
+	free( y );
+	return rval;
+}
+
+double
+devBusMappedLinEval1(DevBusMappedLin t, double raw, int *pOutOfRange)
+{
+double   xi;
+unsigned lo, hi, mid;
+int      oor = 0;
+
+	if ( raw < t->x[0] ) {
+		raw = t->x[0];
+		oor = 1;
+	} else if ( raw > t->x[t->n - 1] ) {
+		raw = t->x[t->n - 1];
+		oor = 1;
+	}
+
+	if ( pOutOfRange )
+		*pOutOfRange = oor;
+
+	if ( t->uniform ) {
+		xi = (raw - t->x0) * t->invDx;
+		lo = (unsigned)xi;
+		if ( lo > t->n - 1 )
+			lo = t->n - 1;
+		return t->y[lo] + (xi - (double)lo) * t->dy[lo];
+	}
+
+	/* find segment x[lo] <= raw < x[lo+1] */
+	lo = 0; hi = t->n - 1;
+	while ( hi - lo > 1 ) {
+		mid = (lo + hi) >> 1;
+		if ( t->x[mid] <= raw )
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return t->y[lo] + (raw - t->x[lo]) * t->dy[lo];
+}
+
+/* The table is never written while evaluating; telling the compiler
+ * lets it vectorize the interpolation loop ('out' may still be 'raw').
+ */
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define LIN_RESTRICT __restrict
+#else
+#define LIN_RESTRICT
+#endif
+
+static void
+linEvalUniform(const double *raw, double *out, unsigned n,
+               double xmin, double xmax, double x0, double invDx,
+               const double * LIN_RESTRICT y, const double * LIN_RESTRICT dy)
+{
+unsigned i;
+double   r, xi;
+int      k;
+
+	/* no calls, no early exits: clamping compiles to min/max
+	 * and the table lookups to gathers where the CPU has them
+	 */
+	for ( i = 0; i < n; i++ ) {
+		r      = raw[i];
+		r      = r < xmin ? xmin : r;
+		r      = r > xmax ? xmax : r;
+		xi     = (r - x0) * invDx;
+		k      = (int)xi;
+		out[i] = y[k] + (xi - (double)k) * dy[k];
+	}
+}
+
+unsigned
+devBusMappedLinEval(DevBusMappedLin t, const double *raw, double *out, unsigned n)
+{
+unsigned     i, oor = 0;
+const double xmin = t->x[0], xmax = t->x[t->n - 1];
+int          o;
+
+	if ( ! t->uniform ) {
+		for ( i = 0; i < n; i++ ) {
+			out[i] = devBusMappedLinEval1( t, raw[i], &o );
+			oor   += o;
+		}
+		return oor;
+	}
+
+	/* count separately; mixing the integer reduction into the
+	 * interpolation loop keeps it from being vectorized
+	 */
+	for ( i = 0; i < n; i++ )
+		oor += (raw[i] < xmin) + (raw[i] > xmax);
+
+	linEvalUniform( raw, out, n, xmin, xmax, t->x0, t->invDx, t->y, t->dy );
+
+	return oor;
+}
+
+static const iocshArg devBusMappedLinLoadArg0 = { "table name", iocshArgString };
+static const iocshArg devBusMappedLinLoadArg1 = { "file name",  iocshArgString };
+
+static const iocshArg *devBusMappedLinLoadArgs[] = {
+	&devBusMappedLinLoadArg0,
+	&devBusMappedLinLoadArg1,
+};
+
+static const iocshFuncDef devBusMappedLinLoadDef = {
+	"devBusMappedLinLoad",
+	sizeof(devBusMappedLinLoadArgs)/sizeof(devBusMappedLinLoadArgs[0]),
+	devBusMappedLinLoadArgs
+};
+
+static void
+devBusMappedLinLoadCall(const iocshArgBuf *args)
+{
+	devBusMappedLinLoad( args[0].sval, args[1].sval );
+}
+
+static void
+devBusMappedLinRegistrar(void)
+{
+	iocshRegister( &devBusMappedLinLoadDef, devBusMappedLinLoadCall );
+}
+
+epicsExportRegistrar(devBusMappedLinRegistrar);
@@ -0,0 +1,374 @@
+/* Register devBusMapped devices by mapping a file (linux UIO, PCI BARs) */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <epicsThread.h>
+#include <registry.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct UioIrqRec_ {
+	int                 fd;
+	IOSCANPVT           scan;
+	DevBusMappedIrqDemux demux;
+	unsigned long       count;
+	char                *name;
+	char                path[];
+} UioIrqRec, *UioIrq;
+
+/* Parse option 'opt' ("opt" or "opt=<val>") from a comma-separated list.
+ * RETURNS: 0 if not found, 1 if found (a copy of the value, if any, is
+ *          stored in *pval; the caller must free it).
+ */
+static int
+getOpt(const char *opts, const char *opt, char **pval)
+{
+const char *p, *e;
+size_t      l = strlen(opt);
+
+	*pval = 0;
+
+	for ( p = opts; p && *p; p = e ? e + 1 : 0 ) {
+		e = strchr( p, ',' );
+		if ( strncmp( p, opt, l ) )
+			continue;
+		if ( ',' == p[l] || 0 == p[l] )
+			return 1;
+		if ( '=' == p[l] ) {
+			p += l + 1;
+			l  = e ? (size_t)(e - p) : strlen(p);
+			if ( (*pval = malloc( l + 1 )) ) {
+				memcpy( *pval, p, l );
+				(*pval)[l] = 0;
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* UIO devices: /dev/uioN; their maps are described in sysfs */
+static int
+uioNumber(const char *path)
+{
+const char *b = strrchr( path, '/' );
+char       *endp;
+long        n;
+
+	b = b ? b + 1 : path;
+	if ( strncmp( b, "uio", 3 ) )
+		return -1;
+	n = strtol( b + 3, &endp, 10 );
+	return ( endp == b + 3 || *endp ) ? -1 : (int)n;
+}
+
+/* read attribute 'attr' (size, offset) of a UIO map;
+ * RETURNS: 0 on success
+ */
+static int
+uioMapAttr(int uio, int map, const char *attr, unsigned long *pv)
+{
+char          buf[100];
+FILE         *f;
+int           rval = -1;
+
+	snprintf( buf, sizeof(buf), "/sys/class/uio/uio%d/maps/map%d/%s", uio, map, attr );
+	if ( (f = fopen( buf, "r" )) ) {
+		if ( 1 == fscanf( f, "%li", pv ) )
+			rval = 0;
+		fclose( f );
+	}
+	return rval;
+}
+
+static void
+uioIrqThread(void *arg)
+{
+UioIrq         u  = arg;
+struct pollfd  pfd;
+epicsUInt32    cnt, on = 1;
+int            ctrl = ( uioNumber( u->path ) >= 0 );
+
+	pfd.fd     = u->fd;
+	pfd.events = POLLIN;
+
+	for ( ;; ) {
+		/* (re-)enable the interrupt if the UIO driver supports it */
+		if ( ctrl && sizeof(on) != write( u->fd, &on, sizeof(on) ) )
+			ctrl = 0;
+
+		if ( poll( &pfd, 1, -1 ) < 0 ) {
+			if ( EINTR == errno )
+				continue;
+			break;
+		}
+
+		if ( sizeof(cnt) != read( u->fd, &cnt, sizeof(cnt) ) )
+			break;
+
+		u->count++;
+
+		/* a demultiplexer may be created after the IRQ thread */
+		if ( u->demux || (u->demux = devBusMappedIrqDemuxFind( u->name )) )
+			devBusMappedIrqDemux( u->demux );
+
+		scanIoRequest( u->scan );
+	}
+
+	errlogPrintf("devBusMappedUioIrq: reading '%s' failed (%s); IRQ thread terminating\n",
+	             u->path, strerror(errno));
+	close( u->fd );
+}
+
+int
+devBusMappedUioIrq(const char *scanName, const char *path)
+{
+UioIrq u;
+
+	if ( ! scanName || ! path ) {
+		errlogPrintf("devBusMappedUioIrq: need scan list name and path\n");
+		return -1;
+	}
+
+	if ( ! (u = calloc( 1, sizeof(*u) + strlen(path) + strlen(scanName) + 2 )) ) {
+		errlogPrintf("devBusMappedUioIrq: no memory\n");
+		return -1;
+	}
+	strcpy( u->path, path );
+	u->name = u->path + strlen(path) + 1;
+	strcpy( u->name, scanName );
+
+	if ( (u->fd = open( path, O_RDWR )) < 0 ) {
+		errlogPrintf("devBusMappedUioIrq: unable to open '%s': %s\n", path, strerror(errno));
+		free( u );
+		return -1;
+	}
+
+	scanIoInit( &u->scan );
+
+	if ( devBusMappedRegisterIOScan( scanName, u->scan ) ) {
+		errlogPrintf("devBusMappedUioIrq: unable to register scan list '%s'\n", scanName);
+		close( u->fd );
+		free( u );
+		return -1;
+	}
+
+	epicsThreadMustCreate( scanName,
+	                       epicsThreadPriorityHigh,
+	                       epicsThreadGetStackSize( epicsThreadStackSmall ),
+	                       uioIrqThread,
+	                       u );
+	return 0;
+}
+
+DevBusMappedDev
+devBusMappedMapFile(const char *name, const char *path, unsigned long offset, unsigned long size, const char *opts)
+{
+DevBusMappedDev rval = 0;
+char           *mpath = 0, *val = 0, *irq = 0;
+int             fd    = -1;
+int             ro, wc, uio, hasIrq, map = 0, prot, flags;
+long            pgsz  = sysconf( _SC_PAGESIZE );
+unsigned long   delta, msz, inpg;
+off_t           moff;
+struct stat     sb;
+void           *addr  = MAP_FAILED;
+
+	if ( ! name || ! path ) {
+		errlogPrintf("devBusMappedMapFile: need device name and path\n");
+		return 0;
+	}
+
+	ro  = getOpt( opts, "ro", &val ); free( val );
+	wc  = getOpt( opts, "wc", &val ); free( val );
+	uio = uioNumber( path );
+
+	if ( getOpt( opts, "map", &val ) ) {
+		map = val ? atoi( val ) : 0;
+		free( val );
+		if ( uio < 0 ) {
+			errlogPrintf("devBusMappedMapFile: 'map' option only valid for UIO devices\n");
+			return 0;
+		}
+	}
+
+	if ( (hasIrq = getOpt( opts, "irq", &irq )) ) {
+		if ( uio < 0 ) {
+			errlogPrintf("devBusMappedMapFile: 'irq' option only valid for UIO devices\n");
+			goto bail;
+		}
+	}
+
+	if ( ! (mpath = malloc( strlen(path) + 4 )) ) {
+		errlogPrintf("devBusMappedMapFile: no memory\n");
+		goto bail;
+	}
+	strcpy( mpath, path );
+
+	/* The caching attributes are a property of the file being mapped:
+	 * PCI BARs are mapped uncached through sysfs 'resourceN' and
+	 * write-combining through 'resourceN_wc' (prefetchable BARs only);
+	 * /dev/mem honors O_SYNC; UIO maps are set up by the kernel.
+	 */
+	if ( wc ) {
+		if ( strstr( path, "/resource" ) ) {
+			strcat( mpath, "_wc" );
+		} else {
+			errlogPrintf("devBusMappedMapFile: 'wc' only supported for PCI resource files; ignored\n");
+		}
+	}
+
+	flags = (ro ? O_RDONLY : O_RDWR) | O_SYNC;
+	if ( (fd = open( mpath, flags )) < 0 ) {
+		errlogPrintf("devBusMappedMapFile: unable to open '%s': %s\n", mpath, strerror(errno));
+		goto bail;
+	}
+
+	if ( uio >= 0 ) {
+		/* UIO selects the map by the mmap() offset (map * pagesize), i.e.,
+		 * we always map from the start of the map. The region starts at
+		 * the map's in-page 'offset' (older kernels don't have it).
+		 */
+		if ( uioMapAttr( uio, map, "size", &msz ) || 0 == msz ) {
+			errlogPrintf("devBusMappedMapFile: unable to determine size of UIO map %d of '%s'\n", map, mpath);
+			goto bail;
+		}
+		if ( uioMapAttr( uio, map, "offset", &inpg ) )
+			inpg = 0;
+		if ( offset >= msz || size > msz - offset ) {
+			errlogPrintf("devBusMappedMapFile: offset/size exceed UIO map %d of '%s' (0x%lx bytes)\n", map, mpath, msz);
+			goto bail;
+		}
+		if ( 0 == size )
+			size = msz - offset;
+		delta = inpg + offset;
+		moff  = (off_t)map * pgsz;
+	} else {
+		if ( 0 == size ) {
+			if ( 0 == fstat( fd, &sb ) && (unsigned long)sb.st_size > offset ) {
+				size = sb.st_size - offset;
+			}
+			if ( 0 == size ) {
+				errlogPrintf("devBusMappedMapFile: unable to determine size of '%s'; please specify\n", mpath);
+				goto bail;
+			}
+		}
+		/* mmap() wants page-aligned offsets */
+		delta = offset & (pgsz - 1);
+		moff  = offset - delta;
+	}
+
+	prot = PROT_READ | (ro ? 0 : PROT_WRITE);
+	addr = mmap( 0, size + delta, prot, MAP_SHARED, fd, moff );
+	if ( MAP_FAILED == addr ) {
+		errlogPrintf("devBusMappedMapFile: mmap of '%s' failed: %s\n", mpath, strerror(errno));
+		goto bail;
+	}
+
+	if ( ! (rval = devBusMappedRegister( name, (volatile void*)((char*)addr + delta) )) ) {
+		errlogPrintf("devBusMappedMapFile: unable to register device '%s'\n", name);
+		munmap( addr, size + delta );
+		goto bail;
+	}
+
+	if ( hasIrq && devBusMappedUioIrq( irq && *irq ? irq : rval->name, path ) ) {
+		errlogPrintf("devBusMappedMapFile: device '%s' mapped but interrupts not available\n", name);
+	}
+
+bail:
+	if ( fd >= 0 )
+		close( fd );
+	free( mpath );
+	free( irq );
+	return rval;
+}
+
+#else
+
+int
+devBusMappedUioIrq(const char *scanName, const char *path)
+{
+	errlogPrintf("devBusMappedUioIrq: not supported on this OS\n");
+	return -1;
+}
+
+DevBusMappedDev
+devBusMappedMapFile(const char *name, const char *path, unsigned long offset, unsigned long size, const char *opts)
+{
+	errlogPrintf("devBusMappedMapFile: not supported on this OS\n");
+	return 0;
+}
+
+#endif
+
+static const iocshArg devBusMappedMapFileArg0 = { "device name", iocshArgString };
+static const iocshArg devBusMappedMapFileArg1 = { "path",        iocshArgString };
+static const iocshArg devBusMappedMapFileArg2 = { "offset",      iocshArgString };
+static const iocshArg devBusMappedMapFileArg3 = { "size (0: entire file/map)", iocshArgString };
+static const iocshArg devBusMappedMapFileArg4 = { "options (ro,wc,map=<n>,irq[=<scan>])", iocshArgString };
+
+static const iocshArg *devBusMappedMapFileArgs[] = {
+	&devBusMappedMapFileArg0,
+	&devBusMappedMapFileArg1,
+	&devBusMappedMapFileArg2,
+	&devBusMappedMapFileArg3,
+	&devBusMappedMapFileArg4,
+};
+
+static const iocshFuncDef devBusMappedMapFileDef = {
+	"devBusMappedMapFile",
+	sizeof(devBusMappedMapFileArgs)/sizeof(devBusMappedMapFileArgs[0]),
+	devBusMappedMapFileArgs
+};
+
+static void
+devBusMappedMapFileCall(const iocshArgBuf *args)
+{
+unsigned long off = args[2].sval ? strtoul( args[2].sval, 0, 0 ) : 0;
+unsigned long sz  = args[3].sval ? strtoul( args[3].sval, 0, 0 ) : 0;
+
+	devBusMappedMapFile( args[0].sval, args[1].sval, off, sz, args[4].sval );
+}
+
+static const iocshArg devBusMappedUioIrqArg0 = { "scan list name", iocshArgString };
+static const iocshArg devBusMappedUioIrqArg1 = { "path",           iocshArgString };
+
+static const iocshArg *devBusMappedUioIrqArgs[] = {
+	&devBusMappedUioIrqArg0,
+	&devBusMappedUioIrqArg1,
+};
+
+static const iocshFuncDef devBusMappedUioIrqDef = {
+	"devBusMappedUioIrq",
+	sizeof(devBusMappedUioIrqArgs)/sizeof(devBusMappedUioIrqArgs[0]),
+	devBusMappedUioIrqArgs
+};
+
+static void
+devBusMappedUioIrqCall(const iocshArgBuf *args)
+{
+	devBusMappedUioIrq( args[0].sval, args[1].sval );
+}
+
+static void
+devBusMappedMapRegistrar(void)
+{
+	iocshRegister( &devBusMappedMapFileDef, devBusMappedMapFileCall );
+	iocshRegister( &devBusMappedUioIrqDef,  devBusMappedUioIrqCall  );
+}
+
+epicsExportRegistrar(devBusMappedMapRegistrar);
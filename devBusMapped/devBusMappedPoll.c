@@ -0,0 +1,331 @@
+/* Change-detecting register poller for devBusMapped */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <registry.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+
+typedef struct PollWatchRec_ {
+	DevBusMappedPvtRec  pvt;       /* copy of the first record's; used for reading */
+	epicsUInt64         mask;
+	double              deadband;
+	int                 valid;     /* 'last' holds a value      */
+	epicsUInt64         last;      /* masked raw value          */
+} PollWatchRec, *PollWatch;
+
+typedef struct PollerRec_ {
+	epicsMutexId        mtx;
+	double              period;
+	PollWatch          *watches;
+	unsigned            n, cap;
+	unsigned long       nPolls, nChanges, nErrors;
+	struct PollerRec_  *next;
+	char                name[];
+} PollerRec, *Poller;
+
+/* just any unique address */
+static void	*pollerRegistryId = (void*)&pollerRegistryId;
+
+/* all pollers (for the report); only grows at the head */
+static Poller            pollers   = 0;
+static epicsMutexId      pollersMtx;
+static epicsThreadOnceId pollersOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+pollersOnceFn(void *unused)
+{
+	pollersMtx = epicsMutexMustCreate();
+}
+
+typedef union {
+	epicsUInt32  u;
+	epicsFloat32 f;
+} PollF32U;
+
+typedef union {
+	epicsUInt64  u;
+	epicsFloat64 f;
+} PollF64U;
+
+/* like a record would: under the device mutex (methods may access
+ * indirectly), after flushing posted writes and counted; no record
+ * to raise an alarm on, though
+ */
+static int
+rdRaw(PollWatch w, epicsUInt64 *pv)
+{
+int rval;
+
+	devBusMappedLock( &w->pvt );
+	rval = devBusMappedGetVal64( &w->pvt, pv, 0 );
+	devBusMappedUnlock( &w->pvt );
+	return rval;
+}
+
+/* value as a double (for the deadband) */
+static double
+rawToDouble(PollWatch w, epicsUInt64 v)
+{
+PollF32U u32;
+PollF64U u64;
+
+	if ( (w->pvt.acc->flags & DEV_BUS_MAPPED_ACC_FLOAT) ) {
+		if ( w->pvt.acc->rd64 ) {
+			u64.u = v;
+			return u64.f;
+		}
+		u32.u = (epicsUInt32)v;
+		return u32.f;
+	}
+	return (double)(epicsInt64)v;
+}
+
+static int
+changed(PollWatch w, epicsUInt64 v)
+{
+	if ( ! w->valid )
+		return 1;
+	if ( 0. == w->deadband )
+		return v != w->last;
+	return fabs( rawToDouble( w, v ) - rawToDouble( w, w->last ) ) > w->deadband;
+}
+
+static void
+pollerThread(void *arg)
+{
+Poller      p = arg;
+PollWatch   w;
+unsigned    i;
+epicsUInt64 v, then;
+double      dt;
+
+	for ( ;; ) {
+		then = epicsMonotonicGet();
+
+		epicsMutexMustLock( p->mtx );
+		for ( i = 0; i < p->n; i++ ) {
+			w = p->watches[i];
+			if ( rdRaw( w, &v ) ) {
+				p->nErrors++;
+				continue;
+			}
+			v &= w->mask;
+			if ( changed( w, v ) ) {
+				w->last  = v;
+				w->valid = 1;
+				p->nChanges++;
+				scanIoRequest( w->pvt.scan );
+			}
+		}
+		p->nPolls++;
+		epicsMutexUnlock( p->mtx );
+
+		dt = p->period - (double)(epicsMonotonicGet() - then) * 1.0E-9;
+		epicsThreadSleep( dt > 0. ? dt : 0. );
+	}
+}
+
+int
+devBusMappedPollerCreate(const char *name, double hz)
+{
+Poller p;
+
+	if ( ! name || hz <= 0. ) {
+		errlogPrintf("devBusMappedPollerCreate: need name and rate > 0\n");
+		return -1;
+	}
+
+	if ( strchr( name, ':' ) || strchr( name, ',' ) ) {
+		errlogPrintf("devBusMappedPollerCreate: name must not contain ':' or ','\n");
+		return -1;
+	}
+
+	if ( ! (p = calloc( 1, sizeof(*p) + strlen(name) + 1 )) ) {
+		errlogPrintf("devBusMappedPollerCreate: no memory\n");
+		return -1;
+	}
+
+	strcpy( p->name, name );
+	p->period = 1./hz;
+	p->mtx    = epicsMutexMustCreate();
+
+	/* registry keeps a pointer to the name; pass our copy */
+	if ( ! registryAdd( pollerRegistryId, p->name, p ) ) {
+		errlogPrintf("devBusMappedPollerCreate: '%s' exists already\n", name);
+		epicsMutexDestroy( p->mtx );
+		free( p );
+		return -1;
+	}
+
+	epicsThreadOnce( &pollersOnce, pollersOnceFn, 0 );
+	epicsMutexMustLock( pollersMtx );
+	p->next = pollers;
+	pollers = p;
+	epicsMutexUnlock( pollersMtx );
+
+	epicsThreadMustCreate( p->name,
+	                       epicsThreadPriorityMedium,
+	                       epicsThreadGetStackSize( epicsThreadStackSmall ),
+	                       pollerThread,
+	                       p );
+	return 0;
+}
+
+IOSCANPVT
+devBusMappedPollerAttach(const char *spec, DevBusMappedPvt pvt)
+{
+char       *nm, *cp, *endp;
+Poller      p;
+PollWatch   w = 0, *nw;
+epicsUInt64 mask     = ~(epicsUInt64)0;
+double      deadband = 0.;
+unsigned    i;
+IOSCANPVT   rval = 0;
+
+	if ( ! (nm = malloc( strlen(spec) + 1 )) )
+		return 0;
+	strcpy( nm, spec );
+
+	if ( (cp = strchr( nm, ':' )) ) {
+		*cp++ = 0;
+		mask  = strtoull( cp, &endp, 0 );
+		if ( endp == cp || (*endp && ':' != *endp) ) {
+			errlogPrintf("devBusMappedPollerAttach: invalid mask in '%s'\n", spec);
+			goto bail;
+		}
+		if ( ':' == *endp ) {
+			cp       = endp + 1;
+			deadband = strtod( cp, &endp );
+			if ( endp == cp || *endp || deadband < 0. ) {
+				errlogPrintf("devBusMappedPollerAttach: invalid deadband in '%s'\n", spec);
+				goto bail;
+			}
+		}
+	}
+
+	if ( ! (p = registryFind( pollerRegistryId, nm )) )
+		goto bail;
+
+	epicsMutexMustLock( p->mtx );
+
+	for ( i = 0; i < p->n; i++ ) {
+		w = p->watches[i];
+		if (    w->pvt.addr == pvt->addr && w->pvt.acc == pvt->acc
+		     && w->mask     == mask      && w->deadband == deadband )
+			break;
+	}
+
+	if ( i == p->n ) {
+		w = 0;
+		if ( p->n == p->cap ) {
+			if ( ! (nw = realloc( p->watches, sizeof(*nw) * (p->cap ? 2*p->cap : 16) )) )
+				goto unlock;
+			p->watches = nw;
+			p->cap     = p->cap ? 2*p->cap : 16;
+		}
+		if ( ! (w = calloc( 1, sizeof(*w) )) )
+			goto unlock;
+		w->pvt      = *pvt;
+		w->mask     = mask;
+		w->deadband = deadband;
+		scanIoInit( &w->pvt.scan );
+		p->watches[p->n++] = w;
+	}
+
+	rval = w->pvt.scan;
+
+unlock:
+	epicsMutexUnlock( p->mtx );
+
+bail:
+	free( nm );
+	return rval;
+}
+
+void
+devBusMappedPollerReport(int level)
+{
+Poller    p;
+PollWatch w;
+unsigned  i;
+
+	epicsThreadOnce( &pollersOnce, pollersOnceFn, 0 );
+	epicsMutexMustLock( pollersMtx );
+	p = pollers;
+	epicsMutexUnlock( pollersMtx );
+
+	printf("%-16s %8s %6s %12s %12s %10s\n", "poller", "Hz", "regs", "polls", "changes", "errors");
+	for ( ; p; p = p->next ) {
+		epicsMutexMustLock( p->mtx );
+		printf("%-16s %8.1f %6u %12lu %12lu %10lu\n",
+		       p->name, 1./p->period, p->n, p->nPolls, p->nChanges, p->nErrors);
+		if ( level > 0 ) {
+			for ( i = 0; i < p->n; i++ ) {
+				w = p->watches[i];
+				printf("  %-24s %p mask 0x%" PRIx64 " deadband %g last 0x%" PRIx64 "%s\n",
+				       w->pvt.dev ? w->pvt.dev->name : "?", (void*)w->pvt.addr,
+				       w->mask, w->deadband, w->last, w->valid ? "" : " (none)");
+			}
+		}
+		epicsMutexUnlock( p->mtx );
+	}
+}
+
+static const iocshArg devBusMappedPollerCreateArg0 = { "name", iocshArgString };
+static const iocshArg devBusMappedPollerCreateArg1 = { "hz",   iocshArgDouble };
+
+static const iocshArg *devBusMappedPollerCreateArgs[] = {
+	&devBusMappedPollerCreateArg0,
+	&devBusMappedPollerCreateArg1,
+};
+
+static const iocshFuncDef devBusMappedPollerCreateDef = {
+	"devBusMappedPollerCreate",
+	sizeof(devBusMappedPollerCreateArgs)/sizeof(devBusMappedPollerCreateArgs[0]),
+	devBusMappedPollerCreateArgs
+};
+
+static void
+devBusMappedPollerCreateCall(const iocshArgBuf *args)
+{
+	devBusMappedPollerCreate( args[0].sval, args[1].dval );
+}
+
+static const iocshArg devBusMappedPollerReportArg0 = { "level", iocshArgInt };
+
+static const iocshArg *devBusMappedPollerReportArgs[] = {
+	&devBusMappedPollerReportArg0,
+};
+
+static const iocshFuncDef devBusMappedPollerReportDef = {
+	"devBusMappedPollerReport",
+	sizeof(devBusMappedPollerReportArgs)/sizeof(devBusMappedPollerReportArgs[0]),
+	devBusMappedPollerReportArgs
+};
+
+static void
+devBusMappedPollerReportCall(const iocshArgBuf *args)
+{
+	devBusMappedPollerReport( args[0].ival );
+}
+
+static void
+devBusMappedPollRegistrar(void)
+{
+	iocshRegister( &devBusMappedPollerCreateDef, devBusMappedPollerCreateCall );
+	iocshRegister( &devBusMappedPollerReportDef, devBusMappedPollerReportCall );
+}
+
+epicsExportRegistrar(devBusMappedPollRegistrar);
@@ -0,0 +1,402 @@
+/* Simulated register file for devBusMapped */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+#include <registry.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+#include <devBusMappedSim.h>
+
+typedef struct SimHookRec_ {
+	struct SimHookRec_  *next;
+	unsigned long        offset;
+	DevBusMappedSimHook  fn;
+	void                *arg;
+} SimHookRec, *SimHook;
+
+struct DevBusMappedSimRec_ {
+	DevBusMappedDev      dev;
+	unsigned long        size;
+	epicsUInt64          rdLat;    /* ns */
+	epicsUInt64          wrLat;    /* ns */
+	SimHook              hooks;
+	IOSCANPVT            scan;
+	DevBusMappedIrqDemux demux;
+	double               irqPeriod;
+	int                  irqRunning;
+	size_t               nRd, nWr, nIrq;
+};
+
+/* just any unique address */
+static void	*simRegistryId = (void*)&simRegistryId;
+
+/* protects the hook lists */
+static epicsMutexId    simMtx  = 0;
+
+static epicsThreadOnceId once_id = 0;
+
+static void
+busyWait(epicsUInt64 ns)
+{
+epicsUInt64 then;
+
+	if ( ns ) {
+		then = epicsMonotonicGet();
+		while ( epicsMonotonicGet() - then < ns )
+			/* spin */;
+	}
+}
+
+/* attach the record to the sim (pvt->udata); the device's 'udata'
+ * belongs to whatever driver registered it and can't be trusted
+ */
+static int
+simInit(DevBusMappedPvt pvt)
+{
+DevBusMappedSim s = registryFind( simRegistryId, pvt->dev->name );
+
+	if ( ! s || s->dev != pvt->dev ) {
+		errlogPrintf("devBusMappedSim: '%s' (record %s) is not a simulated device\n",
+		             pvt->dev->name, pvt->prec ? pvt->prec->name : "?");
+		return -1;
+	}
+	pvt->udata = s;
+	return 0;
+}
+
+/* the record's sim if a 'width' byte access at its address is within
+ * the register file
+ */
+static __inline__ DevBusMappedSim
+simOf(DevBusMappedPvt pvt, unsigned width)
+{
+DevBusMappedSim s   = pvt->udata;
+uintptr_t       off = (uintptr_t)pvt->addr - (uintptr_t)pvt->dev->baseAddr;
+
+	if ( ! s || off >= s->size || s->size - off < width )
+		return 0;
+	return s;
+}
+
+static int
+callHook(DevBusMappedSim s, volatile void *addr, int isWrite, epicsUInt64 *pv)
+{
+SimHook       h;
+unsigned long off = (unsigned long)((uintptr_t)addr - (uintptr_t)s->dev->baseAddr);
+
+	for ( h = s->hooks; h; h = h->next ) {
+		if ( h->offset == off )
+			return h->fn( s, off, isWrite, pv, h->arg );
+	}
+	return 0;
+}
+
+#define DECL_SIM_RD(name, type)                                                  \
+static int name(DevBusMappedPvt pvt, epicsUInt32 *pv, dbCommon *prec)            \
+{                                                                                \
+DevBusMappedSim s = simOf( pvt, sizeof(type) );                                  \
+epicsUInt64     v;                                                               \
+	if ( ! s )                                                                   \
+		return -1;                                                               \
+	busyWait( s->rdLat );                                                        \
+	v = *(volatile type *)pvt->addr;                                             \
+	epicsAtomicIncrSizeT( &s->nRd );                                             \
+	if ( s->hooks && callHook( s, pvt->addr, 0, &v ) < 0 )                       \
+		return -1;                                                               \
+	*pv = (epicsUInt32)v;                                                        \
+	return 0;                                                                    \
+}
+
+#define DECL_SIM_WR(name, type)                                                  \
+static int name(DevBusMappedPvt pvt, epicsUInt32 val, dbCommon *prec)            \
+{                                                                                \
+DevBusMappedSim s = simOf( pvt, sizeof(type) );                                  \
+epicsUInt64     v = val;                                                         \
+int             st = 0;                                                          \
+	if ( ! s )                                                                   \
+		return -1;                                                               \
+	busyWait( s->wrLat );                                                        \
+	epicsAtomicIncrSizeT( &s->nWr );                                             \
+	if ( s->hooks && (st = callHook( s, pvt->addr, 1, &v )) < 0 )                \
+		return -1;                                                               \
+	if ( 0 == st )                                                               \
+		*(volatile type *)pvt->addr = (type)v;                                   \
+	return 0;                                                                    \
+}
+
+DECL_SIM_RD(simRd8,  uint8_t)
+DECL_SIM_RD(simRd16, uint16_t)
+DECL_SIM_RD(simRd32, uint32_t)
+DECL_SIM_WR(simWr8,  uint8_t)
+DECL_SIM_WR(simWr16, uint16_t)
+DECL_SIM_WR(simWr32, uint32_t)
+
+static int
+simRd64(DevBusMappedPvt pvt, epicsUInt64 *pv, dbCommon *prec)
+{
+DevBusMappedSim s = simOf( pvt, sizeof(uint64_t) );
+
+	if ( ! s )
+		return -1;
+	busyWait( s->rdLat );
+	*pv = *(volatile uint64_t *)pvt->addr;
+	epicsAtomicIncrSizeT( &s->nRd );
+	if ( s->hooks && callHook( s, pvt->addr, 0, pv ) < 0 )
+		return -1;
+	return 0;
+}
+
+static int
+simWr64(DevBusMappedPvt pvt, epicsUInt64 v, dbCommon *prec)
+{
+DevBusMappedSim s = simOf( pvt, sizeof(uint64_t) );
+int             st = 0;
+
+	if ( ! s )
+		return -1;
+	busyWait( s->wrLat );
+	epicsAtomicIncrSizeT( &s->nWr );
+	if ( s->hooks && (st = callHook( s, pvt->addr, 1, &v )) < 0 )
+		return -1;
+	if ( 0 == st )
+		*(volatile uint64_t *)pvt->addr = v;
+	return 0;
+}
+
+static DevBusMappedAccessRec sim8  = { simRd8,  simWr8,  0, 0, 0, 0, 0, simInit };
+static DevBusMappedAccessRec sim16 = { simRd16, simWr16, 0, 0, 0, 0, 0, simInit };
+static DevBusMappedAccessRec sim32 = { simRd32, simWr32, 0, 0, 0, 0, 0, simInit };
+static DevBusMappedAccessRec sim64 = { 0, 0, simRd64, simWr64, 0, 0, 0, simInit };
+
+static void init_once_fn(void *unused)
+{
+	simMtx = epicsMutexMustCreate();
+
+	if (    devBusMappedRegisterIO( "sim8",  &sim8  )
+	     || devBusMappedRegisterIO( "sim16", &sim16 )
+	     || devBusMappedRegisterIO( "sim32", &sim32 )
+	     || devBusMappedRegisterIO( "sim64", &sim64 ) ) {
+		errlogPrintf("devBusMappedSim: unable to register access methods\n");
+	}
+}
+
+DevBusMappedSim
+devBusMappedSimCreate(const char *name, unsigned long size, double rdLatencyUs, double wrLatencyUs)
+{
+DevBusMappedSim s   = 0;
+void           *mem = 0;
+
+	epicsThreadOnce( &once_id, init_once_fn, 0 );
+
+	if ( ! name || 0 == size ) {
+		errlogPrintf("devBusMappedSimCreate: need name and size\n");
+		return 0;
+	}
+
+	/* round up so 64-bit accesses to the last register are fine */
+	size = (size + 7) & ~7UL;
+
+	if ( ! (s = calloc( 1, sizeof(*s) )) || ! (mem = calloc( 1, size )) ) {
+		errlogPrintf("devBusMappedSimCreate: no memory\n");
+		goto bail;
+	}
+
+	s->size  = size;
+	s->rdLat = (epicsUInt64)(rdLatencyUs * 1000.);
+	s->wrLat = (epicsUInt64)(wrLatencyUs * 1000.);
+	scanIoInit( &s->scan );
+
+	if ( ! (s->dev = devBusMappedRegister( name, mem )) ) {
+		errlogPrintf("devBusMappedSimCreate: unable to register device '%s'\n", name);
+		goto bail;
+	}
+
+	if ( devBusMappedRegisterIOScan( name, s->scan ) ) {
+		errlogPrintf("devBusMappedSimCreate: unable to register scan list '%s'\n", name);
+	}
+
+	/* devBusMapped keeps a pointer to the name, use the device's copy */
+	registryAdd( simRegistryId, s->dev->name, s );
+
+	return s;
+
+bail:
+	free( mem );
+	free( s );
+	return 0;
+}
+
+DevBusMappedSim
+devBusMappedSimFind(const char *name)
+{
+	return registryFind( simRegistryId, name );
+}
+
+DevBusMappedDev
+devBusMappedSimGetDev(DevBusMappedSim sim)
+{
+	return sim->dev;
+}
+
+IOSCANPVT
+devBusMappedSimGetScan(DevBusMappedSim sim)
+{
+	return sim->scan;
+}
+
+int
+devBusMappedSimSetHook(DevBusMappedSim sim, unsigned long offset, DevBusMappedSimHook fn, void *arg)
+{
+SimHook h, *pp;
+
+	if ( offset >= sim->size )
+		return -1;
+
+	epicsMutexMustLock( simMtx );
+		for ( pp = &sim->hooks; (h = *pp); pp = &h->next ) {
+			if ( h->offset == offset )
+				break;
+		}
+		if ( ! fn ) {
+			/* remove; leaked rather than freed since a reader may still see it */
+			if ( h )
+				*pp = h->next;
+		} else if ( h ) {
+			h->arg = arg;
+			h->fn  = fn;
+		} else if ( (h = calloc( 1, sizeof(*h) )) ) {
+			h->offset = offset;
+			h->fn     = fn;
+			h->arg    = arg;
+			h->next   = sim->hooks;
+			sim->hooks = h;
+		}
+	epicsMutexUnlock( simMtx );
+
+	return ( fn && ! h ) ? -1 : 0;
+}
+
+void
+devBusMappedSimRaiseIrq(DevBusMappedSim sim)
+{
+	epicsAtomicIncrSizeT( &sim->nIrq );
+
+	/* dispatch to a demultiplexer of the same name, if any */
+	if ( sim->demux || (sim->demux = devBusMappedIrqDemuxFind( sim->dev->name )) )
+		devBusMappedIrqDemux( sim->demux );
+
+	scanIoRequest( sim->scan );
+}
+
+static void
+irqThread(void *arg)
+{
+DevBusMappedSim s = arg;
+double          p;
+
+	while ( (p = s->irqPeriod) > 0. ) {
+		epicsThreadSleep( p );
+		devBusMappedSimRaiseIrq( s );
+	}
+	s->irqRunning = 0;
+}
+
+int
+devBusMappedSimIrqRate(DevBusMappedSim sim, double hz)
+{
+	sim->irqPeriod = hz > 0. ? 1./hz : 0.;
+
+	if ( sim->irqPeriod > 0. && ! sim->irqRunning ) {
+		sim->irqRunning = 1;
+		if ( ! epicsThreadCreate( "busMappedSimIrq",
+		                          epicsThreadPriorityHigh,
+		                          epicsThreadGetStackSize( epicsThreadStackSmall ),
+		                          irqThread,
+		                          sim ) ) {
+			sim->irqRunning = 0;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void
+devBusMappedSimGetCounts(DevBusMappedSim sim, unsigned long *pReads, unsigned long *pWrites, unsigned long *pIrqs)
+{
+	if ( pReads )
+		*pReads  = epicsAtomicGetSizeT( &sim->nRd );
+	if ( pWrites )
+		*pWrites = epicsAtomicGetSizeT( &sim->nWr );
+	if ( pIrqs )
+		*pIrqs   = epicsAtomicGetSizeT( &sim->nIrq );
+}
+
+static const iocshArg devBusMappedSimCreateArg0 = { "name",          iocshArgString };
+static const iocshArg devBusMappedSimCreateArg1 = { "size",          iocshArgInt    };
+static const iocshArg devBusMappedSimCreateArg2 = { "rd_latency_us", iocshArgDouble };
+static const iocshArg devBusMappedSimCreateArg3 = { "wr_latency_us", iocshArgDouble };
+
+static const iocshArg *devBusMappedSimCreateArgs[] = {
+	&devBusMappedSimCreateArg0,
+	&devBusMappedSimCreateArg1,
+	&devBusMappedSimCreateArg2,
+	&devBusMappedSimCreateArg3,
+};
+
+static const iocshFuncDef devBusMappedSimCreateDef = {
+	"devBusMappedSimCreate",
+	sizeof(devBusMappedSimCreateArgs)/sizeof(devBusMappedSimCreateArgs[0]),
+	devBusMappedSimCreateArgs
+};
+
+static void
+devBusMappedSimCreateCall(const iocshArgBuf *args)
+{
+	devBusMappedSimCreate( args[0].sval, args[1].ival, args[2].dval, args[3].dval );
+}
+
+static const iocshArg devBusMappedSimIrqRateArg0 = { "name", iocshArgString };
+static const iocshArg devBusMappedSimIrqRateArg1 = { "hz",   iocshArgDouble };
+
+static const iocshArg *devBusMappedSimIrqRateArgs[] = {
+	&devBusMappedSimIrqRateArg0,
+	&devBusMappedSimIrqRateArg1,
+};
+
+static const iocshFuncDef devBusMappedSimIrqRateDef = {
+	"devBusMappedSimIrqRate",
+	sizeof(devBusMappedSimIrqRateArgs)/sizeof(devBusMappedSimIrqRateArgs[0]),
+	devBusMappedSimIrqRateArgs
+};
+
+static void
+devBusMappedSimIrqRateCall(const iocshArgBuf *args)
+{
+DevBusMappedSim s;
+
+	if ( ! args[0].sval || ! (s = devBusMappedSimFind( args[0].sval )) ) {
+		errlogPrintf("devBusMappedSimIrqRate: simulated device not found\n");
+		return;
+	}
+	devBusMappedSimIrqRate( s, args[1].dval );
+}
+
+static void
+devBusMappedSimRegistrar(void)
+{
+	iocshRegister( &devBusMappedSimCreateDef,  devBusMappedSimCreateCall  );
+	iocshRegister( &devBusMappedSimIrqRateDef, devBusMappedSimIrqRateCall );
+}
+
+epicsExportRegistrar(devBusMappedSimRegistrar);
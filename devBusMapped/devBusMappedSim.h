@@ -0,0 +1,111 @@
+#ifndef DEV_BUS_MAPPED_SIM_H
+#define DEV_BUS_MAPPED_SIM_H
+
+/* Simulated register file for devBusMapped (testing, benchmarking) */
+
+/*
+ * A simulated device is an ordinary devBusMapped device (registered
+ * with devBusMappedRegister()) whose registers live in memory.
+ * Records access it with the 'sim8', 'sim16', 'sim32' and 'sim64'
+ * methods (native endianness) which
+ *
+ *  - busy-wait for a configurable per-access latency (e.g., ~1us
+ *    to emulate a VME read),
+ *  - invoke user hooks registered for individual registers
+ *    (clear-on-read, write-one-to-clear, ...),
+ *  - count accesses.
+ *
+ * These methods may only be used on simulated devices (records naming
+ * them on other devices fail to initialize); accesses beyond the size
+ * of the register file fail.
+ *
+ * The device also has a scan list which is registered (with
+ * devBusMappedRegisterIOScan()) under the device's name, i.e., records
+ * may use "#C0S0@sim+0x10,sim32,sim" with SCAN = "I/O Intr".
+ * 'Interrupts' are raised by devBusMappedSimRaiseIrq() (e.g., from
+ * a hook) or periodically (devBusMappedSimIrqRate()); they are also
+ * dispatched to an interrupt demultiplexer of the same name.
+ *
+ * The ordinary 'm' methods may also be used on a simulated device;
+ * they bypass latency, hooks and counters.
+ */
+
+#include <devBusMapped.h>
+#include <dbScan.h>
+#include <epicsTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DevBusMappedSimRec_ *DevBusMappedSim;
+
+/*
+ * Hook called when a record accesses register 'offset' with one
+ * of the 'sim' methods.
+ *
+ * Reading: called after the register was read; *pvalue holds the
+ *          value which is returned to the record and may be modified.
+ * Writing: called before the register is written; *pvalue holds the
+ *          value to be written and may be modified.
+ *
+ * RETURNS: zero to proceed, a positive value to suppress storing the
+ *          value (writing only) or a negative value to fail the access
+ *          (the record raises an alarm).
+ */
+typedef int (*DevBusMappedSimHook)(DevBusMappedSim sim, unsigned long offset, int isWrite, epicsUInt64 *pvalue, void *arg);
+
+/*
+ * Create a simulated device of 'size' bytes (zero-initialized) and
+ * register it under 'name'. Read/write latencies are in microseconds
+ * (zero: no latency).
+ *
+ * RETURNS: handle or NULL on failure.
+ */
+DevBusMappedSim
+devBusMappedSimCreate(const char *name, unsigned long size, double rdLatencyUs, double wrLatencyUs);
+
+/* Find a simulated device by name; RETURNS NULL if not found */
+DevBusMappedSim
+devBusMappedSimFind(const char *name);
+
+/* RETURNS: the underlying devBusMapped device (base address etc.) */
+DevBusMappedDev
+devBusMappedSimGetDev(DevBusMappedSim sim);
+
+/* RETURNS: the device's scan list */
+IOSCANPVT
+devBusMappedSimGetScan(DevBusMappedSim sim);
+
+/*
+ * Register a hook for the register at 'offset' (replacing any
+ * existing one; a NULL 'hook' removes it). Should be done before
+ * records access the device.
+ *
+ * RETURNS: zero on success, nonzero on failure.
+ */
+int
+devBusMappedSimSetHook(DevBusMappedSim sim, unsigned long offset, DevBusMappedSimHook hook, void *arg);
+
+/* Request the device's scan list to be processed */
+void
+devBusMappedSimRaiseIrq(DevBusMappedSim sim);
+
+/*
+ * Raise 'interrupts' periodically at 'hz' (zero stops). The
+ * rate is limited by the OS' sleep resolution.
+ *
+ * RETURNS: zero on success, nonzero on failure.
+ */
+int
+devBusMappedSimIrqRate(DevBusMappedSim sim, double hz);
+
+/* Access counters */
+void
+devBusMappedSimGetCounts(DevBusMappedSim sim, unsigned long *pReads, unsigned long *pWrites, unsigned long *pIrqs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
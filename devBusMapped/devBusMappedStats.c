@@ -0,0 +1,382 @@
+/* Performance counters for devBusMapped */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <drvSup.h>
+#include <aiRecord.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+
+/* Times are in ns; sums are kept in two size_t words
+ * (carry in [1]) so they don't wrap on 32-bit targets.
+ */
+typedef struct DevBusMappedStatsRec_ {
+	struct DevBusMappedStatsRec_ *next;
+	DevBusMappedAccess acc;      /* NULL for a device */
+	const char        *name;
+	size_t             nRd, nWr, nErr;
+	size_t             tAcc[2], tAccMax;
+	size_t             nLck;     /* contended lock acquisitions */
+	size_t             tLck[2], tLckMax;
+} DevBusMappedStatsRec;
+
+volatile int devBusMappedStatsOn = 0;
+
+static DevBusMappedStats  devList  = 0;
+static DevBusMappedStats  accList  = 0;
+static epicsMutexId       statsMtx = 0;
+static epicsThreadOnceId  statsOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+statsOnceFn(void *unused)
+{
+	statsMtx = epicsMutexMustCreate();
+}
+
+#ifndef DEV_BUS_MAPPED_NO_STATS
+static void
+addTime(size_t *sum, size_t *max, epicsUInt64 ns)
+{
+size_t m;
+
+	if ( ns > (size_t)-1 )
+		ns = (size_t)-1;
+
+	if ( epicsAtomicAddSizeT( &sum[0], (size_t)ns ) < (size_t)ns )
+		epicsAtomicIncrSizeT( &sum[1] );
+
+	while ( (m = epicsAtomicGetSizeT( max )) < ns ) {
+		if ( m == epicsAtomicCmpAndSwapSizeT( max, m, (size_t)ns ) )
+			break;
+	}
+}
+
+static void
+addAcc(DevBusMappedStats s, int isWrite, int err, epicsUInt64 ns)
+{
+	epicsAtomicIncrSizeT( isWrite ? &s->nWr : &s->nRd );
+	if ( err )
+		epicsAtomicIncrSizeT( &s->nErr );
+	addTime( s->tAcc, &s->tAccMax, ns );
+}
+
+void
+devBusMappedStatsAdd(DevBusMappedPvt pvt, int isWrite, int err, epicsUInt64 ns)
+{
+	if ( pvt->dev && pvt->dev->stats )
+		addAcc( pvt->dev->stats, isWrite, err, ns );
+	if ( pvt->accStats )
+		addAcc( pvt->accStats, isWrite, err, ns );
+}
+
+void
+devBusMappedStatsLockWait(DevBusMappedDev dev, epicsUInt64 ns)
+{
+	if ( dev->stats ) {
+		epicsAtomicIncrSizeT( &dev->stats->nLck );
+		addTime( dev->stats->tLck, &dev->stats->tLckMax, ns );
+	}
+}
+
+void
+devBusMappedStatsEnable(int on)
+{
+	devBusMappedStatsOn = on;
+}
+#else
+void
+devBusMappedStatsAdd(DevBusMappedPvt pvt, int isWrite, int err, epicsUInt64 ns)
+{
+}
+
+void
+devBusMappedStatsLockWait(DevBusMappedDev dev, epicsUInt64 ns)
+{
+}
+
+void
+devBusMappedStatsEnable(int on)
+{
+	errlogPrintf("devBusMappedStatsEnable: statistics were compiled out (DEV_BUS_MAPPED_NO_STATS)\n");
+}
+#endif
+
+/* Create the counters of a device (acc == NULL) or find/create
+ * those of an access method.
+ */
+DevBusMappedStats
+devBusMappedStatsCreate(DevBusMappedAccess acc, const char *name)
+{
+DevBusMappedStats s;
+
+	epicsThreadOnce( &statsOnce, statsOnceFn, 0 );
+
+	epicsMutexMustLock( statsMtx );
+
+	if ( acc ) {
+		for ( s = accList; s; s = s->next ) {
+			if ( s->acc == acc ) {
+				if ( ! s->name && name && (s->name = malloc( strlen(name) + 1 )) )
+					strcpy( (char*)s->name, name );
+				goto done;
+			}
+		}
+	}
+
+	if ( (s = calloc( 1, sizeof(*s) )) ) {
+		s->acc = acc;
+		if ( acc ) {
+			if ( name && (s->name = malloc( strlen(name) + 1 )) )
+				strcpy( (char*)s->name, name );
+			s->next = accList;
+			accList = s;
+		} else {
+			/* device name is kept by the device */
+			s->name = name;
+			s->next = devList;
+			devList = s;
+		}
+	}
+
+done:
+	epicsMutexUnlock( statsMtx );
+	return s;
+}
+
+static double
+sumGet(size_t *sum)
+{
+	return (double)sum[0] + (double)sum[1] * ((double)(size_t)-1 + 1.);
+}
+
+static void
+statsReset(DevBusMappedStats s)
+{
+	s->nRd = s->nWr = s->nErr = s->nLck = 0;
+	s->tAcc[0] = s->tAcc[1] = s->tAccMax = 0;
+	s->tLck[0] = s->tLck[1] = s->tLckMax = 0;
+}
+
+void
+devBusMappedStatsReset(void)
+{
+DevBusMappedStats s;
+
+	epicsThreadOnce( &statsOnce, statsOnceFn, 0 );
+
+	epicsMutexMustLock( statsMtx );
+	for ( s = devList; s; s = s->next )
+		statsReset( s );
+	for ( s = accList; s; s = s->next )
+		statsReset( s );
+	epicsMutexUnlock( statsMtx );
+}
+
+static void
+statsPrint(DevBusMappedStats s, int withLock)
+{
+double n = (double)(s->nRd + s->nWr);
+
+	printf("%-16s %10lu %10lu %6lu %9.3f %9.3f",
+	       s->name ? s->name : "<unnamed>",
+	       (unsigned long)s->nRd, (unsigned long)s->nWr, (unsigned long)s->nErr,
+	       n > 0. ? sumGet( s->tAcc )/n/1000. : 0.,
+	       (double)s->tAccMax/1000.);
+	if ( withLock ) {
+		printf(" %8lu %9.3f %9.3f",
+		       (unsigned long)s->nLck,
+		       s->nLck ? sumGet( s->tLck )/(double)s->nLck/1000. : 0.,
+		       (double)s->tLckMax/1000.);
+	}
+	printf("\n");
+}
+
+void
+devBusMappedReport(int level)
+{
+DevBusMappedStats s;
+
+	epicsThreadOnce( &statsOnce, statsOnceFn, 0 );
+
+#ifdef DEV_BUS_MAPPED_NO_STATS
+	printf("devBusMapped: statistics were compiled out (DEV_BUS_MAPPED_NO_STATS)\n");
+	return;
+#endif
+
+	printf("devBusMapped statistics are %s; times in us\n", devBusMappedStatsOn ? "ON" : "OFF");
+
+	printf("%-16s %10s %10s %6s %9s %9s %8s %9s %9s\n",
+	       "Device", "Reads", "Writes", "Errors", "Avg", "Max", "LockWait", "AvgWait", "MaxWait");
+
+	epicsMutexMustLock( statsMtx );
+	for ( s = devList; s; s = s->next )
+		statsPrint( s, 1 );
+
+	if ( level > 0 ) {
+		printf("\n%-16s %10s %10s %6s %9s %9s\n",
+		       "Method", "Reads", "Writes", "Errors", "Avg", "Max");
+		for ( s = accList; s; s = s->next )
+			statsPrint( s, 0 );
+	}
+	epicsMutexUnlock( statsMtx );
+}
+
+/* 'dbior' */
+static long
+drvBusMappedReport(int level)
+{
+	devBusMappedReport( level );
+	return 0;
+}
+
+static struct {
+	long      number;
+	DRVSUPFUN report;
+	DRVSUPFUN init;
+} drvBusMapped = {
+	2,
+	drvBusMappedReport,
+	NULL
+};
+epicsExportAddress(drvet, drvBusMapped);
+
+/* Statistics PVs; INP is '#C0 S<metric> @<device>' */
+#define STAT_READS     0
+#define STAT_WRITES    1
+#define STAT_ERRORS    2
+#define STAT_AVG       3	/* avg. access time (us)  */
+#define STAT_MAX       4	/* max. access time (us)  */
+#define STAT_LCK       5	/* contended lock count   */
+#define STAT_LCK_AVG   6	/* avg. lock wait (us)    */
+#define STAT_LCK_MAX   7	/* max. lock wait (us)    */
+
+static long
+init_rec_stats(aiRecord *prec)
+{
+DevBusMappedDev dev;
+long            status = S_dev_noDeviceFound;
+
+	if ( VME_IO != prec->inp.type ) {
+		status = S_dev_badBus;
+	} else if ( prec->inp.value.vmeio.signal > STAT_LCK_MAX ) {
+		status = S_db_badField;
+	} else if ( (dev = devBusMappedFind( prec->inp.value.vmeio.parm )) && dev->stats ) {
+		prec->dpvt = dev->stats;
+		return 0;
+	}
+
+	prec->pact = TRUE;
+	recGblRecordError(status, (void*)prec, "devAiBusStats (init_record) failed");
+	return status;
+}
+
+static long
+read_stats(aiRecord *prec)
+{
+DevBusMappedStats s = prec->dpvt;
+double            n = (double)(s->nRd + s->nWr);
+
+	switch ( prec->inp.value.vmeio.signal ) {
+		case STAT_READS:   prec->val = (double)s->nRd;                                  break;
+		case STAT_WRITES:  prec->val = (double)s->nWr;                                  break;
+		case STAT_ERRORS:  prec->val = (double)s->nErr;                                 break;
+		case STAT_AVG:     prec->val = n > 0. ? sumGet( s->tAcc )/n/1000. : 0.;         break;
+		case STAT_MAX:     prec->val = (double)s->tAccMax/1000.;                        break;
+		case STAT_LCK:     prec->val = (double)s->nLck;                                 break;
+		case STAT_LCK_AVG: prec->val = s->nLck ? sumGet( s->tLck )/(double)s->nLck/1000. : 0.; break;
+		default:           prec->val = (double)s->tLckMax/1000.;                        break;
+	}
+	prec->udf = FALSE;
+
+	return 2;
+}
+
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	read_ai;
+	DEVSUPFUN	special_linconv;
+} devAiBusStats = {
+	6,
+	NULL,
+	NULL,
+	init_rec_stats,
+	NULL,
+	read_stats,
+	NULL
+};
+epicsExportAddress(dset, devAiBusStats);
+
+static const iocshArg devBusMappedLevelArg = { "level", iocshArgInt };
+static const iocshArg devBusMappedOnArg    = { "on",    iocshArgInt };
+
+static const iocshArg *devBusMappedReportArgs[] = {
+	&devBusMappedLevelArg,
+};
+
+static const iocshArg *devBusMappedStatsEnableArgs[] = {
+	&devBusMappedOnArg,
+};
+
+static const iocshFuncDef devBusMappedReportDef = {
+	"devBusMappedReport",
+	sizeof(devBusMappedReportArgs)/sizeof(devBusMappedReportArgs[0]),
+	devBusMappedReportArgs
+};
+
+static const iocshFuncDef devBusMappedStatsEnableDef = {
+	"devBusMappedStatsEnable",
+	sizeof(devBusMappedStatsEnableArgs)/sizeof(devBusMappedStatsEnableArgs[0]),
+	devBusMappedStatsEnableArgs
+};
+
+static const iocshFuncDef devBusMappedStatsResetDef = {
+	"devBusMappedStatsReset",
+	0,
+	0
+};
+
+static void
+devBusMappedReportCall(const iocshArgBuf *args)
+{
+	devBusMappedReport( args[0].ival );
+}
+
+static void
+devBusMappedStatsEnableCall(const iocshArgBuf *args)
+{
+	devBusMappedStatsEnable( args[0].ival );
+}
+
+static void
+devBusMappedStatsResetCall(const iocshArgBuf *args)
+{
+	devBusMappedStatsReset();
+}
+
+static void
+devBusMappedStatsRegistrar(void)
+{
+	iocshRegister( &devBusMappedReportDef,      devBusMappedReportCall      );
+	iocshRegister( &devBusMappedStatsEnableDef, devBusMappedStatsEnableCall );
+	iocshRegister( &devBusMappedStatsResetDef,  devBusMappedStatsResetCall  );
+}
+
+epicsExportRegistrar(devBusMappedStatsRegistrar);
@@ -0,0 +1,218 @@
+/* Write-combining for devBusMapped devices */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <epicsMutex.h>
+#include <callback.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define DEV_BUS_MAPPED_PVT
+#include <devBusMapped.h>
+#include <basicIoOps.h>
+
+typedef struct WcEntryRec_ {
+	DevBusMappedPvt     pvt;
+	epicsUInt32         val;
+} WcEntryRec, *WcEntry;
+
+typedef struct DevBusMappedWcRec_ {
+	CALLBACK            cb;
+	DevBusMappedDev     dev;
+	double              delay;
+	int                 pending;   /* callback requested */
+	unsigned            n, depth;
+	WcEntryRec          q[];       /* sorted by address  */
+} DevBusMappedWcRec, *DevBusMappedWc;
+
+/* write out the queue; caller holds the device mutex */
+static void
+wcFlush(DevBusMappedWc wc)
+{
+unsigned i;
+
+	if ( 0 == wc->n )
+		return;
+
+	for ( i = 0; i < wc->n; i++ )
+		wc->q[i].pvt->acc->wrp( wc->q[i].pvt, wc->q[i].val, wc->q[i].pvt->prec );
+	iobarrier_w();
+
+	wc->n = 0;
+}
+
+static void
+wcCallback(CALLBACK *pcb)
+{
+DevBusMappedWc wc;
+
+	callbackGetUser( wc, pcb );
+
+	epicsMutexMustLock( wc->dev->mutex );
+		wc->pending = 0;
+		wcFlush( wc );
+	epicsMutexUnlock( wc->dev->mutex );
+}
+
+void
+devBusMappedFlush(DevBusMappedDev dev)
+{
+	if ( ! dev || ! dev->wc )
+		return;
+
+	epicsMutexMustLock( dev->mutex );
+		wcFlush( dev->wc );
+	epicsMutexUnlock( dev->mutex );
+}
+
+int
+devBusMappedWcPost(DevBusMappedPvt pvt, epicsUInt32 value)
+{
+DevBusMappedWc wc = pvt->dev->wc;
+unsigned       lo, hi, mid;
+volatile void *a  = pvt->addr;
+
+	if ( ! wc || ! pvt->acc->wrp )
+		return -1;
+
+	/* devBusMappedPutVal() is public; callers need not hold it (recursive) */
+	epicsMutexMustLock( pvt->dev->mutex );
+
+	/* find the first entry with a higher address */
+	lo = 0; hi = wc->n;
+	while ( lo < hi ) {
+		mid = (lo + hi) >> 1;
+		if ( (uintptr_t)wc->q[mid].pvt->addr <= (uintptr_t)a )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* combine with a queued write to the same register */
+	for ( mid = lo; mid > 0 && wc->q[mid-1].pvt->addr == a; mid-- ) {
+		if ( wc->q[mid-1].pvt->acc == pvt->acc ) {
+			wc->q[mid-1].pvt = pvt;
+			wc->q[mid-1].val = value;
+			epicsMutexUnlock( pvt->dev->mutex );
+			return 0;
+		}
+	}
+
+	if ( wc->n == wc->depth ) {
+		wcFlush( wc );
+		lo = 0;
+	}
+
+	memmove( &wc->q[lo+1], &wc->q[lo], sizeof(wc->q[0]) * (wc->n - lo) );
+	wc->q[lo].pvt = pvt;
+	wc->q[lo].val = value;
+	wc->n++;
+
+	if ( ! wc->pending && wc->delay >= 0. ) {
+		wc->pending = 1;
+		if ( wc->delay > 0. )
+			callbackRequestDelayed( &wc->cb, wc->delay );
+		else
+			callbackRequest( &wc->cb );
+	}
+
+	epicsMutexUnlock( pvt->dev->mutex );
+	return 0;
+}
+
+int
+devBusMappedWriteCombine(const char *name, unsigned depth, double delay)
+{
+DevBusMappedDev dev;
+DevBusMappedWc  wc;
+
+	if ( ! name || ! (dev = devBusMappedFind( name )) ) {
+		errlogPrintf("devBusMappedWriteCombine: device '%s' not found\n", name ? name : "<NULL>");
+		return -1;
+	}
+
+	if ( dev->wc ) {
+		errlogPrintf("devBusMappedWriteCombine: already enabled for '%s'\n", name);
+		return -1;
+	}
+
+	if ( 0 == depth )
+		depth = 64;
+
+	if ( ! (wc = calloc( 1, sizeof(*wc) + sizeof(wc->q[0]) * depth )) ) {
+		errlogPrintf("devBusMappedWriteCombine: no memory\n");
+		return -1;
+	}
+
+	wc->dev   = dev;
+	wc->depth = depth;
+	wc->delay = delay;
+	callbackSetCallback( wcCallback, &wc->cb );
+	callbackSetPriority( priorityLow, &wc->cb );
+	callbackSetUser( wc, &wc->cb );
+
+	epicsMutexMustLock( dev->mutex );
+		dev->wc = wc;
+	epicsMutexUnlock( dev->mutex );
+
+	return 0;
+}
+
+static const iocshArg devBusMappedWriteCombineArg0 = { "device name",   iocshArgString };
+static const iocshArg devBusMappedWriteCombineArg1 = { "depth (0: 64)", iocshArgInt    };
+static const iocshArg devBusMappedWriteCombineArg2 = { "delay (s, <0: no callback)", iocshArgDouble };
+
+static const iocshArg *devBusMappedWriteCombineArgs[] = {
+	&devBusMappedWriteCombineArg0,
+	&devBusMappedWriteCombineArg1,
+	&devBusMappedWriteCombineArg2,
+};
+
+static const iocshFuncDef devBusMappedWriteCombineDef = {
+	"devBusMappedWriteCombine",
+	sizeof(devBusMappedWriteCombineArgs)/sizeof(devBusMappedWriteCombineArgs[0]),
+	devBusMappedWriteCombineArgs
+};
+
+static void
+devBusMappedWriteCombineCall(const iocshArgBuf *args)
+{
+	devBusMappedWriteCombine( args[0].sval, args[1].ival < 0 ? 0 : args[1].ival, args[2].dval );
+}
+
+static const iocshArg devBusMappedFlushArg0 = { "device name", iocshArgString };
+
+static const iocshArg *devBusMappedFlushArgs[] = {
+	&devBusMappedFlushArg0,
+};
+
+static const iocshFuncDef devBusMappedFlushDef = {
+	"devBusMappedFlush",
+	sizeof(devBusMappedFlushArgs)/sizeof(devBusMappedFlushArgs[0]),
+	devBusMappedFlushArgs
+};
+
+static void
+devBusMappedFlushCall(const iocshArgBuf *args)
+{
+DevBusMappedDev dev;
+
+	if ( ! args[0].sval || ! (dev = devBusMappedFind( args[0].sval )) ) {
+		errlogPrintf("devBusMappedFlush: device not found\n");
+		return;
+	}
+	devBusMappedFlush( dev );
+}
+
+static void
+devBusMappedWcRegistrar(void)
+{
+	iocshRegister( &devBusMappedWriteCombineDef, devBusMappedWriteCombineCall );
+	iocshRegister( &devBusMappedFlushDef,        devBusMappedFlushCall        );
+}
+
+epicsExportRegistrar(devBusMappedWcRegistrar);
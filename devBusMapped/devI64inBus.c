@@ -0,0 +1,62 @@
+/* devI64inBus.c */
+
+/* int64in device support for devBusMapped; modeled after devLiBus.c */
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"alarm.h"
+#include	"dbDefs.h"
+#include	"dbAccess.h"
+#include	"recGbl.h"
+#include	"recSup.h"
+#include	"devSup.h"
+#include	"int64inRecord.h"
+#include        "epicsExport.h"
+
+#define DEV_BUS_MAPPED_PVT
+#include	"devBusMapped.h"
+
+/* Create the dset for devI64inBus */
+static long init_record();
+static long read_int64in();
+
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	read_int64in;
+}devI64inBus={
+	5,
+	NULL,
+	NULL,
+	init_record,
+	devBusMappedGetIointInfo,
+	read_int64in
+};
+epicsExportAddress(dset, devI64inBus);
+
+
+static long init_record(int64inRecord *prec)
+{
+   	if ( devBusVmeLinkInit(&prec->inp, 0, (dbCommon*)prec) ) {
+		recGblRecordError(S_db_badField,(void *)prec,
+			"devI64inBus (init_record) Illegal INP field");
+		return(S_db_badField);
+	}
+
+    return(0);
+}
+
+static long read_int64in(int64inRecord *pint64in)
+{
+long            rval;
+epicsUInt64     v;
+DevBusMappedPvt pvt = pint64in->dpvt;
+	rval = devBusMappedGetVal64(pvt, &v, (dbCommon*)pint64in);
+	pint64in->val = (epicsInt64)v;
+	return rval;
+}
@@ -0,0 +1,70 @@
+/* devI64outBus.c */
+
+/* int64out device support for devBusMapped; modeled after devLoBus.c */
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"alarm.h"
+#include	"dbDefs.h"
+#include	"dbAccess.h"
+#include	"recGbl.h"
+#include	"recSup.h"
+#include	"devSup.h"
+#include	"int64outRecord.h"
+#include        "epicsExport.h"
+
+#define DEV_BUS_MAPPED_PVT
+#include 	"devBusMapped.h"
+
+/* Create the dset for devI64outBus */
+static long init_record();
+static long write_int64out();
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	write_int64out;
+}devI64outBus={
+	5,
+	NULL,
+	NULL,
+	init_record,
+	devBusMappedGetIointInfo,
+	write_int64out
+};
+epicsExportAddress(dset, devI64outBus);
+
+
+static long init_record(int64outRecord *prec)
+{
+long rval = 0;
+	if ( devBusVmeLinkInit(&prec->out, 0, (dbCommon*)prec) ) {
+		recGblRecordError(S_db_badField,(void *)prec,
+			"devI64outBus (init_record) Illegal OUT field");
+		return(S_db_badField);
+	}
+
+	if (!prec->pini) {
+		epicsUInt64 v;
+		DevBusMappedPvt pvt = prec->dpvt;
+		if ( devBusMappedGetVal64(pvt, &v, (dbCommon*)prec) )
+			recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+		prec->val = (epicsInt64)v;
+		recGblResetAlarms(prec);
+	}
+    return(rval);
+}
+
+static long write_int64out(int64outRecord	*pint64out)
+{
+DevBusMappedPvt pvt = pint64out->dpvt;
+long			rval;
+devBusMappedLock(pvt);
+	rval = devBusMappedPutVal64(pvt, (epicsUInt64)pint64out->val, (dbCommon*)pint64out);
+devBusMappedUnlock(pvt);
+	return rval;
+}
@@ -96,9 +96,9 @@ static long write_longout(longoutRecord	*plongout)
 {
 DevBusMappedPvt pvt = plongout->dpvt;
 long			rval;
-epicsMutexLock(pvt->dev->mutex);
+devBusMappedLock(pvt);
 	rval = devBusMappedPutVal(pvt, plongout->val, (dbCommon*)plongout);
-epicsMutexUnlock(pvt->dev->mutex);
+devBusMappedUnlock(pvt);
 	return rval;
 }
 
@@ -113,25 +113,11 @@ DevBusMappedPvt pvt = pmbbo->dpvt;
 epicsUInt32		data;
 long			rval;
 
-	/* we could maintain a 'per word' mutex but that would be
-	 * too complicated...
+	/* lock-free for memory registers, under the device
+	 * mutex otherwise (see devBusMappedModify())
 	 */
-epicsMutexLock(pvt->dev->mutex);
-
-	if ( (rval = devBusMappedGetVal(pvt, &data, (dbCommon *)pmbbo)) < 0 ) {
-		goto leave;
-	}
-
-	pmbbo->rbv = data;
-
-	data &= ~pmbbo->mask;
-
-    data |= (pmbbo->rval & pmbbo->mask);
-
-	rval = devBusMappedPutVal(pvt, data, (dbCommon *)pmbbo);
-
-leave:
-epicsMutexUnlock(pvt->dev->mutex);
+	if ( 0 == (rval = devBusMappedModify(pvt, pmbbo->mask, pmbbo->rval, &data, (dbCommon *)pmbbo)) )
+		pmbbo->rbv = data;
 
 	return rval;
 }
@@ -0,0 +1,128 @@
+/*
+ * ai device support for epicsDma statistics
+ *
+ *   field(DTYP, "EPICS DMA Stats")
+ *   field(INP,  "@<handle> <xfers|bytes|errors|aborts|pio|avgUs|maxUs|MBps>")
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <alarm.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recGbl.h>
+#include <recSup.h>
+#include <devSup.h>
+#include <aiRecord.h>
+#include <epicsExport.h>
+
+#include <epicsDma.h>
+
+#define F_XFERS     0
+#define F_BYTES     1
+#define F_ERRORS    2
+#define F_ABORTS    3
+#define F_PIO       4
+#define F_AVG_US    5
+#define F_MAX_US    6
+#define F_MBPS      7
+
+static const char *fieldNames[] = {
+    "xfers", "bytes", "errors", "aborts", "pio", "avgUs", "maxUs", "MBps"
+};
+
+typedef struct devAiEpicsDmaPvt {
+    epicsDmaId  dmaId;      /* looked up when first read */
+    int         field;
+    char        name[1];
+} devAiEpicsDmaPvt;
+
+static long init_record(aiRecord *prec);
+static long read_ai(aiRecord *prec);
+
+struct {
+    long        number;
+    DEVSUPFUN   report;
+    DEVSUPFUN   init;
+    DEVSUPFUN   init_record;
+    DEVSUPFUN   get_ioint_info;
+    DEVSUPFUN   read_ai;
+    DEVSUPFUN   special_linconv;
+} devAiEpicsDma = {
+    6,
+    NULL,
+    NULL,
+    init_record,
+    NULL,
+    read_ai,
+    NULL
+};
+epicsExportAddress(dset, devAiEpicsDma);
+
+static long
+init_record(aiRecord *prec)
+{
+    devAiEpicsDmaPvt *pvt;
+    char        name[41], field[21];
+    unsigned    i;
+
+    if (prec->inp.type != INST_IO
+     || sscanf(prec->inp.value.instio.string, "%40s %20s", name, field) != 2) {
+        recGblRecordError(S_db_badField, (void *)prec,
+                          "devAiEpicsDma (init_record) INP must be \"@<handle> <field>\"");
+        return S_db_badField;
+    }
+    for (i = 0; i < sizeof(fieldNames) / sizeof(fieldNames[0]); i++) {
+        if (strcmp(field, fieldNames[i]) == 0)
+            break;
+    }
+    if (i == sizeof(fieldNames) / sizeof(fieldNames[0])) {
+        recGblRecordError(S_db_badField, (void *)prec,
+                          "devAiEpicsDma (init_record) unknown statistics field");
+        return S_db_badField;
+    }
+    if ((pvt = malloc(sizeof(*pvt) + strlen(name))) == NULL) {
+        recGblRecordError(S_db_noMemory, (void *)prec,
+                          "devAiEpicsDma (init_record) no memory");
+        return S_db_noMemory;
+    }
+    pvt->dmaId = NULL;
+    pvt->field = i;
+    strcpy(pvt->name, name);
+    prec->dpvt = pvt;
+    return 0;
+}
+
+static long
+read_ai(aiRecord *prec)
+{
+    devAiEpicsDmaPvt *pvt = prec->dpvt;
+    epicsDmaStats   s;
+    double          v = 0.;
+
+    if (pvt == NULL)
+        return 2;
+    /* drivers may create their handles after the records are initialized */
+    if (pvt->dmaId == NULL && (pvt->dmaId = epicsDmaFind(pvt->name)) == NULL) {
+        recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+        return 2;
+    }
+    epicsDmaGetStats(pvt->dmaId, &s);
+
+    switch (pvt->field) {
+    case F_XFERS:   v = s.nXfers;   break;
+    case F_BYTES:   v = s.bytes;    break;
+    case F_ERRORS:  v = s.nErrors;  break;
+    case F_ABORTS:  v = s.nAborts;  break;
+    case F_PIO:     v = s.nPio;     break;
+    case F_AVG_US:  v = s.nXfers ? s.sumTime / s.nXfers * 1.0E6 : 0.; break;
+    case F_MAX_US:  v = s.maxTime * 1.0E6; break;
+    case F_MBPS:    v = s.sumTime > 0. ? s.bytes / s.sumTime * 1.0E-6 : 0.; break;
+    default:
+        break;
+    }
+    prec->val = v;
+    prec->udf = FALSE;
+    return 2;
+}
@@ -1,11 +1,22 @@
 #include <epicsDma.h>
 #include <epicsVersion.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <errno.h>
 
 #if ((EPICS_VERSION > 3) || (EPICS_REVISION >= 14))
 
 # include <epicsEvent.h>
+# include <epicsMutex.h>
+# include <epicsAtomic.h>
+# include <epicsThread.h>
+# include <epicsTime.h>
+# include <callback.h>
+# include <devLib.h>
+# include <errlog.h>
+# include <iocsh.h>
+# include <epicsExport.h>
 
 #else
 
@@ -37,11 +48,15 @@ typedef int (*sysDmaToVmeFunc)(DMA_ID dmaId, UINT32 vmeAddr, int adrsSpace,
               void *pLocal, int length, int dataWidth);
 typedef int (*sysDmaFromVmeFunc)(DMA_ID dmaId, void *pLocal, UINT32 vmeAddr,
               int adrsSpace, int length, int dataWidth);
+typedef int (*sysDmaAbortFunc)(DMA_ID dmaId);
+typedef int (*sysDmaSetPriorityFunc)(DMA_ID dmaId, int priority);
 #if defined(__rtems__)
 static sysDmaCreateFunc  psysDmaCreate  = rtemsVmeDmaCreate;
 static sysDmaStatusFunc  psysDmaStatus  = rtemsVmeDmaStatus;
 static sysDmaFromVmeFunc psysDmaFromVme = rtemsVmeDmaFromVme;
 static sysDmaToVmeFunc   psysDmaToVme   = rtemsVmeDmaToVme;
+static sysDmaAbortFunc   psysDmaAbort   = rtemsVmeDmaAbort;
+static sysDmaSetPriorityFunc psysDmaSetPriority = rtemsVmeDmaSetPriority;
 #else
 DMA_ID sysDmaCreate(VOIDFUNCPTR callback, void *context) __attribute__((weak));
 int sysDmaStatus(DMA_ID dmaId) __attribute__((weak));
@@ -49,23 +64,313 @@ int sysDmaToVme(DMA_ID dmaId, UINT32 vmeAddr, int adrsSpace,
               void *pLocal, int length, int dataWidth) __attribute__((weak));
 int sysDmaFromVme(DMA_ID dmaId, void *pLocal, UINT32 vmeAddr,
               int adrsSpace, int length, int dataWidth) __attribute__((weak));
+int sysDmaAbort(DMA_ID dmaId) __attribute__((weak));
+int sysDmaSetPriority(DMA_ID dmaId, int priority) __attribute__((weak));
 static sysDmaCreateFunc  psysDmaCreate  = sysDmaCreate;
 static sysDmaStatusFunc  psysDmaStatus  = sysDmaStatus;
 static sysDmaFromVmeFunc psysDmaFromVme = sysDmaFromVme;
 static sysDmaToVmeFunc   psysDmaToVme   = sysDmaToVme;
+static sysDmaAbortFunc   psysDmaAbort   = sysDmaAbort;
+static sysDmaSetPriorityFunc psysDmaSetPriority = sysDmaSetPriority;
 #endif
 
+/*
+ * The BSP's routines are the default backend
+ */
+static void *
+sysCreate(epicsDmaCallback_t callback, void *context)
+{
+    return (*psysDmaCreate)((VOIDFUNCPTR)callback, context);
+}
+
+static int
+sysStatus(void *id)
+{
+    return (*psysDmaStatus)((DMA_ID)id);
+}
+
+static int
+sysToVme(void *id, epicsUInt32 vmeAddr, int adrsSpace, void *pLocal, int length, int dataWidth)
+{
+    return (*psysDmaToVme)((DMA_ID)id, vmeAddr, adrsSpace, pLocal, length, dataWidth);
+}
+
+static int
+sysFromVme(void *id, void *pLocal, epicsUInt32 vmeAddr, int adrsSpace, int length, int dataWidth)
+{
+    return (*psysDmaFromVme)((DMA_ID)id, pLocal, vmeAddr, adrsSpace, length, dataWidth);
+}
+
+static int
+sysAbort(void *id)
+{
+    return psysDmaAbort ? (*psysDmaAbort)((DMA_ID)id) : -1;
+}
+
+static int
+sysSetPriority(void *id, int priority)
+{
+    return psysDmaSetPriority ? (*psysDmaSetPriority)((DMA_ID)id, priority) : -1;
+}
+
+#if defined(__rtems__)
+/* the glue declines (ENOTSUP) where the BSP has no descriptor lists */
+static int
+sysFromVme2D(void *id, void *pLocal, int localStride, epicsUInt32 vmeAddr,
+             int vmeStride, int adrsSpace, int rowBytes, int rows, int dataWidth)
+{
+    return rtemsVmeDmaFromVme2D((DMA_ID)id, pLocal, localStride, vmeAddr,
+                                vmeStride, adrsSpace, rowBytes, rows, dataWidth);
+}
+#else
+#define sysFromVme2D NULL
+#endif
+
+/* devLib maps whole windows; the length needn't be checked */
+static int
+sysLocalAddr(epicsUInt32 vmeAddr, int adrsSpace, int length, volatile void **ppLocal)
+{
+    epicsAddressType at;
+
+    switch (adrsSpace & 0x3f) {
+    case 0x29: case 0x2d:
+        at = atVMEA16; break;
+    case 0x38: case 0x39: case 0x3a: case 0x3b:
+    case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+        at = atVMEA24; break;
+    case 0x08: case 0x09: case 0x0a: case 0x0b:
+    case 0x0c: case 0x0d: case 0x0e: case 0x0f:
+        at = atVMEA32; break;
+    default:
+        return -1;
+    }
+    return devBusToLocalAddr(at, vmeAddr, ppLocal) ? -1 : 0;
+}
+
+static const epicsDmaBackend sysBackend = {
+    sysCreate, sysStatus, sysToVme, sysFromVme, sysAbort, sysSetPriority,
+    sysLocalAddr, sysFromVme2D
+};
+
+static const epicsDmaBackend *backend = NULL;
+
+int
+epicsDmaSetBackend(const epicsDmaBackend *be)
+{
+    if (be && (!be->create || !be->status || !be->toVme || !be->fromVme))
+        return -1;
+    backend = be;
+    return 0;
+}
+
+/*
+ * Transfer statistics; written only when completing a transfer of the
+ * handle (no lock; readers may see a transfer half-counted). No
+ * floating point since this runs in the ISR.
+ */
+typedef struct xferStats {
+    unsigned long       nXfers;
+    unsigned long       nErrors;
+    unsigned long       nAborts;
+    unsigned long       nLate;
+    unsigned long       nPio;
+    epicsUInt64         bytes;
+    epicsUInt64         sumTime;    /* ns */
+    epicsUInt64         maxTime;
+    int                 lastError;
+    unsigned long       hist[EPICS_DMA_HIST_BINS];
+} xferStats;
+
+#define DMA_NAME_LEN    40
+
 /*
  * EPICS DMA identifier
  */
 struct epicsDmaInfo {
-    DMA_ID              dmaId;
+    struct epicsDmaInfo *next;      /* all handles */
+    char                name[DMA_NAME_LEN];
+    void                *dmaId;
+    const epicsDmaBackend *be;
     epicsDmaCallback_t  callback;
     void                *context;
     epicsEventId        eventId;
-    int                 waiting;
+    epicsMutexId        waitLock;   /* serializes ...AndWait callers */
+    int                 waiting;    /* a waiter expects a signal (atomic) */
+    int                 cancelled;  /* ... and was woken by an abort */
+    int                 busy;       /* completion outstanding (atomic)    */
+    void                *syncBuf;   /* invalidate on completion */
+    int                 syncLen;
+    int                 pioEnable;
+    int                 pioDone;    /* last transfer was PIO */
+    CALLBACK            pioCallback;
+    int                 delivery;
+    CALLBACK            deliverCallback;
+    CALLBACK            batchCallback;  /* ends the tick's batch */
+    int                 pending;    /* batched completions (atomic) */
+    epicsUInt64         tDone;      /* completion (oldest of a batch) */
+    epicsUInt64         tStart;
+    int                 xferLen;
+    xferStats           stats;
+    int                 xferError;  /* a row couldn't be started */
+    int                 toVme;      /* 2D transfers done row by row: */
+    int                 rowsLeft;
+    void                *rowLocal;
+    epicsUInt32         rowVme;
+    int                 localStride, vmeStride;
+    int                 adrsSpace, rowBytes, dataWidth;
+    int                 cpuKind;    /* copy left to the callback thread */
+    void                *cpuDst;
+    const void          *cpuSrc;
+    volatile void       *cpuPci;
+    int                 cpuLen, cpuWidth;
 };
 
+#define COPY_MEM        1
+#define COPY_FROM_PCI   2
+#define COPY_TO_PCI     3
+
+static struct epicsDmaInfo  *handles;
+static unsigned             nHandles;
+
+/*
+ * Delivery statistics, updated from callback threads
+ */
+typedef struct deliveryStats {
+    unsigned long       nCallbacks;
+    unsigned long       nWakeups;
+    unsigned long       nLost;      /* callback queue full */
+    epicsUInt64         sumLatency; /* ns, per wakeup */
+    epicsUInt64         maxLatency;
+} deliveryStats;
+
+static deliveryStats        stats[3];
+static epicsMutexId         statsLock;
+static epicsThreadOnceId    statsOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+statsInit(void *unused)
+{
+    statsLock = epicsMutexMustCreate();
+}
+
+static void
+statsRecord(int delivery, epicsUInt64 tDone, unsigned n)
+{
+    epicsUInt64 lat = epicsMonotonicGet() - tDone;
+
+    epicsMutexMustLock(statsLock);
+    stats[delivery].nCallbacks += n;
+    stats[delivery].nWakeups++;
+    stats[delivery].sumLatency += lat;
+    if (lat > stats[delivery].maxLatency)
+        stats[delivery].maxLatency = lat;
+    epicsMutexUnlock(statsLock);
+}
+
+/* from the ISR; there is no lock to take */
+static void
+statsLost(int delivery)
+{
+    stats[delivery].nLost++;
+}
+
+/*
+ * Hand a completion to the user's callback; may run in an ISR
+ */
+static void
+deliver(struct epicsDmaInfo *dmaId)
+{
+    switch (dmaId->delivery) {
+    case EPICS_DMA_DELIVER_CALLBACK:
+        dmaId->tDone = epicsMonotonicGet();
+        if (callbackRequest(&dmaId->deliverCallback) != 0)
+            statsLost(EPICS_DMA_DELIVER_CALLBACK);
+        break;
+    case EPICS_DMA_DELIVER_BATCHED:
+        /* the first completion of a batch schedules its delivery */
+        if (epicsAtomicIncrIntT(&dmaId->pending) == 1) {
+            dmaId->tDone = epicsMonotonicGet();
+            if (callbackRequest(&dmaId->deliverCallback) != 0) {
+                epicsAtomicSetIntT(&dmaId->pending, 0);
+                statsLost(EPICS_DMA_DELIVER_BATCHED);
+            }
+        }
+        break;
+    default:
+        (*dmaId->callback)(dmaId->context);
+        break;
+    }
+}
+
+static void
+deliverCallback(CALLBACK *pcb)
+{
+    struct epicsDmaInfo *dmaId;
+
+    callbackGetUser(dmaId, pcb);
+    if (dmaId->delivery == EPICS_DMA_DELIVER_BATCHED) {
+        /* collect what completes until the next tick */
+        callbackRequestDelayed(&dmaId->batchCallback, epicsThreadSleepQuantum());
+        return;
+    }
+    statsRecord(EPICS_DMA_DELIVER_CALLBACK, dmaId->tDone, 1);
+    (*dmaId->callback)(dmaId->context);
+}
+
+static void
+batchCallback(CALLBACK *pcb)
+{
+    struct epicsDmaInfo *dmaId;
+    epicsUInt64 tDone;
+    int         n;
+
+    callbackGetUser(dmaId, pcb);
+    /* read before the batch is closed; a new one sets it again */
+    tDone = dmaId->tDone;
+    do {
+        n = epicsAtomicGetIntT(&dmaId->pending);
+    } while (epicsAtomicCmpAndSwapIntT(&dmaId->pending, n, 0) != n);
+
+    statsRecord(EPICS_DMA_DELIVER_BATCHED, tDone, n);
+    while (n-- > 0)
+        (*dmaId->callback)(dmaId->context);
+}
+
+/* the handle is still busy, so nobody else writes its statistics */
+static void
+statsXfer(struct epicsDmaInfo *dmaId)
+{
+    xferStats   *s = &dmaId->stats;
+    epicsUInt64 t  = epicsMonotonicGet() - dmaId->tStart;
+    epicsUInt64 us = t / 1000;
+    int         bin, status;
+
+    s->nXfers++;
+    if ((status = epicsDmaStatus(dmaId)) != 0) {
+        s->nErrors++;
+        s->lastError = status;
+    }
+    if (dmaId->pioDone)
+        s->nPio++;
+    s->bytes   += dmaId->xferLen;
+    s->sumTime += t;
+    if (t > s->maxTime)
+        s->maxTime = t;
+    for (bin = 0; us && bin < EPICS_DMA_HIST_BINS - 1; bin++)
+        us >>= 1;
+    s->hist[bin]++;
+}
+
+static int
+startRow(struct epicsDmaInfo *dmaId)
+{
+    if (dmaId->toVme)
+        return (*dmaId->be->toVme)(dmaId->dmaId, dmaId->rowVme, dmaId->adrsSpace,
+                                   dmaId->rowLocal, dmaId->rowBytes, dmaId->dataWidth);
+    return (*dmaId->be->fromVme)(dmaId->dmaId, dmaId->rowLocal, dmaId->rowVme,
+                                 dmaId->adrsSpace, dmaId->rowBytes, dmaId->dataWidth);
+}
+
 /*
  * DMA completion callback
  */
@@ -73,13 +378,62 @@ static void
 myCallback(void *context)
 {
     struct epicsDmaInfo *dmaId = (struct epicsDmaInfo *)context;
+    int status;
 
-    if (dmaId->waiting) {
-        dmaId->waiting = 0;
-        epicsEventSignal(dmaId->eventId);
+    /* the next row of a 2D transfer; the handle stays busy */
+    if (dmaId->rowsLeft > 0 && (*dmaId->be->status)(dmaId->dmaId) == 0) {
+        dmaId->rowsLeft--;
+        dmaId->rowLocal = (char *)dmaId->rowLocal + dmaId->localStride;
+        dmaId->rowVme  += dmaId->vmeStride;
+        if ((status = startRow(dmaId)) == 0)
+            return;
+        dmaId->xferError = status;
     }
+    dmaId->rowsLeft = 0;
+
+    if (dmaId->syncBuf) {
+        epicsDmaSyncForCpu(dmaId->syncBuf, dmaId->syncLen, EPICS_DMA_FROM_DEVICE);
+        dmaId->syncBuf = NULL;
+    }
+    statsXfer(dmaId);
+    epicsAtomicSetIntT(&dmaId->busy, 0);
+    /* a waiter which timed out has reset 'waiting' already */
+    if (epicsAtomicCmpAndSwapIntT(&dmaId->waiting, 1, 0) == 1)
+        epicsEventSignal(dmaId->eventId);
     if (dmaId->callback)
-        (*dmaId->callback)(dmaId->context);
+        deliver(dmaId);
+}
+
+/* a copy the DMA engine can't do */
+static void
+cpuCopy(struct epicsDmaInfo *dmaId)
+{
+    switch (dmaId->cpuKind) {
+    case COPY_MEM:
+        memcpy(dmaId->cpuDst, dmaId->cpuSrc, dmaId->cpuLen);
+        break;
+    case COPY_FROM_PCI:
+        epicsDmaPioCopy(0, dmaId->cpuPci, dmaId->cpuDst, dmaId->cpuLen, dmaId->cpuWidth);
+        break;
+    case COPY_TO_PCI:
+        epicsDmaPioCopy(1, dmaId->cpuPci, (void *)dmaId->cpuSrc, dmaId->cpuLen, dmaId->cpuWidth);
+        break;
+    default:
+        break;
+    }
+    dmaId->cpuKind = 0;
+}
+
+/* completion of an asynchronous PIO transfer or CPU copy */
+static void
+pioCallback(CALLBACK *pcb)
+{
+    struct epicsDmaInfo *dmaId;
+
+    callbackGetUser(dmaId, pcb);
+    if (dmaId->cpuKind)
+        cpuCopy(dmaId);
+    myCallback(dmaId);
 }
 
 /*
@@ -87,34 +441,273 @@ myCallback(void *context)
  */
 epicsDmaId
 epicsDmaCreate(epicsDmaCallback_t callback, void *context)
+{
+    return epicsDmaCreateDelivery(callback, context, EPICS_DMA_DELIVER_ISR, 0);
+}
+
+epicsDmaId
+epicsDmaCreateDelivery(epicsDmaCallback_t callback, void *context,
+                       int delivery, int priority)
 {
     struct epicsDmaInfo *dmaId;
+    const epicsDmaBackend *be = backend;
 
-    if ((psysDmaCreate == NULL)
-     || (psysDmaStatus == NULL)
-     || (psysDmaToVme == NULL)
-     || (psysDmaFromVme == NULL))
+    if (delivery < EPICS_DMA_DELIVER_ISR || delivery > EPICS_DMA_DELIVER_BATCHED
+     || priority < priorityLow || priority > priorityHigh) {
+        errlogPrintf("epicsDmaCreateDelivery: invalid delivery mode or priority\n");
         return NULL;
+    }
+    epicsThreadOnce(&statsOnce, statsInit, 0);
+
+    if (be == NULL) {
+        if ((psysDmaCreate == NULL)
+         || (psysDmaStatus == NULL)
+         || (psysDmaToVme == NULL)
+         || (psysDmaFromVme == NULL))
+            return NULL;
+        be = &sysBackend;
+    }
     if ((dmaId = malloc(sizeof(*dmaId))) == NULL)
         return NULL;
-    if ((dmaId->dmaId = (*psysDmaCreate)(myCallback, dmaId)) == NULL) {
+    /* the waiting/timeout machinery needs these before any transfer */
+    if ((dmaId->eventId = epicsEventCreate(epicsEventEmpty)) == NULL) {
+        free(dmaId);
+        return NULL;
+    }
+    if ((dmaId->waitLock = epicsMutexCreate()) == NULL) {
+        epicsEventDestroy(dmaId->eventId);
         free(dmaId);
         return NULL;
     }
-    dmaId->eventId = NULL;
+    dmaId->be = be;
     dmaId->callback = callback;
     dmaId->context = context;
 	dmaId->waiting=0;
+	dmaId->cancelled=0;
+    dmaId->busy = 0;
+    dmaId->syncBuf = NULL;
+    dmaId->syncLen = 0;
+    dmaId->pioEnable = 1;
+    dmaId->pioDone = 0;
+    callbackSetCallback(pioCallback, &dmaId->pioCallback);
+    callbackSetPriority(priorityHigh, &dmaId->pioCallback);
+    callbackSetUser(dmaId, &dmaId->pioCallback);
+    dmaId->delivery = delivery;
+    dmaId->pending = 0;
+    dmaId->tDone = 0;
+    dmaId->tStart = 0;
+    dmaId->xferLen = 0;
+    memset(&dmaId->stats, 0, sizeof(dmaId->stats));
+    dmaId->xferError = 0;
+    dmaId->rowsLeft = 0;
+    dmaId->cpuKind = 0;
+    callbackSetCallback(deliverCallback, &dmaId->deliverCallback);
+    callbackSetPriority(priority, &dmaId->deliverCallback);
+    callbackSetUser(dmaId, &dmaId->deliverCallback);
+    callbackSetCallback(batchCallback, &dmaId->batchCallback);
+    callbackSetPriority(priority, &dmaId->batchCallback);
+    callbackSetUser(dmaId, &dmaId->batchCallback);
+    if ((dmaId->dmaId = (*be->create)(myCallback, dmaId)) == NULL) {
+        epicsMutexDestroy(dmaId->waitLock);
+        epicsEventDestroy(dmaId->eventId);
+        free(dmaId);
+        return NULL;
+    }
+    epicsMutexMustLock(statsLock);
+    sprintf(dmaId->name, "dma%u", nHandles++);
+    dmaId->next = handles;
+    handles = dmaId;
+    epicsMutexUnlock(statsLock);
+    return dmaId;
+}
+
+int
+epicsDmaSetName(epicsDmaId dmaId, const char *name)
+{
+    if (name == NULL || strlen(name) >= DMA_NAME_LEN)
+        return -1;
+    epicsMutexMustLock(statsLock);
+    strcpy(dmaId->name, name);
+    epicsMutexUnlock(statsLock);
+    return 0;
+}
+
+epicsDmaId
+epicsDmaFind(const char *name)
+{
+    struct epicsDmaInfo *dmaId;
+
+    epicsThreadOnce(&statsOnce, statsInit, 0);
+
+    epicsMutexMustLock(statsLock);
+    for (dmaId = handles; dmaId; dmaId = dmaId->next) {
+        if (strcmp(dmaId->name, name) == 0)
+            break;
+    }
+    epicsMutexUnlock(statsLock);
     return dmaId;
 }
 
+int
+epicsDmaGetStats(epicsDmaId dmaId, epicsDmaStats *p)
+{
+    xferStats s = dmaId->stats;
+    int       i;
+
+    p->nXfers    = s.nXfers;
+    p->nErrors   = s.nErrors;
+    p->nAborts   = s.nAborts;
+    p->nLate     = s.nLate;
+    p->nPio      = s.nPio;
+    p->bytes     = (double)s.bytes;
+    p->sumTime   = (double)s.sumTime * 1.0E-9;
+    p->maxTime   = (double)s.maxTime * 1.0E-9;
+    p->lastError = s.lastError;
+    for (i = 0; i < EPICS_DMA_HIST_BINS; i++)
+        p->hist[i] = s.hist[i];
+    return 0;
+}
+
 /*
  * Return DMA handler status
  */
 int
 epicsDmaStatus(epicsDmaId dmaId)
 {
-    return (*psysDmaStatus)(dmaId->dmaId);
+    if (dmaId->pioDone)
+        return 0;
+    if (dmaId->xferError)
+        return dmaId->xferError;
+    return (*dmaId->be->status)(dmaId->dmaId);
+}
+
+int
+epicsDmaLocalAddr(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
+                  int length, volatile void **ppLocal)
+{
+    if (dmaId->be->localAddr == NULL)
+        return -1;
+    return (*dmaId->be->localAddr)(vmeAddr, adrsSpace, length, ppLocal);
+}
+
+int
+epicsDmaPioEnable(epicsDmaId dmaId, int enable)
+{
+    dmaId->pioEnable = enable;
+    return 0;
+}
+
+/* whether to do the transfer by PIO; sets *pVme if so */
+static int
+usePio(epicsDmaId dmaId, int toVme, epicsUInt32 vmeAddr, int adrsSpace,
+       void *pLocal, int length, int dataWidth, volatile void **pVme)
+{
+    if (!dmaId->pioEnable
+     || length <= 0
+     || length > epicsDmaPioThresholdGet(toVme, dataWidth))
+        return 0;
+    /* the threshold is 0 unless the width is 1, 2 or 4 */
+    if ((length | vmeAddr | (unsigned long)pLocal) & (dataWidth - 1))
+        return 0;
+    return epicsDmaLocalAddr(dmaId, vmeAddr, adrsSpace, length, pVme) == 0;
+}
+
+/*
+ * Cache maintenance only for buffers from the epicsDmaBuf pools: others
+ * may share cache lines with data the CPU writes during the transfer
+ * (and boards which snoop don't need it); their owners call
+ * epicsDmaSyncForDevice()/epicsDmaSyncForCpu() if they must. Buffers
+ * receiving data are invalidated on completion.
+ */
+static void
+syncForDevice(struct epicsDmaInfo *dmaId, void *buf, size_t length, int direction)
+{
+    if (!epicsDmaBufInPool(buf, length))
+        return;
+    epicsDmaSyncForDevice(buf, length, direction);
+    if (direction == EPICS_DMA_FROM_DEVICE) {
+        dmaId->syncBuf = buf;
+        dmaId->syncLen = length;
+    }
+}
+
+/*
+ * Start a transfer; 'wait' arms the completion signal. This happens
+ * only once the handle is ours so that the late completion of an
+ * earlier (timed-out) transfer can't signal the wrong waiter.
+ */
+static int
+startXfer(epicsDmaId dmaId, int toVme, epicsUInt32 vmeAddr, int adrsSpace,
+          void *pLocal, int length, int dataWidth, int wait,
+          int rows, int localStride, int vmeStride)
+{
+    int status, span;
+    volatile void *vme;
+
+    /* a previous transfer timed out and could not be aborted */
+    if (epicsAtomicCmpAndSwapIntT(&dmaId->busy, 0, 1) != 0)
+        return EBUSY;
+    if (wait) {
+        dmaId->cancelled = 0;
+        epicsAtomicSetIntT(&dmaId->waiting, 1);
+    }
+
+    /* rows without gaps are one transfer */
+    if (rows > 1 && localStride == length && vmeStride == length) {
+        length *= rows;
+        rows    = 1;
+    }
+
+    dmaId->tStart    = epicsMonotonicGet();
+    dmaId->xferLen   = length * rows;
+    dmaId->xferError = 0;
+    dmaId->pioDone   = rows == 1
+                    && usePio(dmaId, toVme, vmeAddr, adrsSpace, pLocal, length, dataWidth, &vme);
+    if (dmaId->pioDone) {
+        epicsDmaPioCopy(toVme, vme, pLocal, length, dataWidth);
+        /* complete like a DMA: waiters are signalled, other callers
+         * get the callback after this returns (inline before iocInit)
+         */
+        if (wait || callbackRequest(&dmaId->pioCallback) != 0)
+            myCallback(dmaId);
+        return 0;
+    }
+    if (rows > 1) {
+        /* the whole span, gaps included, is synced */
+        span = (rows - 1) * localStride + length;
+        syncForDevice(dmaId, pLocal, span, toVme ? EPICS_DMA_TO_DEVICE : EPICS_DMA_FROM_DEVICE);
+        status = ENOTSUP;
+        if (!toVme && dmaId->be->fromVme2D)
+            status = (*dmaId->be->fromVme2D)(dmaId->dmaId, pLocal, localStride, vmeAddr,
+                                             vmeStride, adrsSpace, length, rows, dataWidth);
+        if (status == ENOTSUP) {
+            dmaId->toVme       = toVme;
+            dmaId->rowLocal    = pLocal;
+            dmaId->rowVme      = vmeAddr;
+            dmaId->localStride = localStride;
+            dmaId->vmeStride   = vmeStride;
+            dmaId->adrsSpace   = adrsSpace;
+            dmaId->rowBytes    = length;
+            dmaId->dataWidth   = dataWidth;
+            dmaId->rowsLeft    = rows - 1;
+            if ((status = startRow(dmaId)) != 0)
+                dmaId->rowsLeft = 0;
+        }
+    } else if (toVme) {
+        syncForDevice(dmaId, pLocal, length, EPICS_DMA_TO_DEVICE);
+        status = (*dmaId->be->toVme)(dmaId->dmaId, vmeAddr, adrsSpace, pLocal, length, dataWidth);
+    } else {
+        syncForDevice(dmaId, pLocal, length, EPICS_DMA_FROM_DEVICE);
+        status = (*dmaId->be->fromVme)(dmaId->dmaId, pLocal, vmeAddr, adrsSpace, length, dataWidth);
+    }
+    if (status != 0) {
+        dmaId->stats.nErrors++;
+        dmaId->stats.lastError = status;
+        dmaId->syncBuf = NULL;
+        epicsAtomicSetIntT(&dmaId->waiting, 0);
+        epicsAtomicSetIntT(&dmaId->busy, 0);
+    }
+    return status;
 }
 
 /*
@@ -124,7 +717,7 @@ int
 epicsDmaToVme(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
                           void *pLocal, int length, int dataWidth)
 {
-    return (*psysDmaToVme)(dmaId->dmaId, vmeAddr, adrsSpace, pLocal, length, dataWidth);
+    return startXfer(dmaId, 1, vmeAddr, adrsSpace, pLocal, length, dataWidth, 0, 1, 0, 0);
 }
 
 /*
@@ -134,30 +727,209 @@ int
 epicsDmaFromVme(epicsDmaId dmaId, void *pLocal, epicsUInt32 vmeAddr,
                           int adrsSpace, int length, int dataWidth)
 {
-    return (*psysDmaFromVme)(dmaId->dmaId, pLocal, vmeAddr, adrsSpace, length, dataWidth);
+    return startXfer(dmaId, 0, vmeAddr, adrsSpace, pLocal, length, dataWidth, 0, 1, 0, 0);
 }
 
 /*
- * Start a DMA transaction to a VME module and wait for completion
+ * Start a 2D transfer from a VME module
  */
 int
-epicsDmaToVmeAndWait(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
-                                 void *pLocal, int length, int dataWidth)
+epicsDmaFromVme2D(epicsDmaId dmaId, void *pLocal, int localStride,
+                  epicsUInt32 vmeAddr, int vmeStride, int adrsSpace,
+                  int rowBytes, int rows, int dataWidth)
 {
-    int status;
+    if (rows < 1 || rowBytes < 1 || localStride < rowBytes || vmeStride < rowBytes)
+        return EINVAL;
+    return startXfer(dmaId, 0, vmeAddr, adrsSpace, pLocal, rowBytes, dataWidth, 0,
+                     rows, localStride, vmeStride);
+}
+
+/*
+ * Memory and PCI copies: by the engine if the backend can, else by the
+ * CPU (on a callback thread unless waiting), completing like a DMA
+ */
+static int
+startCopy(epicsDmaId dmaId, int kind, void *dst, const void *src,
+          epicsUInt32 pciAddr, volatile void *pci, int length, int dataWidth, int wait)
+{
+    int status = -1;
+
+    if (length < 0 || (kind != COPY_MEM
+     && ((dataWidth != 1 && dataWidth != 2 && dataWidth != 4) || (length % dataWidth))))
+        return EINVAL;
+    if (epicsAtomicCmpAndSwapIntT(&dmaId->busy, 0, 1) != 0)
+        return EBUSY;
+    if (wait) {
+        dmaId->cancelled = 0;
+        epicsAtomicSetIntT(&dmaId->waiting, 1);
+    }
+
+    dmaId->tStart    = epicsMonotonicGet();
+    dmaId->xferLen   = length;
+    dmaId->xferError = 0;
+    dmaId->pioDone   = 0;
+
+    if (kind == COPY_MEM ? dmaId->be->memCopy != NULL : dmaId->be->pciCopy != NULL) {
+        if (kind != COPY_FROM_PCI)
+            syncForDevice(dmaId, (void *)src, length, EPICS_DMA_TO_DEVICE);
+        if (kind != COPY_TO_PCI)
+            syncForDevice(dmaId, dst, length, EPICS_DMA_FROM_DEVICE);
+        if (kind == COPY_MEM)
+            status = (*dmaId->be->memCopy)(dmaId->dmaId, dst, src, length);
+        else if (kind == COPY_FROM_PCI)
+            status = (*dmaId->be->pciCopy)(dmaId->dmaId, 0, dst, pciAddr, length, dataWidth);
+        else
+            status = (*dmaId->be->pciCopy)(dmaId->dmaId, 1, (void *)src, pciAddr, length, dataWidth);
+        if (status == 0)
+            return 0;
+        /* e.g., not supported by this bridge */
+        dmaId->syncBuf = NULL;
+    }
+
+    dmaId->pioDone  = 1;
+    dmaId->cpuDst   = dst;
+    dmaId->cpuSrc   = src;
+    dmaId->cpuPci   = pci;
+    dmaId->cpuLen   = length;
+    dmaId->cpuWidth = dataWidth;
+    dmaId->cpuKind  = kind;
+    if (wait || callbackRequest(&dmaId->pioCallback) != 0) {
+        cpuCopy(dmaId);
+        myCallback(dmaId);
+    }
+    return 0;
+}
 
-    if (dmaId->eventId == NULL) {
-        if ((dmaId->eventId = epicsEventCreate(epicsEventEmpty)) == NULL) {
-            errno = ENOMEM;
-            return -1;
+int
+epicsDmaMemCopy(epicsDmaId dmaId, void *dst, const void *src, int length)
+{
+    return startCopy(dmaId, COPY_MEM, dst, src, 0, NULL, length, 1, 0);
+}
+
+int
+epicsDmaFromPci(epicsDmaId dmaId, void *pLocal, epicsUInt32 pciAddr,
+                volatile void *pciLocal, int length, int dataWidth)
+{
+    return startCopy(dmaId, COPY_FROM_PCI, pLocal, NULL, pciAddr, pciLocal,
+                     length, dataWidth, 0);
+}
+
+int
+epicsDmaToPci(epicsDmaId dmaId, epicsUInt32 pciAddr, volatile void *pciLocal,
+              void *pLocal, int length, int dataWidth)
+{
+    return startCopy(dmaId, COPY_TO_PCI, NULL, pLocal, pciAddr, pciLocal,
+                     length, dataWidth, 0);
+}
+
+/*
+ * Abort a transfer in progress; 1 if it has terminated already
+ */
+static int
+abortXfer(epicsDmaId dmaId)
+{
+    if (!epicsAtomicGetIntT(&dmaId->busy))
+        return 1;
+    /* the data have been copied; the completion is on its way */
+    if (dmaId->pioDone)
+        return -1;
+    if (dmaId->be->abort == NULL || (*dmaId->be->abort)(dmaId->dmaId) != 0)
+        return -1;
+    /* the completion callback won't run */
+    dmaId->stats.nAborts++;
+    dmaId->rowsLeft = 0;
+    dmaId->syncBuf = NULL;
+    epicsAtomicSetIntT(&dmaId->busy, 0);
+    /* wake a waiter (unless it is the one aborting after a timeout) */
+    if (epicsAtomicCmpAndSwapIntT(&dmaId->waiting, 1, 0) == 1) {
+        dmaId->cancelled = 1;
+        epicsEventSignal(dmaId->eventId);
+    }
+    return 0;
+}
+
+int
+epicsDmaAbort(epicsDmaId dmaId)
+{
+    return abortXfer(dmaId) < 0 ? -1 : 0;
+}
+
+/*
+ * Set the scheduling priority of subsequent transfers
+ */
+int
+epicsDmaSetPriority(epicsDmaId dmaId, int priority)
+{
+    if (dmaId->be->setPriority == NULL)
+        return -1;
+    return (*dmaId->be->setPriority)(dmaId->dmaId, priority) ? -1 : 0;
+}
+
+/*
+ * Wait for the completion of a transfer started with 'wait' set
+ */
+static int
+waitDone(epicsDmaId dmaId, double timeout)
+{
+    epicsEventStatus ev;
+
+    if (timeout < 0.)
+        ev = epicsEventWait(dmaId->eventId);
+    else
+        ev = epicsEventWaitWithTimeout(dmaId->eventId, timeout);
+
+    if (ev != epicsEventWaitOK) {
+        /* whoever resets 'waiting' first decides: if the completion
+         * came in the meantime, consume its signal
+         */
+        if (epicsAtomicCmpAndSwapIntT(&dmaId->waiting, 1, 0) != 1) {
+            epicsEventMustWait(dmaId->eventId);
+            ev = epicsEventWaitOK;
+        } else if (abortXfer(dmaId) > 0) {
+            /* completed just now (the completion found 'waiting' reset) */
+            dmaId->stats.nLate++;
+            ev = epicsEventWaitOK;
         }
+        /* if the abort failed the handle stays busy (EBUSY) until the
+         * transfer does complete
+         */
     }
-    dmaId->waiting = 1;
-    status = epicsDmaToVme(dmaId, vmeAddr, adrsSpace, pLocal, length, dataWidth);
-    if (status != 0)
-        return status;
-    epicsEventWait(dmaId->eventId);
-    return epicsDmaStatus(dmaId);
+    if (ev != epicsEventWaitOK)
+        return ETIMEDOUT;
+    /* epicsDmaAbort() from another thread */
+    return dmaId->cancelled ? ECANCELED : epicsDmaStatus(dmaId);
+}
+
+/*
+ * Start a DMA transaction and wait (at most 'timeout' seconds if
+ * 'timeout' >= 0) for its completion
+ */
+static int
+startAndWait(epicsDmaId dmaId, int toVme, epicsUInt32 vmeAddr, int adrsSpace,
+             void *pLocal, int length, int dataWidth, double timeout,
+             int rows, int localStride, int vmeStride)
+{
+    int status;
+
+    epicsMutexMustLock(dmaId->waitLock);
+
+    status = startXfer(dmaId, toVme, vmeAddr, adrsSpace, pLocal, length, dataWidth, 1,
+                       rows, localStride, vmeStride);
+    if (status == 0)
+        status = waitDone(dmaId, timeout);
+
+    epicsMutexUnlock(dmaId->waitLock);
+    return status;
+}
+
+/*
+ * Start a DMA transaction to a VME module and wait for completion
+ */
+int
+epicsDmaToVmeAndWait(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
+                                 void *pLocal, int length, int dataWidth)
+{
+    return startAndWait(dmaId, 1, vmeAddr, adrsSpace, pLocal, length, dataWidth, -1., 1, 0, 0);
 }
 
 /*
@@ -166,19 +938,180 @@ epicsDmaToVmeAndWait(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
 int
 epicsDmaFromVmeAndWait(epicsDmaId dmaId, void *pLocal, epicsUInt32 vmeAddr,
                                    int adrsSpace, int length, int dataWidth)
+{
+    return startAndWait(dmaId, 0, vmeAddr, adrsSpace, pLocal, length, dataWidth, -1., 1, 0, 0);
+}
+
+/*
+ * Same with a timeout
+ */
+int
+epicsDmaToVmeAndWaitTimeout(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
+                            void *pLocal, int length, int dataWidth, double timeout)
+{
+    return startAndWait(dmaId, 1, vmeAddr, adrsSpace, pLocal, length, dataWidth,
+                        timeout, 1, 0, 0);
+}
+
+int
+epicsDmaFromVmeAndWaitTimeout(epicsDmaId dmaId, void *pLocal, epicsUInt32 vmeAddr,
+                              int adrsSpace, int length, int dataWidth, double timeout)
+{
+    return startAndWait(dmaId, 0, vmeAddr, adrsSpace, pLocal, length, dataWidth,
+                        timeout, 1, 0, 0);
+}
+
+int
+epicsDmaFromVme2DAndWaitTimeout(epicsDmaId dmaId, void *pLocal, int localStride,
+                                epicsUInt32 vmeAddr, int vmeStride, int adrsSpace,
+                                int rowBytes, int rows, int dataWidth, double timeout)
+{
+    if (rows < 1 || rowBytes < 1 || localStride < rowBytes || vmeStride < rowBytes)
+        return EINVAL;
+    return startAndWait(dmaId, 0, vmeAddr, adrsSpace, pLocal, rowBytes, dataWidth,
+                        timeout, rows, localStride, vmeStride);
+}
+
+static int
+copyAndWait(epicsDmaId dmaId, int kind, void *dst, const void *src,
+            epicsUInt32 pciAddr, volatile void *pci, int length, int dataWidth,
+            double timeout)
 {
     int status;
 
-    if (dmaId->eventId == NULL) {
-        if ((dmaId->eventId = epicsEventCreate(epicsEventEmpty)) == NULL) {
-            errno = ENOMEM;
-            return -1;
+    epicsMutexMustLock(dmaId->waitLock);
+    status = startCopy(dmaId, kind, dst, src, pciAddr, pci, length, dataWidth, 1);
+    if (status == 0)
+        status = waitDone(dmaId, timeout);
+    epicsMutexUnlock(dmaId->waitLock);
+    return status;
+}
+
+int
+epicsDmaMemCopyAndWaitTimeout(epicsDmaId dmaId, void *dst, const void *src,
+                              int length, double timeout)
+{
+    return copyAndWait(dmaId, COPY_MEM, dst, src, 0, NULL, length, 1, timeout);
+}
+
+int
+epicsDmaFromPciAndWaitTimeout(epicsDmaId dmaId, void *pLocal, epicsUInt32 pciAddr,
+                              volatile void *pciLocal, int length, int dataWidth,
+                              double timeout)
+{
+    return copyAndWait(dmaId, COPY_FROM_PCI, pLocal, NULL, pciAddr, pciLocal,
+                       length, dataWidth, timeout);
+}
+
+int
+epicsDmaToPciAndWaitTimeout(epicsDmaId dmaId, epicsUInt32 pciAddr, volatile void *pciLocal,
+                            void *pLocal, int length, int dataWidth, double timeout)
+{
+    return copyAndWait(dmaId, COPY_TO_PCI, NULL, pLocal, pciAddr, pciLocal,
+                       length, dataWidth, timeout);
+}
+
+void
+epicsDmaDeliveryReport(int level)
+{
+    static const char *name[] = { "isr", "callback", "batched" };
+    deliveryStats s;
+    int i;
+
+    epicsThreadOnce(&statsOnce, statsInit, 0);
+
+    printf("%10s %10s %10s %8s %12s %12s\n",
+           "delivery", "callbacks", "wakeups", "lost", "avg lat[us]", "max lat[us]");
+    /* interrupt delivery has no latency to speak of */
+    for (i = EPICS_DMA_DELIVER_CALLBACK; i <= EPICS_DMA_DELIVER_BATCHED; i++) {
+        epicsMutexMustLock(statsLock);
+        s = stats[i];
+        epicsMutexUnlock(statsLock);
+        printf("%10s %10lu %10lu %8lu %12.1f %12.1f\n", name[i],
+               s.nCallbacks, s.nWakeups, s.nLost,
+               s.nWakeups ? (double)s.sumLatency / s.nWakeups * 1.0E-3 : 0.,
+               (double)s.maxLatency * 1.0E-3);
+    }
+}
+
+void
+epicsDmaReport(int level)
+{
+    struct epicsDmaInfo *dmaId;
+    epicsDmaStats       s;
+    int                 i;
+
+    epicsThreadOnce(&statsOnce, statsInit, 0);
+
+    printf("%-16s %10s %12s %8s %8s %8s %10s %10s %8s\n", "handle", "xfers",
+           "bytes", "errors", "aborts", "pio", "avg[us]", "max[us]", "MB/s");
+    /* handles are never destroyed; the list only grows at the head */
+    epicsMutexMustLock(statsLock);
+    dmaId = handles;
+    epicsMutexUnlock(statsLock);
+    for (; dmaId; dmaId = dmaId->next) {
+        epicsDmaGetStats(dmaId, &s);
+        printf("%-16s %10lu %12.0f %8lu %8lu %8lu %10.1f %10.1f %8.2f\n",
+               dmaId->name, s.nXfers, s.bytes, s.nErrors, s.nAborts, s.nPio,
+               s.nXfers ? s.sumTime / s.nXfers * 1.0E6 : 0., s.maxTime * 1.0E6,
+               s.sumTime > 0. ? s.bytes / s.sumTime * 1.0E-6 : 0.);
+        if (s.nErrors)
+            printf("%-16s last error %d\n", "", s.lastError);
+        if (s.nLate)
+            printf("%-16s %lu completions found after the wait timed out\n", "", s.nLate);
+        if (level > 0) {
+            printf("%-16s", "  <us:");
+            for (i = 0; i < EPICS_DMA_HIST_BINS; i++) {
+                if (i < EPICS_DMA_HIST_BINS - 1)
+                    printf(" %6u", 1u << i);
+                else
+                    printf(" %6s", "more");
+            }
+            printf("\n%-16s", "");
+            for (i = 0; i < EPICS_DMA_HIST_BINS; i++)
+                printf(" %6lu", s.hist[i]);
+            printf("\n");
         }
     }
-    dmaId->waiting = 1;
-    status = epicsDmaFromVme(dmaId, pLocal, vmeAddr, adrsSpace, length, dataWidth);
-    if (status != 0)
-        return status;
-    epicsEventWait(dmaId->eventId);
-    return epicsDmaStatus(dmaId);
+#if defined(__rtems__)
+    if (level > 0 && backend == NULL)
+        rtemsVmeDmaReport(level);
+#endif
 }
+
+static const iocshArg epicsDmaReportArg0 = { "level", iocshArgInt };
+static const iocshArg *epicsDmaReportArgs[] = {
+    &epicsDmaReportArg0,
+};
+static const iocshFuncDef epicsDmaReportDef = {
+    "epicsDmaReport", 1, epicsDmaReportArgs
+};
+
+static void
+epicsDmaReportCall(const iocshArgBuf *args)
+{
+    epicsDmaReport(args[0].ival);
+}
+
+static const iocshArg epicsDmaDeliveryReportArg0 = { "level", iocshArgInt };
+static const iocshArg *epicsDmaDeliveryReportArgs[] = {
+    &epicsDmaDeliveryReportArg0,
+};
+static const iocshFuncDef epicsDmaDeliveryReportDef = {
+    "epicsDmaDeliveryReport", 1, epicsDmaDeliveryReportArgs
+};
+
+static void
+epicsDmaDeliveryReportCall(const iocshArgBuf *args)
+{
+    epicsDmaDeliveryReport(args[0].ival);
+}
+
+static void
+epicsDmaRegistrar(void)
+{
+    iocshRegister(&epicsDmaReportDef,         epicsDmaReportCall);
+    iocshRegister(&epicsDmaDeliveryReportDef, epicsDmaDeliveryReportCall);
+}
+
+epicsExportRegistrar(epicsDmaRegistrar);
@@ -1,8 +1,13 @@
 #ifndef _EPICSDMA_H_
 #define _EPICSDMA_H_
 
+#include <stddef.h>
 #include <epicsTypes.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef void (*epicsDmaCallback_t)(void *);
 typedef struct epicsDmaInfo *epicsDmaId;
 
@@ -10,6 +15,48 @@ typedef struct epicsDmaInfo *epicsDmaId;
  * EPICS wrappers/additions
  */
 epicsDmaId epicsDmaCreate(epicsDmaCallback_t callback, void *context);
+
+/*
+ * Where the completion callback runs: directly from the DMA interrupt
+ * (as with epicsDmaCreate()), on the EPICS callback queue of 'priority'
+ * (priorityLow/Medium/High), or batched: all completions of a clock
+ * tick are delivered together by one callback thread wakeup. Waiters
+ * (...AndWait) are always woken from the interrupt.
+ */
+#define EPICS_DMA_DELIVER_ISR       0
+#define EPICS_DMA_DELIVER_CALLBACK  1
+#define EPICS_DMA_DELIVER_BATCHED   2
+epicsDmaId epicsDmaCreateDelivery(epicsDmaCallback_t callback, void *context,
+                                  int delivery, int priority);
+/* completion-to-callback latency by delivery mode */
+void epicsDmaDeliveryReport(int level);
+
+/*
+ * Statistics of a handle; times are from starting a transfer to its
+ * completion (including waiting for a channel). Handles are named
+ * "dma<n>" in order of creation unless named by the driver; ai
+ * records can show the statistics (DTYP "EPICS DMA Stats",
+ * INP "@<name> <xfers|bytes|errors|aborts|pio|avgUs|maxUs|MBps>").
+ */
+#define EPICS_DMA_HIST_BINS 16  /* < 1us, < 2us, < 4us, ..., larger */
+typedef struct epicsDmaStats {
+    unsigned long   nXfers;     /* completed, including errors */
+    unsigned long   nErrors;
+    unsigned long   nAborts;
+    unsigned long   nLate;      /* found complete only after a wait timed out */
+    unsigned long   nPio;       /* done by the CPU (PIO, copies) */
+    double          bytes;
+    double          sumTime;    /* s */
+    double          maxTime;
+    int             lastError;  /* epicsDmaStatus() */
+    unsigned long   hist[EPICS_DMA_HIST_BINS];
+} epicsDmaStats;
+
+int epicsDmaSetName(epicsDmaId dmaId, const char *name);
+epicsDmaId epicsDmaFind(const char *name);
+int epicsDmaGetStats(epicsDmaId dmaId, epicsDmaStats *pStats);
+/* all handles; level > 0: histograms, and the driver's per-channel report */
+void epicsDmaReport(int level);
 int epicsDmaStatus(epicsDmaId dmaId);
 int epicsDmaToVme(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
                           void *pLocal, int length, int dataWidth);
@@ -20,4 +67,181 @@ int epicsDmaToVmeAndWait(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
 int epicsDmaFromVmeAndWait(epicsDmaId dmaId, void *pLocal, epicsUInt32 vmeAddr,
                                    int adrsSpace, int length, int dataWidth);
 
+/*
+ * Variants which give up after 'timeout' seconds, abort the transfer
+ * and return ETIMEDOUT. A handle may be shared by several threads;
+ * waiting callers are serialized. If the backend cannot abort, the
+ * handle stays busy (starting a transfer returns EBUSY) until the
+ * late completion arrives.
+ *
+ * In all ...AndWaitTimeout() routines a negative 'timeout' waits
+ * forever and 0 aborts unless the transfer completed right away.
+ */
+int epicsDmaToVmeAndWaitTimeout(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
+                                void *pLocal, int length, int dataWidth, double timeout);
+int epicsDmaFromVmeAndWaitTimeout(epicsDmaId dmaId, void *pLocal, epicsUInt32 vmeAddr,
+                                  int adrsSpace, int length, int dataWidth, double timeout);
+
+/*
+ * Read 'rows' rows of 'rowBytes' bytes, 'vmeStride' bytes apart on
+ * VME, into rows 'localStride' bytes apart; the callback is called
+ * once, when the last row is done (or the first one failed). Uses the
+ * backend's descriptor lists if it has them; otherwise the rows are
+ * queued one after the other from the completion interrupt. The
+ * local buffer is synced as a whole, so the gaps between rows must not
+ * be written while the transfer runs. A negative 'timeout' waits
+ * forever.
+ */
+int epicsDmaFromVme2D(epicsDmaId dmaId, void *pLocal, int localStride,
+                      epicsUInt32 vmeAddr, int vmeStride, int adrsSpace,
+                      int rowBytes, int rows, int dataWidth);
+int epicsDmaFromVme2DAndWaitTimeout(epicsDmaId dmaId, void *pLocal, int localStride,
+                                    epicsUInt32 vmeAddr, int vmeStride, int adrsSpace,
+                                    int rowBytes, int rows, int dataWidth, double timeout);
+
+/*
+ * Copies between local buffers, and between local buffers and PCI
+ * device memory ('pciAddr' as seen by the DMA engine, 'pciLocal' as
+ * mapped for the CPU). They are done by the DMA engine where the
+ * backend supports it; otherwise the CPU copies (with accesses of
+ * 'dataWidth' bytes to PCI memory) on a callback thread, or in the
+ * caller when waiting. The completion callback is called either way.
+ * A negative 'timeout' waits forever.
+ */
+int epicsDmaMemCopy(epicsDmaId dmaId, void *dst, const void *src, int length);
+int epicsDmaMemCopyAndWaitTimeout(epicsDmaId dmaId, void *dst, const void *src,
+                                  int length, double timeout);
+int epicsDmaFromPci(epicsDmaId dmaId, void *pLocal, epicsUInt32 pciAddr,
+                    volatile void *pciLocal, int length, int dataWidth);
+int epicsDmaToPci(epicsDmaId dmaId, epicsUInt32 pciAddr, volatile void *pciLocal,
+                  void *pLocal, int length, int dataWidth);
+int epicsDmaFromPciAndWaitTimeout(epicsDmaId dmaId, void *pLocal, epicsUInt32 pciAddr,
+                                  volatile void *pciLocal, int length, int dataWidth,
+                                  double timeout);
+int epicsDmaToPciAndWaitTimeout(epicsDmaId dmaId, epicsUInt32 pciAddr, volatile void *pciLocal,
+                                void *pLocal, int length, int dataWidth, double timeout);
+
+/*
+ * Abort the transfer in progress (if any); the completion callback is
+ * not called and an ...AndWait() caller returns ECANCELED.
+ * RETURNS: 0 on success, -1 if the backend can't abort.
+ */
+int epicsDmaAbort(epicsDmaId dmaId);
+
+/*
+ * Scheduling priority of the handle's transfers where the backend
+ * queues requests for several DMA channels (higher first, default 0).
+ * RETURNS: 0 on success, -1 if the backend has no priorities.
+ */
+int epicsDmaSetPriority(epicsDmaId dmaId, int priority);
+
+/*
+ * Alternate backend, e.g., the simulation (epicsDmaSimInstall). Must
+ * be set before creating handles; NULL restores the BSP's routines.
+ * Only 'create', 'status', 'toVme' and 'fromVme' are required. Without
+ * 'localAddr' all transfers use DMA, without 'fromVme2D' 2D transfers
+ * are done row by row (also if it returns ENOTSUP) and without
+ * 'memCopy'/'pciCopy' the CPU copies.
+ */
+typedef struct epicsDmaBackend {
+    void *  (*create)(epicsDmaCallback_t callback, void *context);
+    int     (*status)(void *id);
+    int     (*toVme)(void *id, epicsUInt32 vmeAddr, int adrsSpace,
+                     void *pLocal, int length, int dataWidth);
+    int     (*fromVme)(void *id, void *pLocal, epicsUInt32 vmeAddr,
+                       int adrsSpace, int length, int dataWidth);
+    int     (*abort)(void *id);
+    int     (*setPriority)(void *id, int priority);
+    int     (*localAddr)(epicsUInt32 vmeAddr, int adrsSpace, int length,
+                         volatile void **ppLocal);
+    int     (*fromVme2D)(void *id, void *pLocal, int localStride,
+                         epicsUInt32 vmeAddr, int vmeStride, int adrsSpace,
+                         int rowBytes, int rows, int dataWidth);
+    int     (*memCopy)(void *id, void *dst, const void *src, int length);
+    int     (*pciCopy)(void *id, int toPci, void *pLocal, epicsUInt32 pciAddr,
+                       int length, int dataWidth);
+} epicsDmaBackend;
+
+int epicsDmaSetBackend(const epicsDmaBackend *backend);
+
+/*
+ * Programmed I/O
+ *
+ * Transfers of at most the threshold for their direction and data
+ * width (1, 2 or 4) are done by the CPU through the VME window instead
+ * of the DMA engine, where setting up the engine and taking the
+ * interrupt cost more than the copy. The completion callback is still
+ * called (from a callback thread unless waiting) and epicsDmaStatus()
+ * returns 0. Thresholds are 0 (always DMA) until set or calibrated.
+ */
+int epicsDmaPioEnable(epicsDmaId dmaId, int enable);
+int epicsDmaPioThresholdSet(int toVme, int dataWidth, int length);
+int epicsDmaPioThresholdGet(int toVme, int dataWidth);
+
+/*
+ * Measure PIO and DMA to/from 'vmeAddr' (which must be memory; it is
+ * overwritten if 'write' is set) for lengths up to 'maxLength' and set
+ * the thresholds to the longest transfers for which PIO is faster.
+ */
+int epicsDmaPioCalibrate(epicsUInt32 vmeAddr, int adrsSpace, int maxLength, int write);
+void epicsDmaPioReport(int level);
+
+/* CPU address of VME memory for the handle's backend; 0 on success */
+int epicsDmaLocalAddr(epicsDmaId dmaId, epicsUInt32 vmeAddr, int adrsSpace,
+                      int length, volatile void **ppLocal);
+/* copy using accesses of 'dataWidth' bytes to the VME side */
+void epicsDmaPioCopy(int toVme, volatile void *vme, void *pLocal, int length, int dataWidth);
+
+/*
+ * Simulated VME DMA: transfers copy from/to a simulated VME memory of
+ * 'memSize' bytes (addresses wrap) and complete 'latency' seconds
+ * after they were started; a fraction 'hangProb' (0..1) never
+ * completes (to exercise timeouts).
+ */
+int epicsDmaSimInstall(unsigned long memSize, double latency, double hangProb);
+void epicsDmaSimReport(int level);
+
+typedef struct epicsDmaSimCounts {
+    unsigned long   nStarted;
+    unsigned long   nCompleted;
+    unsigned long   nHung;          /* of the started ones */
+    unsigned long   nAborted;       /* all aborts, including... */
+    unsigned long   nHungAborted;   /* ... those of hung transfers */
+    unsigned long   nAbortLate;     /* aborts failed: completion under way */
+    unsigned long   nBusy;
+} epicsDmaSimCounts;
+int epicsDmaSimGetCounts(epicsDmaSimCounts *pCounts);
+
+/*
+ * DMA buffers
+ *
+ * Pools of aligned buffers are reserved at boot (epicsDmaBufPoolCreate,
+ * also from iocsh); epicsDmaBufAlloc() never calls malloc() and
+ * returns NULL if all pools which are large enough are exhausted.
+ * Buffers are a power of two (>= 256) in size and aligned to their
+ * size (up to a page).
+ */
+int epicsDmaBufPoolCreate(size_t size, unsigned count);
+void *epicsDmaBufAlloc(size_t size);
+void epicsDmaBufFree(void *buf);
+void epicsDmaBufReport(int level);
+/* nonzero if 'length' bytes at 'buf' lie within a pool */
+int epicsDmaBufInPool(const void *buf, size_t length);
+
+/*
+ * Cache maintenance before/after a transfer. The transfer routines do
+ * this for buffers from the pools only; callers passing other buffers
+ * do it themselves where DMA is not coherent. Buffers which share
+ * cache lines with other data cannot safely receive DMA on such CPUs;
+ * use epicsDmaBufAlloc().
+ */
+#define EPICS_DMA_TO_DEVICE     1
+#define EPICS_DMA_FROM_DEVICE   2
+void epicsDmaSyncForDevice(void *buf, size_t length, int direction);
+void epicsDmaSyncForCpu(void *buf, size_t length, int direction);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _EPICSDMA_H_ */
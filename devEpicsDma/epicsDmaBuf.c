@@ -0,0 +1,323 @@
+/*
+ * Pools of aligned DMA buffers and cache maintenance
+ */
+#include <epicsDma.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__rtems__)
+# include <rtems.h>
+#elif defined(vxWorks)
+# include <cacheLib.h>
+#endif
+
+/*
+ * Buffers of a pool are a power of two in size and aligned to their
+ * size (but at most to a page) so that a buffer never shares a cache
+ * line with other data and VME block transfers don't need to be broken
+ * up at the start (BLT: 256b, MBLT: 2k boundaries).
+ */
+#define DMA_BUF_MIN_SIZE    256
+#define DMA_BUF_MAX_ALIGN   4096
+#define DMA_BUF_MAX_POOLS   16
+
+typedef struct dmaBufFree {
+    struct dmaBufFree   *next;
+} dmaBufFree;
+
+typedef struct dmaBufPool {
+    size_t              size;
+    unsigned            count;
+    unsigned            nFree;
+    unsigned            minFree;    /* low-water mark       */
+    unsigned long       nAlloc;
+    unsigned long       nFail;      /* pool (and larger ones) exhausted */
+    char                *start;
+    char                *end;
+    dmaBufFree          *freeList;
+} dmaBufPool;
+
+/* sorted by size */
+static dmaBufPool       pools[DMA_BUF_MAX_POOLS];
+static unsigned         nPools;
+
+/* the pools' memory; append-only so that epicsDmaBufInPool() can read
+ * it without the lock (it is called when starting transfers, possibly
+ * from a completion callback in interrupt context)
+ */
+static struct {
+    const char          *start;
+    const char          *end;
+} poolMem[DMA_BUF_MAX_POOLS];
+static int              nPoolMem;
+static epicsMutexId     poolLock;
+static epicsThreadOnceId poolOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+poolInit(void *unused)
+{
+    poolLock = epicsMutexMustCreate();
+}
+
+static size_t
+roundSize(size_t size)
+{
+    size_t s = DMA_BUF_MIN_SIZE;
+
+    while (s < size && s)
+        s <<= 1;
+    return s;
+}
+
+/*
+ * Reserve 'count' buffers of 'size' bytes (rounded up to a power of
+ * two); to be called at boot before the buffers are needed.
+ */
+int
+epicsDmaBufPoolCreate(size_t size, unsigned count)
+{
+    dmaBufPool  *p;
+    size_t      align;
+    char        *mem;
+    unsigned    i;
+
+    epicsThreadOnce(&poolOnce, poolInit, 0);
+
+    if (size == 0 || count == 0 || (size = roundSize(size)) == 0) {
+        errlogPrintf("epicsDmaBufPoolCreate: invalid size/count\n");
+        return -1;
+    }
+    align = size < DMA_BUF_MAX_ALIGN ? size : DMA_BUF_MAX_ALIGN;
+
+    epicsMutexMustLock(poolLock);
+
+    for (i = 0; i < nPools; i++) {
+        if (pools[i].size >= size)
+            break;
+    }
+    if (i < nPools && pools[i].size == size) {
+        epicsMutexUnlock(poolLock);
+        errlogPrintf("epicsDmaBufPoolCreate: pool of %lu byte buffers exists already\n",
+                     (unsigned long)size);
+        return -1;
+    }
+    if (nPools == DMA_BUF_MAX_POOLS) {
+        epicsMutexUnlock(poolLock);
+        errlogPrintf("epicsDmaBufPoolCreate: too many pools\n");
+        return -1;
+    }
+
+    if (count > ((size_t)-1 - (align - 1)) / size) {
+        epicsMutexUnlock(poolLock);
+        errlogPrintf("epicsDmaBufPoolCreate: %u buffers of %lu bytes are too large\n",
+                     count, (unsigned long)size);
+        return -1;
+    }
+
+    /* never freed */
+    if ((mem = malloc(size * count + align - 1)) == NULL) {
+        epicsMutexUnlock(poolLock);
+        errlogPrintf("epicsDmaBufPoolCreate: no memory for %u buffers of %lu bytes\n",
+                     count, (unsigned long)size);
+        return -1;
+    }
+    mem = (char *)(((uintptr_t)mem + align - 1) & ~(uintptr_t)(align - 1));
+
+    memmove(&pools[i + 1], &pools[i], sizeof(pools[0]) * (nPools - i));
+    p = &pools[i];
+    nPools++;
+
+    p->size     = size;
+    p->count    = count;
+    p->nFree    = count;
+    p->minFree  = count;
+    p->nAlloc   = 0;
+    p->nFail    = 0;
+    p->start    = mem;
+    p->end      = mem + size * count;
+    p->freeList = NULL;
+    for (i = count; i > 0; i--) {
+        dmaBufFree *b = (dmaBufFree *)(mem + size * (i - 1));
+        b->next = p->freeList;
+        p->freeList = b;
+    }
+
+    poolMem[nPoolMem].start = p->start;
+    poolMem[nPoolMem].end   = p->end;
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&nPoolMem, nPoolMem + 1);
+
+    epicsMutexUnlock(poolLock);
+    return 0;
+}
+
+int
+epicsDmaBufInPool(const void *buf, size_t length)
+{
+    const char  *b = buf;
+    int         i, n = epicsAtomicGetIntT(&nPoolMem);
+
+    epicsAtomicReadMemoryBarrier();
+    for (i = 0; i < n; i++) {
+        if (b >= poolMem[i].start && b < poolMem[i].end)
+            return length <= (size_t)(poolMem[i].end - b);
+    }
+    return 0;
+}
+
+/*
+ * Get a buffer of at least 'size' bytes from the smallest pool which
+ * has one; never falls back to malloc().
+ */
+void *
+epicsDmaBufAlloc(size_t size)
+{
+    dmaBufFree  *b = NULL;
+    unsigned    i;
+
+    epicsThreadOnce(&poolOnce, poolInit, 0);
+
+    epicsMutexMustLock(poolLock);
+    for (i = 0; i < nPools; i++) {
+        if (pools[i].size < size)
+            continue;
+        if ((b = pools[i].freeList) != NULL) {
+            pools[i].freeList = b->next;
+            if (--pools[i].nFree < pools[i].minFree)
+                pools[i].minFree = pools[i].nFree;
+            pools[i].nAlloc++;
+            break;
+        }
+        pools[i].nFail++;
+    }
+    epicsMutexUnlock(poolLock);
+    return b;
+}
+
+void
+epicsDmaBufFree(void *buf)
+{
+    dmaBufFree  *b = buf;
+    unsigned    i;
+
+    if (buf == NULL)
+        return;
+
+    epicsThreadOnce(&poolOnce, poolInit, 0);
+
+    epicsMutexMustLock(poolLock);
+    for (i = 0; i < nPools; i++) {
+        if ((char *)buf >= pools[i].start && (char *)buf < pools[i].end) {
+            b->next = pools[i].freeList;
+            pools[i].freeList = b;
+            pools[i].nFree++;
+            break;
+        }
+    }
+    epicsMutexUnlock(poolLock);
+
+    if (i == nPools)
+        errlogPrintf("epicsDmaBufFree: %p was not allocated by epicsDmaBufAlloc\n", buf);
+}
+
+/*
+ * Cache maintenance; a no-op on hosts with coherent DMA.
+ *
+ * Before a transfer dirty lines are written back (and, for transfers
+ * to memory, evicted so they are not written back over the new data).
+ * After a transfer to memory stale lines are invalidated. Only buffers
+ * which don't share cache lines with other data (such as those from
+ * epicsDmaBufAlloc()) can be invalidated safely.
+ */
+void
+epicsDmaSyncForDevice(void *buf, size_t length, int direction)
+{
+#if defined(__rtems__)
+    rtems_cache_flush_multiple_data_lines(buf, length);
+#elif defined(vxWorks)
+    cacheFlush(DATA_CACHE, buf, length);
+#endif
+}
+
+void
+epicsDmaSyncForCpu(void *buf, size_t length, int direction)
+{
+    if (direction != EPICS_DMA_FROM_DEVICE)
+        return;
+#if defined(__rtems__)
+    rtems_cache_invalidate_multiple_data_lines(buf, length);
+#elif defined(vxWorks)
+    cacheInvalidate(DATA_CACHE, buf, length);
+#endif
+}
+
+void
+epicsDmaBufReport(int level)
+{
+    unsigned i;
+
+    epicsThreadOnce(&poolOnce, poolInit, 0);
+
+    printf("%10s %8s %8s %8s %10s %8s\n",
+           "Size", "Count", "Free", "MinFree", "Allocs", "Exhaust");
+    epicsMutexMustLock(poolLock);
+    for (i = 0; i < nPools; i++) {
+        printf("%10lu %8u %8u %8u %10lu %8lu\n",
+               (unsigned long)pools[i].size, pools[i].count, pools[i].nFree,
+               pools[i].minFree, pools[i].nAlloc, pools[i].nFail);
+        if (level > 0)
+            printf("%10s %p..%p\n", "", (void *)pools[i].start, (void *)pools[i].end);
+    }
+    epicsMutexUnlock(poolLock);
+}
+
+static const iocshArg epicsDmaBufPoolCreateArg0 = { "size",  iocshArgInt };
+static const iocshArg epicsDmaBufPoolCreateArg1 = { "count", iocshArgInt };
+static const iocshArg *epicsDmaBufPoolCreateArgs[] = {
+    &epicsDmaBufPoolCreateArg0,
+    &epicsDmaBufPoolCreateArg1,
+};
+static const iocshFuncDef epicsDmaBufPoolCreateDef = {
+    "epicsDmaBufPoolCreate", 2, epicsDmaBufPoolCreateArgs
+};
+
+static void
+epicsDmaBufPoolCreateCall(const iocshArgBuf *args)
+{
+    if (args[0].ival <= 0 || args[1].ival <= 0) {
+        errlogPrintf("usage: epicsDmaBufPoolCreate <size> <count>\n");
+        return;
+    }
+    epicsDmaBufPoolCreate((size_t)args[0].ival, (unsigned)args[1].ival);
+}
+
+static const iocshArg epicsDmaBufReportArg0 = { "level", iocshArgInt };
+static const iocshArg *epicsDmaBufReportArgs[] = {
+    &epicsDmaBufReportArg0,
+};
+static const iocshFuncDef epicsDmaBufReportDef = {
+    "epicsDmaBufReport", 1, epicsDmaBufReportArgs
+};
+
+static void
+epicsDmaBufReportCall(const iocshArgBuf *args)
+{
+    epicsDmaBufReport(args[0].ival);
+}
+
+static void
+epicsDmaBufRegistrar(void)
+{
+    iocshRegister(&epicsDmaBufPoolCreateDef, epicsDmaBufPoolCreateCall);
+    iocshRegister(&epicsDmaBufReportDef,     epicsDmaBufReportCall);
+}
+
+epicsExportRegistrar(epicsDmaBufRegistrar);
@@ -0,0 +1,297 @@
+/*
+ * Futures over epicsDma
+ */
+#include <errno.h>
+
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <errlog.h>
+
+#include <epicsDmaFuture.h>
+
+/*
+ * Transfers on a channel are numbered (wrapping around); a future is
+ * done once the channel has completed as many transfers as its number.
+ * Whoever clears 'pending' (the completion callback or abort()) accounts
+ * for the completion, so a completion racing with an abort is counted
+ * once.
+ */
+struct epicsDmaChannelCore {
+    epicsDmaId      id;
+    epicsEventId    event;
+    size_t          started;    /* number of the last transfer started */
+    size_t          completed;  /* ... and completed (atomic) */
+    int             pending;    /* a transfer is in flight (atomic) */
+    int             status;     /* of the last completed transfer */
+};
+
+static void
+complete(epicsDmaChannelCore *core, int status)
+{
+    core->status = status;
+    epicsAtomicIncrSizeT(&core->completed);
+    epicsEventSignal(core->event);
+}
+
+extern "C" {
+static void
+channelCallback(void *context)
+{
+    epicsDmaChannelCore *core = static_cast<epicsDmaChannelCore *>(context);
+
+    if (epicsAtomicCmpAndSwapIntT(&core->pending, 1, 0) == 1)
+        complete(core, epicsDmaStatus(core->id));
+}
+}
+
+static bool
+isDone(const epicsDmaChannelCore *core, size_t gen)
+{
+    /* 'completed' is at most half the range behind */
+    return epicsAtomicGetSizeT(&core->completed) - gen <= ((size_t)-1 >> 1);
+}
+
+/* false if a transfer is in flight; else '*pGen' is the number of the next */
+static bool
+begin(epicsDmaChannelCore *core, size_t *pGen)
+{
+    if (epicsAtomicGetIntT(&core->pending))
+        return false;
+    *pGen = core->started + 1;
+    epicsAtomicSetIntT(&core->pending, 1);
+    return true;
+}
+
+/* the transfer may have completed already (PIO, CPU copies) */
+static epicsDmaFuture
+started(epicsDmaChannelCore *core, size_t gen, int status)
+{
+    if (status != 0) {
+        epicsAtomicSetIntT(&core->pending, 0);
+        return epicsDmaFuture(0, 0, status);
+    }
+    core->started = gen;
+    return epicsDmaFuture(core, gen, 0);
+}
+
+bool
+epicsDmaFuture::ready() const
+{
+    return core_ == 0 || isDone(core_, gen_);
+}
+
+int
+epicsDmaFuture::wait(double timeout) const
+{
+    epicsUInt64 deadline = 0, now;
+
+    if (core_ == 0)
+        return status_;
+    if (timeout >= 0.)
+        deadline = epicsMonotonicGet() + (epicsUInt64)(timeout * 1.0E9);
+    /* the event may be left signalled by an earlier transfer */
+    while (!isDone(core_, gen_)) {
+        if (timeout < 0.) {
+            epicsEventMustWait(core_->event);
+            continue;
+        }
+        if ((now = epicsMonotonicGet()) >= deadline)
+            return ETIMEDOUT;
+        epicsEventWaitWithTimeout(core_->event, (deadline - now) * 1.0E-9);
+    }
+    return core_->status;
+}
+
+epicsDmaChannel::epicsDmaChannel(int priority)
+    : core_(0)
+{
+    epicsDmaChannelCore *core = new epicsDmaChannelCore;
+
+    core->id = 0;
+    core->started = core->completed = 0;
+    core->pending = 0;
+    core->status = 0;
+    if ((core->event = epicsEventCreate(epicsEventEmpty)) == 0) {
+        errlogPrintf("epicsDmaChannel: unable to create event\n");
+        delete core;
+        return;
+    }
+    /* the callback only signals; it can run in the ISR */
+    if ((core->id = epicsDmaCreate(channelCallback, core)) == 0) {
+        errlogPrintf("epicsDmaChannel: unable to create DMA handle\n");
+        epicsEventDestroy(core->event);
+        delete core;
+        return;
+    }
+    if (priority != 0)
+        epicsDmaSetPriority(core->id, priority);
+    core_ = core;
+}
+
+epicsDmaChannel::~epicsDmaChannel()
+{
+    /* the core is the handle's callback context; it stays with the handle */
+    if (core_ != 0)
+        abort();
+}
+
+bool
+epicsDmaChannel::ok() const
+{
+    return core_ != 0;
+}
+
+epicsDmaId
+epicsDmaChannel::id() const
+{
+    return core_ ? core_->id : 0;
+}
+
+epicsDmaFuture
+epicsDmaChannel::toVme(epicsUInt32 vmeAddr, int adrsSpace, void *pLocal,
+                       int length, int dataWidth)
+{
+    size_t gen;
+
+    if (core_ == 0)
+        return epicsDmaFuture(0, 0, ENODEV);
+    if (!begin(core_, &gen))
+        return epicsDmaFuture(0, 0, EBUSY);
+    return started(core_, gen, epicsDmaToVme(core_->id, vmeAddr, adrsSpace,
+                                             pLocal, length, dataWidth));
+}
+
+epicsDmaFuture
+epicsDmaChannel::fromVme(void *pLocal, epicsUInt32 vmeAddr, int adrsSpace,
+                         int length, int dataWidth)
+{
+    size_t gen;
+
+    if (core_ == 0)
+        return epicsDmaFuture(0, 0, ENODEV);
+    if (!begin(core_, &gen))
+        return epicsDmaFuture(0, 0, EBUSY);
+    return started(core_, gen, epicsDmaFromVme(core_->id, pLocal, vmeAddr,
+                                               adrsSpace, length, dataWidth));
+}
+
+epicsDmaFuture
+epicsDmaChannel::fromVme2D(void *pLocal, int localStride, epicsUInt32 vmeAddr,
+                           int vmeStride, int adrsSpace, int rowBytes, int rows,
+                           int dataWidth)
+{
+    size_t gen;
+
+    if (core_ == 0)
+        return epicsDmaFuture(0, 0, ENODEV);
+    if (!begin(core_, &gen))
+        return epicsDmaFuture(0, 0, EBUSY);
+    return started(core_, gen, epicsDmaFromVme2D(core_->id, pLocal, localStride,
+                                                 vmeAddr, vmeStride, adrsSpace,
+                                                 rowBytes, rows, dataWidth));
+}
+
+epicsDmaFuture
+epicsDmaChannel::memCopy(void *dst, const void *src, int length)
+{
+    size_t gen;
+
+    if (core_ == 0)
+        return epicsDmaFuture(0, 0, ENODEV);
+    if (!begin(core_, &gen))
+        return epicsDmaFuture(0, 0, EBUSY);
+    return started(core_, gen, epicsDmaMemCopy(core_->id, dst, src, length));
+}
+
+int
+epicsDmaChannel::abort()
+{
+    if (core_ == 0 || !epicsAtomicGetIntT(&core_->pending))
+        return 0;
+    if (epicsDmaAbort(core_->id) != 0)
+        return -1;
+    /* unless the completion beat us to it */
+    if (epicsAtomicCmpAndSwapIntT(&core_->pending, 1, 0) == 1)
+        complete(core_, ECANCELED);
+    return 0;
+}
+
+int
+epicsDmaFutureSet::add(const epicsDmaFuture &f)
+{
+    if (n_ >= EPICS_DMA_WHEN_ALL_MAX) {
+        overflow_ = true;
+        return -1;
+    }
+    f_[n_++] = f;
+    return 0;
+}
+
+bool
+epicsDmaFutureSet::ready() const
+{
+    int i;
+
+    for (i = 0; i < n_; i++) {
+        if (!f_[i].ready())
+            return false;
+    }
+    return true;
+}
+
+int
+epicsDmaFutureSet::wait(double timeout) const
+{
+    epicsUInt64 deadline = 0, now;
+    double      left = -1.;
+    int         i, status, rval = 0;
+
+    if (overflow_)
+        return EINVAL;
+    if (timeout >= 0.)
+        deadline = epicsMonotonicGet() + (epicsUInt64)(timeout * 1.0E9);
+    for (i = 0; i < n_; i++) {
+        if (timeout >= 0.) {
+            now = epicsMonotonicGet();
+            left = now < deadline ? (deadline - now) * 1.0E-9 : 0.;
+        }
+        status = f_[i].wait(left);
+        if (status != 0 && rval == 0)
+            rval = status;
+    }
+    return rval;
+}
+
+epicsDmaFutureSet
+epicsDmaWhenAll(const epicsDmaFuture &a, const epicsDmaFuture &b)
+{
+    epicsDmaFutureSet s;
+
+    s.add(a);
+    s.add(b);
+    return s;
+}
+
+epicsDmaFutureSet
+epicsDmaWhenAll(const epicsDmaFuture &a, const epicsDmaFuture &b,
+                const epicsDmaFuture &c)
+{
+    epicsDmaFutureSet s;
+
+    s.add(a);
+    s.add(b);
+    s.add(c);
+    return s;
+}
+
+epicsDmaFutureSet
+epicsDmaWhenAll(const epicsDmaFuture *f, int n)
+{
+    epicsDmaFutureSet s;
+    int i;
+
+    for (i = 0; i < n; i++)
+        s.add(f[i]);
+    return s;
+}
@@ -0,0 +1,102 @@
+#ifndef _EPICSDMAFUTURE_H_
+#define _EPICSDMAFUTURE_H_
+
+/*
+ * Futures over epicsDma, for overlapping transfers with computation:
+ *
+ *     epicsDmaChannel in, out;
+ *     epicsDmaFuture  r = in.fromVme(next, vmeIn, am, len, 4);
+ *     process(cur);
+ *     epicsDmaFuture  w = out.toVme(vmeOut, am, cur, len, 4);
+ *     status = epicsDmaWhenAll(r, w).wait(1.0);
+ *
+ * A channel owns one epicsDma handle and so has at most one transfer
+ * in flight; use one channel per concurrent transfer. Completion only
+ * signals the channel's event from the DMA callback; no thread is
+ * involved. A future's status is available until the next transfer
+ * is started on its channel. One thread at a time may start transfers
+ * on a channel and one may wait on its futures.
+ *
+ * epicsDma handles can't be destroyed (nor what their completions
+ * refer to): create channels at init, not per transfer.
+ */
+
+#include <epicsDma.h>
+
+struct epicsDmaChannelCore;
+
+class epicsDmaFuture {
+public:
+    /* a failed start is a future which is ready with 'status' */
+    epicsDmaFuture(epicsDmaChannelCore *core = 0, size_t gen = 0, int status = 0)
+        : core_(core), gen_(gen), status_(status) {}
+
+    bool ready() const;
+    /* status of the transfer, ETIMEDOUT if it didn't complete in
+     * 'timeout' seconds (it is not aborted); < 0 waits forever
+     */
+    int  wait(double timeout = -1.) const;
+
+private:
+    epicsDmaChannelCore *core_; /* 0: failed to start */
+    size_t          gen_;
+    int             status_;
+};
+
+class epicsDmaChannel {
+public:
+    /* 'priority': see epicsDmaSetPriority() */
+    explicit epicsDmaChannel(int priority = 0);
+    /* aborts a transfer in flight */
+    ~epicsDmaChannel();
+
+    /* false if the DMA handle couldn't be created */
+    bool ok() const;
+    epicsDmaId id() const;
+
+    epicsDmaFuture toVme(epicsUInt32 vmeAddr, int adrsSpace, void *pLocal,
+                         int length, int dataWidth);
+    epicsDmaFuture fromVme(void *pLocal, epicsUInt32 vmeAddr, int adrsSpace,
+                           int length, int dataWidth);
+    epicsDmaFuture fromVme2D(void *pLocal, int localStride, epicsUInt32 vmeAddr,
+                             int vmeStride, int adrsSpace, int rowBytes, int rows,
+                             int dataWidth);
+    epicsDmaFuture memCopy(void *dst, const void *src, int length);
+    /* the future completes with ECANCELED */
+    int            abort();
+
+private:
+    epicsDmaChannelCore *core_;
+
+    /* not copyable */
+    epicsDmaChannel(const epicsDmaChannel &);
+    epicsDmaChannel &operator=(const epicsDmaChannel &);
+};
+
+/*
+ * Completes when all of its futures have; wait() returns the first
+ * non-zero status (or ETIMEDOUT), after waiting for all of them.
+ */
+#define EPICS_DMA_WHEN_ALL_MAX 8
+
+class epicsDmaFutureSet {
+public:
+    epicsDmaFutureSet() : n_(0), overflow_(false) {}
+
+    /* -1 if the set is full */
+    int  add(const epicsDmaFuture &f);
+    bool ready() const;
+    int  wait(double timeout = -1.) const;
+
+private:
+    epicsDmaFuture  f_[EPICS_DMA_WHEN_ALL_MAX];
+    int             n_;
+    bool            overflow_;  /* wait() returns EINVAL */
+};
+
+epicsDmaFutureSet epicsDmaWhenAll(const epicsDmaFuture &a, const epicsDmaFuture &b);
+epicsDmaFutureSet epicsDmaWhenAll(const epicsDmaFuture &a, const epicsDmaFuture &b,
+                                  const epicsDmaFuture &c);
+epicsDmaFutureSet epicsDmaWhenAll(const epicsDmaFuture *f, int n);
+
+#endif /* _EPICSDMAFUTURE_H_ */
@@ -0,0 +1,276 @@
+/*
+ * Programmed I/O for short transfers
+ */
+#include <epicsDma.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* longest PIO transfer, by direction (from/to VME) and width (1, 2, 4) */
+static int pioThreshold[2][3];
+
+#define CAL_REPEAT      20
+#define CAL_MIN_LENGTH  4
+#define CAL_TIMEOUT     1.0
+
+static int
+widthIndex(int dataWidth)
+{
+    switch (dataWidth) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    default:
+        break;
+    }
+    return -1;
+}
+
+int
+epicsDmaPioThresholdSet(int toVme, int dataWidth, int length)
+{
+    int w = widthIndex(dataWidth);
+
+    if (w < 0 || length < 0) {
+        errlogPrintf("epicsDmaPioThresholdSet: invalid data width or length\n");
+        return -1;
+    }
+    pioThreshold[toVme ? 1 : 0][w] = length;
+    return 0;
+}
+
+int
+epicsDmaPioThresholdGet(int toVme, int dataWidth)
+{
+    int w = widthIndex(dataWidth);
+
+    return w < 0 ? 0 : pioThreshold[toVme ? 1 : 0][w];
+}
+
+/*
+ * memcpy() may use other access widths than the device supports (or
+ * cache-line operations); copy one item at a time
+ */
+void
+epicsDmaPioCopy(int toVme, volatile void *vme, void *pLocal, int length, int dataWidth)
+{
+    int n;
+
+    switch (dataWidth) {
+    case 4: {
+        volatile epicsUInt32 *v = vme;
+        epicsUInt32          *l = pLocal;
+
+        n = length >> 2;
+        if (toVme)
+            while (n-- > 0) *v++ = *l++;
+        else
+            while (n-- > 0) *l++ = *v++;
+        break;
+    }
+    case 2: {
+        volatile epicsUInt16 *v = vme;
+        epicsUInt16          *l = pLocal;
+
+        n = length >> 1;
+        if (toVme)
+            while (n-- > 0) *v++ = *l++;
+        else
+            while (n-- > 0) *l++ = *v++;
+        break;
+    }
+    default: {
+        volatile epicsUInt8  *v = vme;
+        epicsUInt8           *l = pLocal;
+
+        n = length;
+        if (toVme)
+            while (n-- > 0) *v++ = *l++;
+        else
+            while (n-- > 0) *l++ = *v++;
+        break;
+    }
+    }
+}
+
+/* best of CAL_REPEAT in ns; 0 on error */
+static epicsUInt64
+timePio(int toVme, volatile void *vme, void *buf, int length, int dataWidth)
+{
+    epicsUInt64 t0, t, best = 0;
+    int         i;
+
+    for (i = 0; i < CAL_REPEAT; i++) {
+        t0 = epicsMonotonicGet();
+        epicsDmaPioCopy(toVme, vme, buf, length, dataWidth);
+        t = epicsMonotonicGet() - t0;
+        if (i == 0 || t < best)
+            best = t;
+    }
+    return best ? best : 1;
+}
+
+static epicsUInt64
+timeDma(epicsDmaId dma, int toVme, epicsUInt32 vmeAddr, int adrsSpace,
+        void *buf, int length, int dataWidth)
+{
+    epicsUInt64 t0, t, best = 0;
+    int         i, status;
+
+    for (i = 0; i < CAL_REPEAT; i++) {
+        t0 = epicsMonotonicGet();
+        if (toVme)
+            status = epicsDmaToVmeAndWaitTimeout(dma, vmeAddr, adrsSpace, buf,
+                                                 length, dataWidth, CAL_TIMEOUT);
+        else
+            status = epicsDmaFromVmeAndWaitTimeout(dma, buf, vmeAddr, adrsSpace,
+                                                   length, dataWidth, CAL_TIMEOUT);
+        t = epicsMonotonicGet() - t0;
+        if (status != 0)
+            return 0;
+        if (i == 0 || t < best)
+            best = t;
+    }
+    return best ? best : 1;
+}
+
+int
+epicsDmaPioCalibrate(epicsUInt32 vmeAddr, int adrsSpace, int maxLength, int write)
+{
+    static const int widths[] = { 1, 2, 4 };
+    epicsDmaId      dma;
+    volatile void   *vme;
+    void            *buf;
+    epicsUInt64     tPio, tDma;
+    int             toVme, w, len, thr, rval = -1;
+
+    if (maxLength < CAL_MIN_LENGTH) {
+        errlogPrintf("epicsDmaPioCalibrate: maxLength must be at least %d\n", CAL_MIN_LENGTH);
+        return -1;
+    }
+    if ((dma = epicsDmaCreate(NULL, NULL)) == NULL) {
+        errlogPrintf("epicsDmaPioCalibrate: unable to create DMA handle\n");
+        return -1;
+    }
+    if (epicsDmaLocalAddr(dma, vmeAddr, adrsSpace, maxLength, &vme) != 0) {
+        errlogPrintf("epicsDmaPioCalibrate: 0x%08x (AM 0x%02x) not mapped\n",
+                     (unsigned)vmeAddr, adrsSpace);
+        return -1;
+    }
+    /* cache-line aligned */
+    if ((buf = epicsDmaBufAlloc(maxLength)) == NULL) {
+        errlogPrintf("epicsDmaPioCalibrate: no DMA buffer of %d bytes (epicsDmaBufPoolCreate)\n",
+                     maxLength);
+        return -1;
+    }
+    memset(buf, 0, maxLength);
+    epicsDmaPioEnable(dma, 0);
+
+    for (toVme = 0; toVme <= (write ? 1 : 0); toVme++) {
+        for (w = 0; w < 3; w++) {
+            thr = 0;
+            for (len = CAL_MIN_LENGTH; len <= maxLength; len <<= 1) {
+                tPio = timePio(toVme, vme, buf, len, widths[w]);
+                tDma = timeDma(dma, toVme, vmeAddr, adrsSpace, buf, len, widths[w]);
+                if (tDma == 0) {
+                    errlogPrintf("epicsDmaPioCalibrate: DMA failed (%s VME, width %d, %d bytes)\n",
+                                 toVme ? "to" : "from", widths[w], len);
+                    goto bail;
+                }
+                if (tPio > tDma)
+                    break;
+                thr = len;
+            }
+            epicsDmaPioThresholdSet(toVme, widths[w], thr);
+        }
+    }
+    rval = 0;
+    epicsDmaPioReport(0);
+
+bail:
+    /* the handle is kept; there is no epicsDmaDestroy() */
+    epicsDmaBufFree(buf);
+    return rval;
+}
+
+void
+epicsDmaPioReport(int level)
+{
+    printf("PIO thresholds [bytes]  %8s %8s %8s\n", "D8", "D16", "D32");
+    printf("  from VME              %8d %8d %8d\n",
+           pioThreshold[0][0], pioThreshold[0][1], pioThreshold[0][2]);
+    printf("  to VME                %8d %8d %8d\n",
+           pioThreshold[1][0], pioThreshold[1][1], pioThreshold[1][2]);
+}
+
+static const iocshArg epicsDmaPioThresholdSetArg0 = { "toVme",     iocshArgInt };
+static const iocshArg epicsDmaPioThresholdSetArg1 = { "dataWidth", iocshArgInt };
+static const iocshArg epicsDmaPioThresholdSetArg2 = { "length",    iocshArgInt };
+static const iocshArg *epicsDmaPioThresholdSetArgs[] = {
+    &epicsDmaPioThresholdSetArg0,
+    &epicsDmaPioThresholdSetArg1,
+    &epicsDmaPioThresholdSetArg2,
+};
+static const iocshFuncDef epicsDmaPioThresholdSetDef = {
+    "epicsDmaPioThresholdSet", 3, epicsDmaPioThresholdSetArgs
+};
+
+static void
+epicsDmaPioThresholdSetCall(const iocshArgBuf *args)
+{
+    epicsDmaPioThresholdSet(args[0].ival, args[1].ival, args[2].ival);
+}
+
+/* A32 addresses don't fit an iocshArgInt */
+static const iocshArg epicsDmaPioCalibrateArg0 = { "vmeAddr",   iocshArgString };
+static const iocshArg epicsDmaPioCalibrateArg1 = { "adrsSpace", iocshArgInt };
+static const iocshArg epicsDmaPioCalibrateArg2 = { "maxLength", iocshArgInt };
+static const iocshArg epicsDmaPioCalibrateArg3 = { "write",     iocshArgInt };
+static const iocshArg *epicsDmaPioCalibrateArgs[] = {
+    &epicsDmaPioCalibrateArg0,
+    &epicsDmaPioCalibrateArg1,
+    &epicsDmaPioCalibrateArg2,
+    &epicsDmaPioCalibrateArg3,
+};
+static const iocshFuncDef epicsDmaPioCalibrateDef = {
+    "epicsDmaPioCalibrate", 4, epicsDmaPioCalibrateArgs
+};
+
+static void
+epicsDmaPioCalibrateCall(const iocshArgBuf *args)
+{
+    if (args[0].sval == NULL) {
+        errlogPrintf("usage: epicsDmaPioCalibrate <vmeAddr> <adrsSpace> <maxLength> <write>\n");
+        return;
+    }
+    epicsDmaPioCalibrate((epicsUInt32)strtoul(args[0].sval, NULL, 0),
+                         args[1].ival, args[2].ival, args[3].ival);
+}
+
+static const iocshArg epicsDmaPioReportArg0 = { "level", iocshArgInt };
+static const iocshArg *epicsDmaPioReportArgs[] = {
+    &epicsDmaPioReportArg0,
+};
+static const iocshFuncDef epicsDmaPioReportDef = {
+    "epicsDmaPioReport", 1, epicsDmaPioReportArgs
+};
+
+static void
+epicsDmaPioReportCall(const iocshArgBuf *args)
+{
+    epicsDmaPioReport(args[0].ival);
+}
+
+static void
+epicsDmaPioRegistrar(void)
+{
+    iocshRegister(&epicsDmaPioThresholdSetDef, epicsDmaPioThresholdSetCall);
+    iocshRegister(&epicsDmaPioCalibrateDef,    epicsDmaPioCalibrateCall);
+    iocshRegister(&epicsDmaPioReportDef,       epicsDmaPioReportCall);
+}
+
+epicsExportRegistrar(epicsDmaPioRegistrar);
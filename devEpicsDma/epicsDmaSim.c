@@ -0,0 +1,323 @@
+/*
+ * Simulated VME DMA backend (for testing without hardware)
+ */
+#include <epicsDma.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define SIM_IDLE        0
+#define SIM_QUEUED      1
+#define SIM_HUNG        2   /* never completes unless aborted */
+#define SIM_COMPLETING  3   /* dequeued by the worker; can't abort */
+
+typedef struct simDma {
+    struct simDma       *next;
+    epicsDmaCallback_t  callback;
+    void                *context;
+    int                 status;
+    int                 state;
+    int                 inCallback; /* completion being delivered */
+    int                 toVme;
+    void                *pLocal;
+    epicsUInt32         vmeAddr;
+    int                 length;
+    epicsUInt64         due;
+} simDma;
+
+static struct {
+    epicsMutexId        lock;
+    epicsEventId        wakeup;
+    simDma              *head, *tail;
+    char                *mem;
+    unsigned long       memSize;
+    epicsUInt64         latency;    /* ns */
+    double              hangProb;
+    epicsDmaSimCounts   n;
+} sim;
+
+/* copy between the local buffer and the (wrapping) VME memory */
+static void
+simCopy(simDma *d)
+{
+    unsigned long   off = d->vmeAddr % sim.memSize;
+    char            *p  = d->pLocal;
+    int             l   = d->length;
+    unsigned long   n;
+
+    while (l > 0) {
+        n = sim.memSize - off;
+        if (n > (unsigned long)l)
+            n = l;
+        if (d->toVme)
+            memcpy(sim.mem + off, p, n);
+        else
+            memcpy(p, sim.mem + off, n);
+        p  += n;
+        l  -= n;
+        off = 0;
+    }
+}
+
+static void
+simThread(void *arg)
+{
+    simDma      *d;
+    epicsUInt64 now;
+
+    for (;;) {
+        epicsMutexMustLock(sim.lock);
+        if ((d = sim.head) == NULL) {
+            epicsMutexUnlock(sim.lock);
+            epicsEventMustWait(sim.wakeup);
+            continue;
+        }
+        now = epicsMonotonicGet();
+        if (d->due > now) {
+            epicsMutexUnlock(sim.lock);
+            epicsEventWaitWithTimeout(sim.wakeup, (double)(d->due - now) * 1.0E-9);
+            continue;
+        }
+        if ((sim.head = d->next) == NULL)
+            sim.tail = NULL;
+        d->state = SIM_COMPLETING;
+        epicsMutexUnlock(sim.lock);
+
+        simCopy(d);
+
+        epicsMutexMustLock(sim.lock);
+        d->status     = 0;
+        d->state      = SIM_IDLE;
+        d->inCallback = 1;
+        sim.n.nCompleted++;
+        epicsMutexUnlock(sim.lock);
+
+        /* may start the next transfer */
+        (*d->callback)(d->context);
+
+        epicsMutexMustLock(sim.lock);
+        d->inCallback = 0;
+        epicsMutexUnlock(sim.lock);
+    }
+}
+
+static void *
+simCreate(epicsDmaCallback_t callback, void *context)
+{
+    simDma *d;
+
+    if ((d = calloc(1, sizeof(*d))) == NULL)
+        return NULL;
+    d->callback = callback;
+    d->context  = context;
+    d->status   = -1;
+    return d;
+}
+
+static int
+simStatus(void *id)
+{
+    return ((simDma *)id)->status ? EIO : 0;
+}
+
+static int
+simStart(simDma *d, int toVme, void *pLocal, epicsUInt32 vmeAddr, int length)
+{
+    epicsMutexMustLock(sim.lock);
+    if (d->state != SIM_IDLE) {
+        sim.n.nBusy++;
+        epicsMutexUnlock(sim.lock);
+        return EBUSY;
+    }
+    d->status  = -1;
+    d->toVme   = toVme;
+    d->pLocal  = pLocal;
+    d->vmeAddr = vmeAddr;
+    d->length  = length;
+    sim.n.nStarted++;
+    if (sim.hangProb > 0. && rand() < sim.hangProb * ((double)RAND_MAX + 1.)) {
+        d->state = SIM_HUNG;
+        sim.n.nHung++;
+    } else {
+        d->state = SIM_QUEUED;
+        d->due   = epicsMonotonicGet() + sim.latency;
+        d->next  = NULL;
+        if (sim.tail)
+            sim.tail->next = d;
+        else
+            sim.head = d;
+        sim.tail = d;
+    }
+    epicsMutexUnlock(sim.lock);
+    epicsEventSignal(sim.wakeup);
+    return 0;
+}
+
+static int
+simToVme(void *id, epicsUInt32 vmeAddr, int adrsSpace, void *pLocal, int length, int dataWidth)
+{
+    return simStart(id, 1, pLocal, vmeAddr, length);
+}
+
+static int
+simFromVme(void *id, void *pLocal, epicsUInt32 vmeAddr, int adrsSpace, int length, int dataWidth)
+{
+    return simStart(id, 0, pLocal, vmeAddr, length);
+}
+
+static int
+simAbort(void *id)
+{
+    simDma  *d = id, **pp, *prev = NULL;
+    int     rval = 0;
+
+    epicsMutexMustLock(sim.lock);
+    switch (d->state) {
+    case SIM_QUEUED:
+        for (pp = &sim.head; *pp != d; pp = &(*pp)->next)
+            prev = *pp;
+        *pp = d->next;
+        if (sim.tail == d)
+            sim.tail = prev;
+        /* fall through */
+    case SIM_HUNG:
+        if (d->state == SIM_HUNG)
+            sim.n.nHungAborted++;
+        d->state  = SIM_IDLE;
+        d->status = -1;
+        sim.n.nAborted++;
+        break;
+    case SIM_COMPLETING:
+        sim.n.nAbortLate++;
+        rval = -1;
+        break;
+    default:
+        /* too late if the completion is on its way */
+        if (d->inCallback) {
+            sim.n.nAbortLate++;
+            rval = -1;
+        }
+        break;
+    }
+    epicsMutexUnlock(sim.lock);
+    return rval;
+}
+
+/* for PIO; the window doesn't wrap */
+static int
+simLocalAddr(epicsUInt32 vmeAddr, int adrsSpace, int length, volatile void **ppLocal)
+{
+    unsigned long off = vmeAddr % sim.memSize;
+
+    if (length < 0 || off + (unsigned long)length > sim.memSize)
+        return -1;
+    *ppLocal = sim.mem + off;
+    return 0;
+}
+
+static const epicsDmaBackend simBackend = {
+    simCreate, simStatus, simToVme, simFromVme, simAbort, NULL, simLocalAddr
+};
+
+int
+epicsDmaSimInstall(unsigned long memSize, double latency, double hangProb)
+{
+    if (sim.lock) {
+        errlogPrintf("epicsDmaSimInstall: already installed\n");
+        return -1;
+    }
+    if (memSize == 0)
+        memSize = 0x100000;
+    if ((sim.mem = calloc(1, memSize)) == NULL) {
+        errlogPrintf("epicsDmaSimInstall: no memory\n");
+        return -1;
+    }
+    sim.memSize  = memSize;
+    sim.latency  = latency > 0. ? (epicsUInt64)(latency * 1.0E9) : 0;
+    sim.hangProb = hangProb;
+    sim.lock     = epicsMutexMustCreate();
+    sim.wakeup   = epicsEventMustCreate(epicsEventEmpty);
+
+    epicsThreadMustCreate("epicsDmaSim",
+                          epicsThreadPriorityHigh,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          simThread, NULL);
+
+    return epicsDmaSetBackend(&simBackend);
+}
+
+void
+epicsDmaSimReport(int level)
+{
+    if (!sim.lock) {
+        printf("epicsDmaSim: not installed\n");
+        return;
+    }
+    epicsMutexMustLock(sim.lock);
+    printf("epicsDmaSim: %lu started, %lu completed, %lu hung, %lu aborted (%lu hung), "
+           "%lu too late to abort, %lu busy\n",
+           sim.n.nStarted, sim.n.nCompleted, sim.n.nHung, sim.n.nAborted, sim.n.nHungAborted,
+           sim.n.nAbortLate, sim.n.nBusy);
+    epicsMutexUnlock(sim.lock);
+}
+
+int
+epicsDmaSimGetCounts(epicsDmaSimCounts *pCounts)
+{
+    if (!sim.lock)
+        return -1;
+    epicsMutexMustLock(sim.lock);
+    *pCounts = sim.n;
+    epicsMutexUnlock(sim.lock);
+    return 0;
+}
+
+static const iocshArg epicsDmaSimInstallArg0 = { "memSize",  iocshArgInt };
+static const iocshArg epicsDmaSimInstallArg1 = { "latency",  iocshArgDouble };
+static const iocshArg epicsDmaSimInstallArg2 = { "hangProb", iocshArgDouble };
+static const iocshArg *epicsDmaSimInstallArgs[] = {
+    &epicsDmaSimInstallArg0,
+    &epicsDmaSimInstallArg1,
+    &epicsDmaSimInstallArg2,
+};
+static const iocshFuncDef epicsDmaSimInstallDef = {
+    "epicsDmaSimInstall", 3, epicsDmaSimInstallArgs
+};
+
+static void
+epicsDmaSimInstallCall(const iocshArgBuf *args)
+{
+    epicsDmaSimInstall((unsigned long)(args[0].ival < 0 ? 0 : args[0].ival),
+                       args[1].dval, args[2].dval);
+}
+
+static const iocshArg epicsDmaSimReportArg0 = { "level", iocshArgInt };
+static const iocshArg *epicsDmaSimReportArgs[] = {
+    &epicsDmaSimReportArg0,
+};
+static const iocshFuncDef epicsDmaSimReportDef = {
+    "epicsDmaSimReport", 1, epicsDmaSimReportArgs
+};
+
+static void
+epicsDmaSimReportCall(const iocshArgBuf *args)
+{
+    epicsDmaSimReport(args[0].ival);
+}
+
+static void
+epicsDmaSimRegistrar(void)
+{
+    iocshRegister(&epicsDmaSimInstallDef, epicsDmaSimInstallCall);
+    iocshRegister(&epicsDmaSimReportDef,  epicsDmaSimReportCall);
+}
+
+epicsExportRegistrar(epicsDmaSimRegistrar);
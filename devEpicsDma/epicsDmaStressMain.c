@@ -0,0 +1,172 @@
+/* Stress test of the timed epicsDma...AndWait routines on the simulated
+ * backend.
+ *
+ * Usage: epicsDmaStress [n_threads [n_iter [latency_s [hang_prob [timeout_s]]]]]
+ *
+ * All threads share one DMA handle. Each thread writes a pattern to
+ * its own region of the simulated VME memory, reads it back and
+ * verifies it. A fraction 'hang_prob' of the transfers never completes
+ * and must time out. The test fails if a call returns anything but
+ * success, ETIMEDOUT or EBUSY, if a call takes much longer than the
+ * timeout, if data read back is wrong, or if a completion was missed:
+ * there are more timeouts than transfers the simulation aborted, or a
+ * transfer was only found complete once its wait had timed out.
+ *
+ * Built as a host test (make runtests).
+ */
+#include <epicsDma.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define XFER_LEN    1024
+
+static epicsDmaId   dma;
+static unsigned     nIter   = 1000;
+static double       timeout = 0.01;
+static int          nCallbacks;
+static int          nOk, nTimeout, nBusy, nErr, nSlow, nBad;
+static epicsEventId done;
+
+static void
+countCallback(void *unused)
+{
+    epicsAtomicIncrIntT(&nCallbacks);
+}
+
+/* returns nonzero if the call took much longer than the timeout */
+static int
+check(int status, epicsUInt64 t0)
+{
+    if ((double)(epicsMonotonicGet() - t0) * 1.0E-9 > timeout + 1.0)
+        epicsAtomicIncrIntT(&nSlow);
+
+    switch (status) {
+    case 0:         epicsAtomicIncrIntT(&nOk);      return 0;
+    case ETIMEDOUT: epicsAtomicIncrIntT(&nTimeout); return -1;
+    case EBUSY:     epicsAtomicIncrIntT(&nBusy);    return -1;
+    default:        epicsAtomicIncrIntT(&nErr);     return -1;
+    }
+}
+
+static void
+stressThread(void *arg)
+{
+    unsigned        id    = (unsigned)(size_t)arg;
+    epicsUInt32     vme   = id * XFER_LEN;
+    epicsUInt32     *buf  = epicsDmaBufAlloc(XFER_LEN);
+    int             known = 0;  /* contents of our VME region are known */
+    epicsUInt32     pat   = 0;
+    epicsUInt64     t0;
+    unsigned        i, k;
+
+    if (buf == NULL) {
+        fprintf(stderr, "thread %u: no DMA buffer\n", id);
+        epicsAtomicIncrIntT(&nErr);
+        epicsEventSignal(done);
+        return;
+    }
+
+    for (i = 0; i < nIter; i++) {
+        for (k = 0; k < XFER_LEN / sizeof(*buf); k++)
+            buf[k] = (id << 24) ^ (i << 8) ^ k;
+        t0 = epicsMonotonicGet();
+        if (check(epicsDmaToVmeAndWaitTimeout(dma, vme, 0, buf, XFER_LEN, 4, timeout), t0) == 0) {
+            known = 1;
+            pat   = i;
+        } else {
+            /* may still be written if it couldn't be aborted */
+            known = 0;
+        }
+
+        memset(buf, 0, XFER_LEN);
+        t0 = epicsMonotonicGet();
+        if (check(epicsDmaFromVmeAndWaitTimeout(dma, buf, vme, 0, XFER_LEN, 4, timeout), t0) == 0 && known) {
+            for (k = 0; k < XFER_LEN / sizeof(*buf); k++) {
+                if (buf[k] != ((id << 24) ^ (pat << 8) ^ k)) {
+                    epicsAtomicIncrIntT(&nBad);
+                    break;
+                }
+            }
+        }
+    }
+
+    epicsDmaBufFree(buf);
+    epicsEventSignal(done);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned    nThreads = 4, i;
+    double      latency  = 0.0001, hang = 0.01;
+    char        name[20];
+    epicsUInt64 t0;
+    epicsDmaSimCounts c;
+    epicsDmaStats     s;
+
+    if (argc > 1) nThreads = strtoul(argv[1], 0, 0);
+    if (argc > 2) nIter    = strtoul(argv[2], 0, 0);
+    if (argc > 3) latency  = strtod(argv[3], 0);
+    if (argc > 4) hang     = strtod(argv[4], 0);
+    if (argc > 5) timeout  = strtod(argv[5], 0);
+
+    testPlan(8);
+
+    if (epicsDmaSimInstall(nThreads * XFER_LEN, latency, hang)
+     || epicsDmaBufPoolCreate(XFER_LEN, nThreads)
+     || (dma = epicsDmaCreate(countCallback, NULL)) == NULL) {
+        testAbort("setup failed");
+    }
+    done = epicsEventMustCreate(epicsEventEmpty);
+
+    t0 = epicsMonotonicGet();
+    for (i = 0; i < nThreads; i++) {
+        sprintf(name, "dmaStress%u", i);
+        epicsThreadMustCreate(name, epicsThreadPriorityMedium,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              stressThread, (void *)(size_t)i);
+    }
+    for (i = 0; i < nThreads; i++)
+        epicsEventMustWait(done);
+
+    testDiag("%u threads x %u iterations in %.3fs", nThreads, nIter,
+             (double)(epicsMonotonicGet() - t0) * 1.0E-9);
+
+    /* completions of transfers which were too late to abort */
+    epicsThreadSleep(0.1);
+    epicsDmaSimGetCounts(&c);
+    epicsDmaGetStats(dma, &s);
+
+    testDiag("ok %d (%lu after the timeout), timeout %d, busy %d, error %d, slow %d, "
+             "bad data %d, callbacks %d", nOk, s.nLate, nTimeout, nBusy, nErr, nSlow,
+             nBad, nCallbacks);
+    testDiag("simulation: %lu started, %lu completed, %lu hung, %lu aborted (%lu hung), "
+             "%lu too late to abort", c.nStarted, c.nCompleted, c.nHung, c.nAborted,
+             c.nHungAborted, c.nAbortLate);
+
+    testOk(nErr == 0, "no errors");
+    testOk(nBad == 0, "data read back correctly");
+    testOk(nSlow == 0, "no call took much longer than its timeout");
+    testOk(c.nHungAborted == c.nHung, "every hung transfer was aborted");
+    testOk((unsigned long)nTimeout == c.nAborted + c.nAbortLate,
+           "every timeout aborted a transfer (%d timeouts)", nTimeout);
+    /* a completion racing with the waiter's timeout is reported as a
+     * success after the timeout (nLate); that is timing dependent and
+     * only a diagnostic. Every completion must be accounted for,
+     * though: as a success or, if the abort came too late, a timeout.
+     */
+    testOk((unsigned long)nOk + c.nAbortLate == c.nCompleted,
+           "every completion reached its waiter (%lu after the timeout)", s.nLate);
+    testOk((unsigned long)nCallbacks == c.nCompleted, "every completion was delivered");
+    /* every successful wait was woken by a completion */
+    testOk(nCallbacks >= nOk, "a completion for every successful wait");
+
+    return testDone();
+}
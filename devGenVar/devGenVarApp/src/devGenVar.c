@@ -6,74 +6,74 @@
 #include <dbCommon.h>
 #include <dbBase.h>
 #include <errlog.h>
-#include <stdio.h> /* required by gpHash.h; epics 3.14.11 */
-#include <gpHash.h>
 #include <recGbl.h>
 #include <alarm.h>
 #include <epicsExport.h>
 #include <cantProceed.h>
 #include <iocsh.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 
-#include <epicsVersion.h>
 #include <epicsThread.h>
+#include <epicsMutex.h>
 
 #include "devGenVar.h"
-
-#if   ! defined(EPICS_VERSION)      \
-   || ! defined(EPICS_REVISION)     \
-   || ! defined(EPICS_MODIFICATION)
-#error "Unknown EPICS Version"
-#endif
-
-/* I Loooooove changing APIs. Really, I do... */
-#if      EPICS_VERSION > 3 \
-    || ( EPICS_VERSION == 3 && EPICS_REVISION > 14 ) \
-    || ( EPICS_VERSION == 3 && EPICS_REVISION == 14 && EPICS_MODIFICATION > 10 )
-#define HAVE_EPICS_31411
-#endif
+#include "devGenVarWaitSet.h"
+#include "devGenVarReg.h"
 
 #define REG_LD_TBL_SZ_DEFAULT 9
 
 #define FLG_NCONV    (1<<0)
 #define FLG_ASYNC    (1<<1)
 #define FLG_NPOST    (1<<2)
+#define FLG_RED_MSK  (7<<DEV_GEN_VAR_RED_SHIFT)
 #define FLG_NCSUP    (1<<31)
 
+#define FLG_RED(f)   (((f) & FLG_RED_MSK) >> DEV_GEN_VAR_RED_SHIFT)
+
 typedef struct DevGenVarPvtRec_ {
 	DevGenVar   gv;
 	epicsUInt32 flags;
 	dbAddr      dbaddr;
+	double     *tmp;     /* scratch buffer (waveform) */
 } DevGenVarPvtRec, *DevGenVarPvt;
 
 typedef struct RegHeadRec_ {
 	DevGenVar  gv;
 	int        n_entries;
+	unsigned   hash;
 	char       name[];
 } RegHeadRec, *RegHead;
 
-#ifdef HAVE_EPICS_31411
-struct gphPvt
-#else
-void
-#endif
-*devGenVarRegistry  = 0;
+/* EPICS' 'general-purpose' hash table has a fixed size and
+ * degrades to linear search when it is overloaded (which it
+ * is with 100k+ registered names). We use our own open-addressing
+ * table which doubles in size when it is 3/4 full.
+ */
+static RegHead     *regTbl     = 0;
+static unsigned     regLdTblSz = REG_LD_TBL_SZ_DEFAULT;
+static unsigned     regUsed    = 0;
+static epicsMutexId regMtx     = 0;
+
+/* DPVTs are carved out of big chunks (never freed) rather than
+ * calloc()ed one by one.
+ */
+#define PVT_CHUNK_SZ 1024
 
-static unsigned regLdTblSz = REG_LD_TBL_SZ_DEFAULT;
+static DevGenVarPvt pvtChunk   = 0;
+static unsigned     pvtAvail   = 0;
 
 static epicsThreadOnceId once_id = 0;
 
 static void init_once_fn(void *unused)
 {
-	if ( ! devGenVarRegistry ) {
-		gphInitPvt( &devGenVarRegistry, (1 << regLdTblSz) );
+	regMtx = epicsMutexMustCreate();
 
-		if ( ! devGenVarRegistry ) 
-			cantProceed("devGenVar: Unable to create hash table\n");
-	}
+	if ( ! (regTbl = calloc( 1 << regLdTblSz, sizeof(*regTbl) )) )
+		cantProceed("devGenVar: Unable to create hash table\n");
 }
 
 static void init_once()
@@ -81,14 +81,118 @@ static void init_once()
 	epicsThreadOnce( &once_id, init_once_fn, 0 );
 }
 
+/* FNV-1a */
+static unsigned
+regHash(const char *name)
+{
+unsigned h = 2166136261U;
+
+	while ( *name ) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Find slot holding 'name' or the empty slot where it should go;
+ * caller must hold regMtx.
+ */
+static RegHead *
+regSlot(RegHead *tbl, unsigned ldSz, const char *name, unsigned hash)
+{
+unsigned msk = (1 << ldSz) - 1;
+unsigned i   = hash & msk;
+
+	while ( tbl[i] ) {
+		if ( tbl[i]->hash == hash && ! strcmp( tbl[i]->name, name ) )
+			break;
+		i = (i + 1) & msk;
+	}
+	return &tbl[i];
+}
+
+/* caller must hold regMtx */
+static int
+regGrow(void)
+{
+RegHead  *n;
+unsigned  i;
+
+	if ( ! (n = calloc( 2 << regLdTblSz, sizeof(*n) )) )
+		return -1;
+
+	for ( i = 0; i < (1U << regLdTblSz); i++ ) {
+		if ( regTbl[i] )
+			*regSlot( n, regLdTblSz + 1, regTbl[i]->name, regTbl[i]->hash ) = regTbl[i];
+	}
+
+	free( regTbl );
+	regTbl = n;
+	regLdTblSz++;
+	return 0;
+}
+
+static DevGenVarPvt
+pvtAlloc(void)
+{
+DevGenVarPvt rval = 0;
+
+	init_once();
+
+	epicsMutexMustLock( regMtx );
+
+	if ( 0 == pvtAvail ) {
+		if ( (pvtChunk = calloc( PVT_CHUNK_SZ, sizeof(*pvtChunk) )) )
+			pvtAvail = PVT_CHUNK_SZ;
+	}
+
+	if ( pvtAvail ) {
+		rval = pvtChunk++;
+		pvtAvail--;
+	}
+
+	epicsMutexUnlock( regMtx );
+
+	return rval;
+}
+
+#ifndef DEV_GEN_VAR_NO_STATS
+static __inline__ epicsUInt64
+statsBeg(DevGenVar gv)
+{
+DevGenVarStats s = gv->stats;
+epicsUInt64    t;
+
+	if ( ! s )
+		return 0;
+
+	t = epicsMonotonicGet();
+	if ( s->tScan ) {
+		devGenVarStatsAdd( s, DEV_GEN_VAR_STAT_SCAN, t - s->tScan );
+		s->tScan = 0;
+	}
+	return t;
+}
+
+static __inline__ void
+statsEnd(DevGenVar gv, epicsUInt64 t)
+{
+	if ( gv->stats && t )
+		devGenVarStatsAdd( gv->stats, DEV_GEN_VAR_STAT_PROC, epicsMonotonicGet() - t );
+}
+#else
+#define statsBeg(gv)   ((epicsUInt64)0)
+#define statsEnd(gv,t) ((void)(t))
+#endif
+
 int
 devGenVarConfig(unsigned ldTblSz)
 {
-	if ( ldTblSz < 8 || ldTblSz > 16 ) {
-		errlogPrintf("devGenVarConfig(): ldTableSize argument must be in 8..16\n");
+	if ( ldTblSz < 8 || ldTblSz > 24 ) {
+		errlogPrintf("devGenVarConfig(): ldTableSize argument must be in 8..24\n");
 		return (1 << regLdTblSz);
 	}
-	if ( devGenVarRegistry ) {
+	if ( regTbl ) {
 		/* Already initialized; return current size */
 		return (1 << regLdTblSz);
 	}
@@ -107,6 +211,12 @@ int rval;
 	devGenVarLock( gv );
 		/* Test again in case it changed */
 		if ( gv->rec_p ) {
+#ifndef DEV_GEN_VAR_NO_STATS
+			if ( gv->stats && gv->stats->tPhase1 ) {
+				devGenVarStatsAdd( gv->stats, DEV_GEN_VAR_STAT_CPLT, epicsMonotonicGet() - gv->stats->tPhase1 );
+				gv->stats->tPhase1 = 0;
+			}
+#endif
 			dbScanLock( gv->rec_p );
 				/* process nests mutex lock */
 				gv->rec_p->rset->process(gv->rec_p);
@@ -141,7 +251,8 @@ long
 devGenVarRegister(const char *registryEntry, DevGenVar gv, int n_entries)
 {
 RegHead   h = 0;
-GPHENTRY *he;
+RegHead  *slot;
+long      rval = -1;
 
 	init_once();
 
@@ -158,16 +269,41 @@ GPHENTRY *he;
 
 	h->n_entries = n_entries;
 	h->gv        = gv;
+	h->hash      = regHash( registryEntry );
 	strcpy(h->name, registryEntry);
 
-	if ( ! (he = gphAdd(devGenVarRegistry, h->name, devGenVarRegistry)) ) {
-		errlogPrintf("devGenVarRegister: Unable to add entry '%s'\n", registryEntry);
-		free(h);
-		return -1;
+	epicsMutexMustLock( regMtx );
+
+	if ( 4 * (regUsed + 1) > 3 * (1U << regLdTblSz) && regGrow() ) {
+		errlogPrintf("devGenVarRegister: no memory for growing hash table\n");
+		goto bail;
 	}
 
-	he->userPvt = h;
-	return 0;
+	slot = regSlot( regTbl, regLdTblSz, h->name, h->hash );
+
+	if ( *slot ) {
+		errlogPrintf("devGenVarRegister: Unable to add entry '%s' (exists already)\n", registryEntry);
+		goto bail;
+	}
+
+	*slot = h;
+	h     = 0;
+	regUsed++;
+	rval  = 0;
+
+bail:
+	epicsMutexUnlock( regMtx );
+	free( h );
+	return rval;
+}
+
+void
+devGenVarPost(DevGenVar gv)
+{
+	if ( gv->evt )
+		epicsEventSignal( gv->evt );
+	if ( gv->wnode )
+		devGenVarWaitSetPost( gv->wnode );
 }
 
 long 
@@ -178,12 +314,22 @@ DevGenVar         gv = p->gv;
 unsigned short dbf_t = p->dbaddr.field_type;
 unsigned short dbr_t = gv->dbr_t;
 long          status;
+epicsUInt64       t0;
+
+double        red;
 
 	if ( dbf_t > DBF_DEVICE || dbr_t > DBR_ENUM )
 		return -1;
 
-	/* 'put' from outside data buffer to rec. field */
-	status = (* (dbFastPutConvertRoutine[dbr_t][dbf_t]))(gv->data_p, p->dbaddr.pfield, &p->dbaddr);
+	t0 = statsBeg( gv );
+
+	if ( FLG_RED( p->flags ) && devGenVarRingReduce( gv, FLG_RED( p->flags ), &red ) ) {
+		/* reduced samples from the ring */
+		status = (* (dbFastPutConvertRoutine[DBR_DOUBLE][dbf_t]))(&red, p->dbaddr.pfield, &p->dbaddr);
+	} else {
+		/* 'put' from outside data buffer to rec. field */
+		status = (* (dbFastPutConvertRoutine[dbr_t][dbf_t]))(gv->data_p, p->dbaddr.pfield, &p->dbaddr);
+	}
 
 	/* Use timestamp, status and severity */
 	if ( epicsTimeEventDeviceTime == prec->tse )
@@ -199,10 +345,12 @@ long          status;
 		status = 2;
 	}
 
-	if ( gv->evt && ! (p->flags & FLG_NPOST) ) {
-		epicsEventSignal( gv->evt );
+	if ( ! (p->flags & FLG_NPOST) ) {
+		devGenVarPost( gv );
 	}
 
+	statsEnd( gv, t0 );
+
 	return status;
 }
 
@@ -261,6 +409,7 @@ DevGenVar         gv = p->gv;
 unsigned short dbf_t = p->dbaddr.field_type;
 unsigned short dbr_t = gv->dbr_t;
 long     status;
+epicsUInt64   t0;
 
 	if ( dbf_t > DBF_DEVICE || dbr_t > DBR_ENUM )
 		return -1;
@@ -270,6 +419,8 @@ long     status;
 		return 0;
 	}
 
+	t0 = statsBeg( gv );
+
 	/* Is asynchronous processing requested ? */
 	if ( (p->flags & FLG_ASYNC) ) {
 		if ( gv->rec_p ) {
@@ -291,10 +442,20 @@ long     status;
 	gv->stat = prec->stat;
 	gv->sevr = prec->sevr;
 
-	if ( gv->evt && ! (p->flags & FLG_NPOST) ) {
-		epicsEventSignal( gv->evt );
+#ifndef DEV_GEN_VAR_NO_STATS
+	if ( gv->stats && prec->pact )
+		gv->stats->tPhase1 = epicsMonotonicGet();
+#endif
+
+	if ( gv->shm )
+		devGenVarShmUpdate( gv );
+
+	if ( ! (p->flags & FLG_NPOST) ) {
+		devGenVarPost( gv );
 	}
 
+	statsEnd( gv, t0 );
+
 	return status;
 }
 
@@ -332,6 +493,103 @@ int i;
 	return 0;
 }
 
+long
+devGenVarRingCreate(DevGenVar p, unsigned ldSize)
+{
+DevGenVarRing r;
+
+	if ( p->ring || ldSize < 1 || ldSize > 24 )
+		return -1;
+
+	if ( ! (r = calloc( 1, sizeof(*r) + (sizeof(r->buf[0]) << ldSize) )) ) {
+		errlogPrintf("devGenVarRingCreate: no memory\n");
+		return -1;
+	}
+
+	r->mask = (1 << ldSize) - 1;
+	p->ring = r;
+	return 0;
+}
+
+unsigned long
+devGenVarRingDrain(DevGenVar p, double *buf, unsigned long n)
+{
+DevGenVarRing r = p->ring;
+size_t        h,t;
+unsigned long rval = 0;
+
+	if ( ! r )
+		return 0;
+
+	h = epicsAtomicGetSizeT( &r->head );
+	/* don't read samples before we have seen the new head */
+	epicsAtomicReadMemoryBarrier();
+
+	t = r->tail;
+
+	/* skip what doesn't fit */
+	if ( h - t > n )
+		t = h - n;
+
+	while ( t != h ) {
+		buf[rval++] = r->buf[ t & r->mask ];
+		t++;
+	}
+
+	/* done reading the slots; release them to the producer */
+	epicsAtomicWriteMemoryBarrier();
+	epicsAtomicSetSizeT( &r->tail, h );
+
+	return rval;
+}
+
+unsigned long
+devGenVarRingReduce(DevGenVar p, int mode, double *presult)
+{
+DevGenVarRing r = p->ring;
+size_t        h,t;
+unsigned long n;
+double        v, acc;
+
+	if ( ! r )
+		return 0;
+
+	h = epicsAtomicGetSizeT( &r->head );
+	epicsAtomicReadMemoryBarrier();
+
+	t = r->tail;
+
+	if ( 0 == (n = h - t) )
+		return 0;
+
+	if ( DEV_GEN_VAR_RED_LAST == mode ) {
+		acc = r->buf[ (h - 1) & r->mask ];
+	} else {
+		acc = r->buf[ t & r->mask ];
+		if ( DEV_GEN_VAR_RED_RMS == mode )
+			acc *= acc;
+		for ( t++; t != h; t++ ) {
+			v = r->buf[ t & r->mask ];
+			switch ( mode ) {
+				case DEV_GEN_VAR_RED_MIN:  if ( v < acc ) acc = v; break;
+				case DEV_GEN_VAR_RED_MAX:  if ( v > acc ) acc = v; break;
+				case DEV_GEN_VAR_RED_RMS:  acc += v*v;             break;
+				default:                   acc += v;               break;
+			}
+		}
+		if ( DEV_GEN_VAR_RED_MEAN == mode )
+			acc /= (double)n;
+		else if ( DEV_GEN_VAR_RED_RMS == mode )
+			acc = sqrt( acc/(double)n );
+	}
+
+	epicsAtomicWriteMemoryBarrier();
+	epicsAtomicSetSizeT( &r->tail, h );
+
+	*presult = acc;
+
+	return n;
+}
 
 long
 devGenVarGetIointInfo(int delFrom, dbCommon *prec, IOSCANPVT *ppvt)
@@ -344,27 +602,328 @@ DevGenVar gv = ((DevGenVarPvt)prec->dpvt)->gv;
 	return 0;
 }
 
-static void *
+static RegHead
 findEntry(const char *name)
 {
-GPHENTRY *he;
+RegHead rval;
 
 	init_once();
 
 	if ( ! name )
 		return 0;
-	if ( ! (he = gphFind( devGenVarRegistry, name, devGenVarRegistry )) )
+
+	epicsMutexMustLock( regMtx );
+		rval = *regSlot( regTbl, regLdTblSz, name, regHash( name ) );
+	epicsMutexUnlock( regMtx );
+
+	return rval;
+}
+
+/* Call 'fn' for every registry entry matching 'name' (all if
+ * NULL or "*"). Returns number of matching entries.
+ */
+static int
+forEachEntry(const char *name, void (*fn)(RegHead, void*), void *arg)
+{
+RegHead  h;
+unsigned i;
+int      rval = 0;
+
+	init_once();
+
+	if ( name && *name && strcmp( name, "*" ) ) {
+		if ( (h = findEntry( name )) ) {
+			fn( h, arg );
+			rval = 1;
+		}
+		return rval;
+	}
+
+	/* fn must not register new entries */
+	epicsMutexMustLock( regMtx );
+	for ( i = 0; i < (1U << regLdTblSz); i++ ) {
+		if ( (h = regTbl[i]) ) {
+			fn( h, arg );
+			rval++;
+		}
+	}
+	epicsMutexUnlock( regMtx );
+
+	return rval;
+}
+
+typedef struct RegForEachArgRec_ {
+	DevGenVarRegFn fn;
+	void          *arg;
+} RegForEachArgRec;
+
+static void
+regForEachFn(RegHead h, void *arg)
+{
+RegForEachArgRec *a = arg;
+
+	a->fn( h->name, h->gv, h->n_entries, a->arg );
+}
+
+int
+devGenVarRegForEach(const char *name, DevGenVarRegFn fn, void *arg)
+{
+RegForEachArgRec a;
+
+	a.fn  = fn;
+	a.arg = arg;
+	return forEachEntry( name, regForEachFn, &a );
+}
+
+#ifndef DEV_GEN_VAR_NO_STATS
+
+void
+devGenVarStatsAdd(DevGenVarStats s, int metric, epicsUInt64 ns)
+{
+DevGenVarHist h = &s->hist[metric];
+unsigned      b;
+size_t        m;
+
+	/* b = number of significant bits */
+#if defined(__GNUC__)
+	b = ns ? 64 - __builtin_clzll( (unsigned long long)ns ) : 0;
+#else
+	for ( b = 0; b < 64 && (ns >> b); b++ )
+		/* nothing else to do */;
+#endif
+	if ( b >= DEV_GEN_VAR_HIST_BUCKETS )
+		b = DEV_GEN_VAR_HIST_BUCKETS - 1;
+
+	epicsAtomicIncrSizeT( &h->cnt[b] );
+
+	if ( ns > (size_t)-1 )
+		ns = (size_t)-1;
+
+	while ( (m = epicsAtomicGetSizeT( &h->max )) < ns ) {
+		if ( m == epicsAtomicCmpAndSwapSizeT( &h->max, m, (size_t)ns ) )
+			break;
+	}
+}
+
+static size_t
+histCount(DevGenVarHist h)
+{
+size_t   n = 0;
+unsigned b;
+
+	for ( b = 0; b < DEV_GEN_VAR_HIST_BUCKETS; b++ )
+		n += h->cnt[b];
+	return n;
+}
+
+double
+devGenVarHistQuantile(DevGenVarHist h, double q)
+{
+size_t   n, c, acc;
+unsigned b;
+double   lo, hi, rval;
+
+	if ( 0 == (n = histCount( h )) )
+		return 0.;
+
+	q  *= (double)n;
+	acc = 0;
+
+	for ( b = 0; b < DEV_GEN_VAR_HIST_BUCKETS - 1; b++ ) {
+		if ( (double)(acc + (c = h->cnt[b])) >= q )
+			break;
+		acc += c;
+	}
+
+	if ( 0 == (c = h->cnt[b]) )
+		return (double)h->max;
+
+	lo   = b ? ldexp( 1., b - 1 ) : 0.;
+	hi   = ldexp( 1., b );
+	rval = lo + (hi - lo) * (q - (double)acc) / (double)c;
+
+	return rval > (double)h->max ? (double)h->max : rval;
+}
+
+static DevGenVarStats
+statsAttach(DevGenVar gv)
+{
+DevGenVarStats s;
+
+	if ( (s = gv->stats) )
+		return s;
+
+	if ( ! (s = calloc( 1, sizeof(*s) )) )
 		return 0;
-	return he->userPvt;
+
+	/* struct must be initialized before anybody sees it */
+	epicsAtomicWriteMemoryBarrier();
+	if ( epicsAtomicCmpAndSwapPtrT( (EpicsAtomicPtrT*)&gv->stats, 0, s ) ) {
+		free( s );
+		s = gv->stats;
+	}
+	return s;
+}
+
+static void
+statsEnableFn(RegHead h, void *arg)
+{
+int i;
+
+	for ( i = 0; i < h->n_entries; i++ ) {
+		if ( statsAttach( h->gv + i ) )
+			++*(long*)arg;
+	}
 }
 
+long
+devGenVarStatsEnable(const char *name)
+{
+long n = 0;
+
+	if ( 0 == forEachEntry( name, statsEnableFn, &n ) ) {
+		errlogPrintf("devGenVarStatsEnable: no entry '%s' found\n", name ? name : "*");
+		return -1;
+	}
+	return n;
+}
+
+static void
+statsResetFn(RegHead h, void *arg)
+{
+int i;
+
+	for ( i = 0; i < h->n_entries; i++ ) {
+		if ( h->gv[i].stats )
+			memset( h->gv[i].stats->hist, 0, sizeof(h->gv[i].stats->hist) );
+	}
+}
+
+void
+devGenVarStatsReset(const char *name)
+{
+	forEachEntry( name, statsResetFn, 0 );
+}
+
+static const char *statNames[DEV_GEN_VAR_STAT_NUM] = {
+	"SCAN", "PROC", "CPLT", "LKWT", "LKHD"
+};
+
+static void
+reportFn(RegHead h, void *arg)
+{
+int            level = *(int*)arg;
+int            i, m;
+unsigned       b;
+DevGenVarStats s;
+DevGenVarHist  hst;
+
+	for ( i = 0; i < h->n_entries; i++ ) {
+		if ( ! (s = h->gv[i].stats) )
+			continue;
+		if ( level < 1 )
+			continue;
+		printf("%s[%i]:\n", h->name, i);
+		for ( m = 0; m < DEV_GEN_VAR_STAT_NUM; m++ ) {
+			hst = &s->hist[m];
+			if ( 0 == histCount( hst ) )
+				continue;
+			printf("  %s: n %8lu, p50 %10.3fus, p99 %10.3fus, max %10.3fus\n",
+				statNames[m],
+				(unsigned long)histCount( hst ),
+				devGenVarHistQuantile( hst, .50 )/1000.,
+				devGenVarHistQuantile( hst, .99 )/1000.,
+				(double)hst->max/1000.);
+			if ( level < 2 )
+				continue;
+			for ( b = 0; b < DEV_GEN_VAR_HIST_BUCKETS; b++ ) {
+				if ( hst->cnt[b] )
+					printf("        < %12.3fus: %lu\n", ldexp( 1., b )/1000., (unsigned long)hst->cnt[b]);
+			}
+		}
+	}
+}
+
+static void
+countFn(RegHead h, void *arg)
+{
+int i;
+
+	for ( i = 0; i < h->n_entries; i++ ) {
+		if ( h->gv[i].stats )
+			++*(int*)arg;
+	}
+}
+
+void
+devGenVarReport(const char *name, int level)
+{
+int n = 0;
+
+	forEachEntry( name, countFn, &n );
+	printf("devGenVar: statistics enabled for %i GenVar(s)\n", n);
+	if ( n )
+		forEachEntry( name, reportFn, &level );
+}
+
+#else
+
+void
+devGenVarStatsAdd(DevGenVarStats s, int metric, epicsUInt64 ns)
+{
+}
+
+double
+devGenVarHistQuantile(DevGenVarHist h, double q)
+{
+	return 0.;
+}
+
+long
+devGenVarStatsEnable(const char *name)
+{
+	errlogPrintf("devGenVarStatsEnable: statistics were compiled out (DEV_GEN_VAR_NO_STATS)\n");
+	return -1;
+}
+
+void
+devGenVarStatsReset(const char *name)
+{
+}
+
+void
+devGenVarReport(const char *name, int level)
+{
+	printf("devGenVar: statistics were compiled out (DEV_GEN_VAR_NO_STATS)\n");
+}
+
+#endif
+
+
+/* The ring is SPSC; more than one draining record needs 'mtx' to
+ * serialize them. Records initialize in a single thread.
+ */
+static long
+ringAddConsumer(dbCommon *prec, DevGenVar gv)
+{
+	if ( gv->ring->nCons && ! gv->mtx ) {
+		errlogPrintf("devGenVarInitRec(%s): sample ring already has a consumer and the GenVar has no mutex\n", prec->name);
+		return S_dev_NoInit;
+	}
+	gv->ring->nCons++;
+	return 0;
+}
 
 static long
-devGenVarInitRec(DBLINK *l, dbCommon *prec, int fldOff, int rawFldOff)
+devGenVarInitRec(DBLINK *l, dbCommon *prec, int fldOff, int rawFldOff, int isOut)
 {
 RegHead       h;
 DevGenVarPvt  p;
+DevGenVar    gv;
+epicsUInt32 flags;
 char        *nm = 0;
+char       nbuf[PVNAME_STRINGSZ + 16];
+size_t      len;
 long       rval = -1;
 dbFldDes *fldD;
 
@@ -386,26 +945,51 @@ dbFldDes *fldD;
 		goto bail;
 	}
 
-	if ( ! ( p = calloc( 1, sizeof(*p) ) ) ) {
-		errlogPrintf("devGenVarInitRec(%s): no memory for DPVT\n", prec->name);
-		rval = S_db_noMemory;
-		goto bail;
-	}
-
-	p->gv    = h->gv + l->value.vmeio.card;
+	gv    = h->gv + l->value.vmeio.card;
 
-	p->flags = (l->value.vmeio.signal & 0xffff);
+	flags = (l->value.vmeio.signal & 0xffff);
 
 	if ( rawFldOff >= 0 ) {
-		p->flags |= FLG_NCSUP;
-		if ( ( p->flags & FLG_NCONV ) ) {
+		flags |= FLG_NCSUP;
+		if ( ( flags & FLG_NCONV ) ) {
 			/* no conversion; use raw field */
 			fldOff = rawFldOff;
 		}
 	} else {
-		p->flags &= ~FLG_NCONV;
+		flags &= ~FLG_NCONV;
 	}
 
+	if ( FLG_RED( flags ) > DEV_GEN_VAR_RED_RMS ) {
+		errlogPrintf("devGenVarInitRec(%s): invalid reduction %u\n", prec->name, (unsigned)FLG_RED( flags ));
+		rval = S_db_badField;
+		goto bail;
+	}
+
+	if ( FLG_RED( flags ) ) {
+		if ( isOut ) {
+			/* the readback would drain the ring */
+			errlogPrintf("devGenVarInitRec(%s): reduction not supported by output records\n", prec->name);
+			rval = S_dev_NoInit;
+			goto bail;
+		}
+		if ( ! gv->ring ) {
+			errlogPrintf("devGenVarInitRec(%s): reduction requested but %s has no sample ring\n", prec->name, l->value.vmeio.parm);
+			rval = S_dev_NoInit;
+			goto bail;
+		}
+		if ( (rval = ringAddConsumer( prec, gv )) )
+			goto bail;
+	}
+
+	if ( ! ( p = pvtAlloc() ) ) {
+		errlogPrintf("devGenVarInitRec(%s): no memory for DPVT\n", prec->name);
+		rval = S_db_noMemory;
+		goto bail;
+	}
+
+	p->gv    = gv;
+	p->flags = flags;
+
 	prec->dpvt = p;
 
 	if ( fldOff >= prec->rdes->no_fields ) {
@@ -416,17 +1000,17 @@ dbFldDes *fldD;
 
 	fldD = fldOff < 0 ? prec->rdes->pvalFldDes : prec->rdes->papFldDes[fldOff];
 
-	if ( ! (nm = malloc(strlen(prec->name) + 1 + strlen(fldD->name) + 1 )) ) {
+	len = strlen(prec->name) + 1 + strlen(fldD->name) + 1;
+
+	if ( len > sizeof(nbuf) && ! (nm = malloc( len )) ) {
 		errlogPrintf("devGenVarInitRec(%s): no memory\n", prec->name);
 		rval = S_db_noMemory;
 		goto bail;
 	}
 
-	strcpy(nm, prec->name);
-	strcat(nm, ".");
-	strcat(nm, fldD->name);
+	sprintf( nm ? nm : nbuf, "%s.%s", prec->name, fldD->name );
 
-	if ( dbNameToAddr(nm, &p->dbaddr) ) {
+	if ( dbNameToAddr(nm ? nm : nbuf, &p->dbaddr) ) {
 		errlogPrintf("devGenVarInitRec(%s): dbNameToAddr() failure\n", prec->name);
 		rval = S_db_notFound;
 		goto bail;
@@ -446,7 +1030,7 @@ bail:
 long
 devGenVarInitInpRec(DBLINK *l, dbCommon *prec, int fldOff, int rawFldOff)
 {
-	return devGenVarInitRec(l, prec, fldOff, rawFldOff);
+	return devGenVarInitRec(l, prec, fldOff, rawFldOff, 0);
 }
 
 long 
@@ -454,9 +1038,10 @@ devGenVarInitOutRec(DBLINK *l, dbCommon *prec, int fldOff, int rawFldOff)
 {
 long         status;
 DevGenVarEvt evt;
+DevGenVarWaitNode wnode;
 DevGenVarPvt p;
 
-	status = devGenVarInitRec(l, prec, fldOff, rawFldOff);
+	status = devGenVarInitRec(l, prec, fldOff, rawFldOff, 1);
 	if ( status ) goto bail;
 
 	p = prec->dpvt;
@@ -478,10 +1063,13 @@ DevGenVarPvt p;
 		/* Ugly hack; we don't want to sent the event
 		 * here so we temporarily set it to NULL
 		 */
-		evt = p->gv->evt;
-		p->gv->evt = 0;
-		status     = devGenVarGet_nolock(prec);
-		p->gv->evt = evt;
+		evt   = p->gv->evt;
+		wnode = p->gv->wnode;
+		p->gv->evt   = 0;
+		p->gv->wnode = 0;
+		status       = devGenVarGet_nolock(prec);
+		p->gv->evt   = evt;
+		p->gv->wnode = wnode;
 
 		devGenVarUnlock( p->gv );
 
@@ -930,6 +1518,203 @@ static struct {
 };
 epicsExportAddress(dset, devMbboGenVar);
 
+#include <waveformRecord.h>
+
+static long init_rec_wf(waveformRecord *prec)
+{
+long status;
+
+	status = devGenVarInitInpRec( &prec->inp, (dbCommon*)prec, -1, -1 );
+
+	if ( status ) {
+		recGblRecordError(status, (void*)prec, "devGenVar(waveform): init_record failed\n");
+		return status;
+	}
+
+	if ( ! ((DevGenVarPvt)prec->dpvt)->gv->ring ) {
+		prec->pact = TRUE;
+		recGblRecordError(S_dev_NoInit, (void*)prec, "devGenVar(waveform): GenVar has no sample ring\n");
+		return S_dev_NoInit;
+	}
+
+	/* already counted if a reduction was (pointlessly) requested */
+	if ( ! FLG_RED( ((DevGenVarPvt)prec->dpvt)->flags )
+	     && (status = ringAddConsumer( (dbCommon*)prec, ((DevGenVarPvt)prec->dpvt)->gv )) ) {
+		prec->pact = TRUE;
+		recGblRecordError(status, (void*)prec, "devGenVar(waveform): init_record failed\n");
+		return status;
+	}
+
+	/* only 'double' buffer is directly filled; anything else is converted */
+	switch ( prec->ftvl ) {
+		case DBF_CHAR:  case DBF_UCHAR:
+		case DBF_SHORT: case DBF_USHORT:
+		case DBF_LONG:  case DBF_ULONG:
+		case DBF_FLOAT:
+			if ( ! (((DevGenVarPvt)prec->dpvt)->tmp = malloc( sizeof(double) * prec->nelm )) ) {
+				prec->pact = TRUE;
+				recGblRecordError(S_db_noMemory, (void*)prec, "devGenVar(waveform): no memory\n");
+				return S_db_noMemory;
+			}
+			break;
+
+		case DBF_DOUBLE:
+			break;
+
+		default:
+			prec->pact = TRUE;
+			recGblRecordError(S_db_badField, (void*)prec, "devGenVar(waveform): unsupported FTVL\n");
+			return S_db_badField;
+	}
+
+	return 0;
+}
+
+#define WF_CVT(type)                                                   \
+	do {                                                               \
+		type *d_ = (type*)prec->bptr;                                  \
+		for ( i = 0; i < n; i++ )                                      \
+			d_[i] = (type)tmp[i];                                      \
+	} while (0)
+
+static long read_wf(waveformRecord *prec)
+{
+DevGenVarPvt       p = prec->dpvt;
+DevGenVar         gv = p->gv;
+unsigned long   i, n;
+double        *tmp = DBF_DOUBLE == prec->ftvl ? prec->bptr : p->tmp;
+epicsUInt64     t0;
+
+	devGenVarLock( gv );
+
+		t0 = statsBeg( gv );
+
+		n = devGenVarRingDrain( gv, tmp, prec->nelm );
+
+		if ( epicsTimeEventDeviceTime == prec->tse )
+			prec->time = gv->ts;
+
+		recGblSetSevr( prec, gv->stat, gv->sevr );
+
+		if ( ! (p->flags & FLG_NPOST) )
+			devGenVarPost( gv );
+
+		statsEnd( gv, t0 );
+
+	devGenVarUnlock( gv );
+
+	switch ( prec->ftvl ) {
+		case DBF_CHAR:   WF_CVT(epicsInt8);    break;
+		case DBF_UCHAR:  WF_CVT(epicsUInt8);   break;
+		case DBF_SHORT:  WF_CVT(epicsInt16);   break;
+		case DBF_USHORT: WF_CVT(epicsUInt16);  break;
+		case DBF_LONG:   WF_CVT(epicsInt32);   break;
+		case DBF_ULONG:  WF_CVT(epicsUInt32);  break;
+		case DBF_FLOAT:  WF_CVT(epicsFloat32); break;
+		default:                               break;
+	}
+
+	prec->nord = n;
+	prec->udf  = FALSE;
+
+	return 0;
+}
+
+static struct {
+	long         number;
+	DEVSUPFUN    report;
+	DEVSUPFUN    init;
+	DEVSUPFUN    init_record;
+	DEVSUPFUN    get_ioint_info;
+	DEVSUPFUN    read_record;
+} devWfGenVar = {
+	5,
+	NULL,
+	NULL,
+	init_rec_wf,
+	devGenVarGetIointInfo,
+	read_wf
+};
+epicsExportAddress(dset, devWfGenVar);
+
+/* Statistics; INP is '#Cx Sy @name' where 'name' and 'x' select
+ * the GenVar and 'y' the metric (DEV_GEN_VAR_STAT_xxx; bits 0..2)
+ * and what to read (bits 4..5; 0: p50, 1: p99, 2: max in us, 3: count).
+ */
+#define STATS_Q_SHIFT 4
+
+static long report_stats(int level)
+{
+	devGenVarReport( 0, level );
+	return 0;
+}
+
+static long init_rec_stats(aiRecord *prec)
+{
+struct vmeio *io = &prec->inp.value.vmeio;
+RegHead        h;
+long      status = S_dev_noDeviceFound;
+
+	if ( VME_IO != prec->inp.type ) {
+		status = S_dev_badBus;
+	} else if ( (h = findEntry( io->parm )) && io->card < h->n_entries
+	            && (io->signal & 7) < DEV_GEN_VAR_STAT_NUM ) {
+#ifndef DEV_GEN_VAR_NO_STATS
+		if ( statsAttach( h->gv + io->card ) ) {
+			prec->dpvt = h->gv + io->card;
+			return 0;
+		}
+		status = S_db_noMemory;
+#else
+		status = S_dev_NoInit;
+#endif
+	}
+
+	prec->pact = TRUE;
+	recGblRecordError(status, (void*)prec, "devGenVar(ai stats): init_record failed\n");
+	return status;
+}
+
+static long read_stats(aiRecord *prec)
+{
+DevGenVar     gv = prec->dpvt;
+int            s = prec->inp.value.vmeio.signal;
+DevGenVarHist  h = &gv->stats->hist[ s & 7 ];
+
+	switch ( (s >> STATS_Q_SHIFT) & 3 ) {
+		case 0:  prec->val = devGenVarHistQuantile( h, .50 )/1000.; break;
+		case 1:  prec->val = devGenVarHistQuantile( h, .99 )/1000.; break;
+		case 2:  prec->val = (double)h->max/1000.;                  break;
+		default: prec->val = 0.;
+#ifndef DEV_GEN_VAR_NO_STATS
+		         prec->val = (double)histCount( h );
+#endif
+		         break;
+	}
+	prec->udf = FALSE;
+
+	return 2;
+}
+
+static struct {
+	long         number;
+	DEVSUPFUN    report;
+	DEVSUPFUN    init;
+	DEVSUPFUN    init_record;
+	DEVSUPFUN    get_ioint_info;
+	DEVSUPFUN    read_record;
+	DEVSUPFUN    special_linconv;
+} devAiGenVarStats = {
+	6,
+	report_stats,
+	NULL,
+	init_rec_stats,
+	NULL,
+	read_stats,
+	NULL
+};
+epicsExportAddress(dset, devAiGenVarStats);
+
 static const iocshArg devGenVarConfigArg1 = {
 	name:	"ld_table_size",
 	type:   iocshArgInt,
@@ -951,9 +1736,67 @@ devGenVarConfigCall(const iocshArgBuf *argBuf)
 	devGenVarConfig( argBuf->ival );
 }
 
+static const iocshArg devGenVarNameArg = {
+	name:	"name",
+	type:   iocshArgString,
+};
+
+static const iocshArg devGenVarLevelArg = {
+	name:	"level",
+	type:   iocshArgInt,
+};
+
+static const iocshArg *devGenVarStatsArgs[] = {
+	&devGenVarNameArg,
+};
+
+static const iocshArg *devGenVarReportArgs[] = {
+	&devGenVarNameArg,
+	&devGenVarLevelArg,
+};
+
+static iocshFuncDef devGenVarStatsEnableDef = {
+	name: "devGenVarStatsEnable",
+	nargs: sizeof(devGenVarStatsArgs)/sizeof(devGenVarStatsArgs[0]),
+	arg:   devGenVarStatsArgs,
+};
+
+static iocshFuncDef devGenVarStatsResetDef = {
+	name: "devGenVarStatsReset",
+	nargs: sizeof(devGenVarStatsArgs)/sizeof(devGenVarStatsArgs[0]),
+	arg:   devGenVarStatsArgs,
+};
+
+static iocshFuncDef devGenVarReportDef = {
+	name: "devGenVarReport",
+	nargs: sizeof(devGenVarReportArgs)/sizeof(devGenVarReportArgs[0]),
+	arg:   devGenVarReportArgs,
+};
+
+static void 
+devGenVarStatsEnableCall(const iocshArgBuf *argBuf)
+{
+	devGenVarStatsEnable( argBuf[0].sval );
+}
+
+static void 
+devGenVarStatsResetCall(const iocshArgBuf *argBuf)
+{
+	devGenVarStatsReset( argBuf[0].sval );
+}
+
+static void 
+devGenVarReportCall(const iocshArgBuf *argBuf)
+{
+	devGenVarReport( argBuf[0].sval, argBuf[1].ival );
+}
+
 static void devGenVarRegistrar(void)
 {
-	iocshRegister( &devGenVarConfigDef, devGenVarConfigCall );
+	iocshRegister( &devGenVarConfigDef,      devGenVarConfigCall      );
+	iocshRegister( &devGenVarStatsEnableDef, devGenVarStatsEnableCall );
+	iocshRegister( &devGenVarStatsResetDef,  devGenVarStatsResetCall  );
+	iocshRegister( &devGenVarReportDef,      devGenVarReportCall      );
 }
 
 epicsExportRegistrar(devGenVarRegistrar);
@@ -7,6 +7,7 @@
 #include <epicsMutex.h>
 #include <epicsEvent.h>
 #include <epicsTime.h>
+#include <epicsAtomic.h>
 #include <string.h>
 
 #ifdef __cplusplus
@@ -63,8 +64,17 @@ extern "C" {
  *                 write them during phase 1 and read them back during
  *                 phase 2).
  *
+ *       ring:     (optional) sample ring. Producers which update the
+ *                 variable faster than the record scans may push every
+ *                 sample into a ring (devGenVarRingCreate()) so that input
+ *                 records can reduce them (mean, min, max, ...) and
+ *                 waveform records can read the raw history.
+ *
  *  Private fields:
  *       rec_p:    Used internally, initialize to NULL and do not modify.
+ *       wnode:    Used internally, initialize to NULL and do not modify.
+ *       stats:    Used internally, initialize to NULL and do not modify.
+ *       shm:      Used internally, initialize to NULL and do not modify.
  *
  *  NOTE: Only the mandatory and optional fields that you intend to use 
  *        need to be filled by you. Unused optional fields may remain
@@ -78,6 +88,10 @@ extern "C" {
 typedef epicsEventId DevGenVarEvt; 
 typedef epicsMutexId DevGenVarMtx;
 
+typedef struct DevGenVarRingRec_ *DevGenVarRing;
+typedef struct DevGenVarWaitSetRec_ *DevGenVarWaitSet;
+typedef struct DevGenVarStatsRec_   *DevGenVarStats;
+
 typedef struct DevGenVarRec_ {
 	IOSCANPVT      *scan_p;        /* scanlist (may be NULL)            */
 	DevGenVarMtx    mtx;           /* protection (may be NULL)          */
@@ -87,6 +101,12 @@ typedef struct DevGenVarRec_ {
 	epicsTimeStamp  ts;            /* timestamp (if TSE == epicsTimeEventDeviceTime)     */
 	epicsEnum16     stat, sevr;    /* status + severity                                  */
 	dbCommon       *rec_p;         /* INTERNAL USE ONLY; DO NOT TOUCH                    */
+	DevGenVarRing   ring;          /* sample ring (may be NULL)                          */
+	struct DevGenVarWaitNodeRec_
+	               *wnode;         /* INTERNAL USE ONLY; DO NOT TOUCH                    */
+	DevGenVarStats  stats;         /* INTERNAL USE ONLY; DO NOT TOUCH                    */
+	struct DevGenVarShmSlotRec_
+	               *shm;           /* INTERNAL USE ONLY; DO NOT TOUCH                    */
 } DevGenVarRec, *DevGenVar;
 
 /*
@@ -131,7 +151,7 @@ devGenVarInitScanPvt( DevGenVar p, int n_entries );
  */
 #define DEV_GEN_VAR_INIT( scan, mutx, evnt, data, type ) \
 	{ scan_p: (scan), mtx: (mutx), evt: (evnt), data_p: (data), dbr_t: (type), \
-      ts: { 0, 0 }, stat: 0, sevr: 0, rec_p: 0 }
+      ts: { 0, 0 }, stat: 0, sevr: 0, rec_p: 0, ring: 0, wnode: 0, stats: 0, shm: 0 }
 
 /*
  * Register an array of DevGenVarRec's so that the device-support module
@@ -189,6 +209,58 @@ devGenVarWait(DevGenVar p, double timeout)
                epicsEventWaitWithTimeout( p->evt, timeout );
 }
 
+/*
+ * Wait sets
+ *
+ * A thread which serves many (output) GenVars may block on a wait
+ * set until any of its members is written (or read) by a record
+ * instead of dedicating one thread to each devGenVarWait().
+ *
+ * A member is 'posted' under the same conditions as its event
+ * (i.e., unless the record suppresses posting with flag bit (1<<2)).
+ * A GenVar does not need an event in order to be added to a wait
+ * set; if it does have one then the event is still posted.
+ *
+ * On linux the set is implemented with eventfd/epoll, a generic
+ * implementation (one event per set) is used elsewhere.
+ */
+
+/*
+ * Create an empty wait set.
+ *
+ * RETURNS: new wait set or NULL on failure.
+ */
+DevGenVarWaitSet
+devGenVarWaitSetCreate(void);
+
+/*
+ * Add a GenVar to a wait set. A GenVar may be a member of
+ * at most one set. Members must be added before the set is
+ * waited on for the first time (i.e., during initialization).
+ *
+ * RETURNS: zero on success, nonzero on failure.
+ */
+long
+devGenVarWaitSetAdd(DevGenVarWaitSet ws, DevGenVar p);
+
+/*
+ * Block (with timeout) until at least one member of the wait set
+ * has been posted. Up to 'max' posted members are stored in 'ready'
+ * and their 'posted' state is cleared. Members which are not returned
+ * (because 'ready' is too small) remain posted and are returned by
+ * the next call.
+ *
+ * Only a single thread may wait on a given set.
+ *
+ * Zero timeout returns immediately, negative timeout blocks
+ * indefinitely.
+ *
+ * RETURNS: number of GenVars stored in 'ready', zero on timeout or
+ *          a negative value on error.
+ */
+int
+devGenVarWaitSetWait(DevGenVarWaitSet ws, double timeout, DevGenVar *ready, int max);
+
 /*
  * Create a lock and attach to 'p'. Always use this routine - the
  * underlying implementation may change in the future!
@@ -220,12 +292,113 @@ devGenVarUnlockRaw(DevGenVarMtx mtx)
 }
 
 
+/*
+ * Latency statistics
+ *
+ * Statistics may be enabled for individual GenVars at run-time
+ * (devGenVarStatsEnable()). devGenVar then keeps log2-bucketed
+ * histograms (in ns, based on the monotonic clock) of
+ *
+ *   SCAN: devGenVarScan() -> record reads/writes the variable
+ *   PROC: time spent in device support reading/writing the variable
+ *   CPLT: asynchronous records: phase 1 -> devGenVarProcComplete()
+ *   LKWT: time spent waiting for the GenVar's mutex
+ *   LKHD: time the GenVar's mutex was held
+ *
+ * Note that the lock and scan times are recorded by the inline
+ * routines below, i.e., in your low-level code, too.
+ *
+ * All of this may be compiled out by defining DEV_GEN_VAR_NO_STATS
+ * (in your application *and* when building devGenVar).
+ */
+
+#define DEV_GEN_VAR_STAT_SCAN  0
+#define DEV_GEN_VAR_STAT_PROC  1
+#define DEV_GEN_VAR_STAT_CPLT  2
+#define DEV_GEN_VAR_STAT_LKWT  3
+#define DEV_GEN_VAR_STAT_LKHD  4
+#define DEV_GEN_VAR_STAT_NUM   5
+
+/* bucket 'i' counts values in [2^(i-1), 2^i) ns; the last one
+ * counts everything bigger, too.
+ */
+#define DEV_GEN_VAR_HIST_BUCKETS 32
+
+typedef struct DevGenVarHistRec_ {
+	size_t          cnt[DEV_GEN_VAR_HIST_BUCKETS];
+	size_t          max;           /* ns */
+} DevGenVarHistRec, *DevGenVarHist;
+
+typedef struct DevGenVarStatsRec_ {
+	epicsUInt64     tScan;         /* time of pending scan request (0: none) */
+	epicsUInt64     tLock;         /* time mutex was acquired                */
+	epicsUInt64     tPhase1;       /* time async. phase 1 was completed      */
+	unsigned        depth;         /* mutex nesting level                    */
+	DevGenVarHistRec hist[DEV_GEN_VAR_STAT_NUM];
+} DevGenVarStatsRec;
+
+/*
+ * Enable statistics for all GenVars registered under 'name'
+ * (all registered GenVars if 'name' is NULL or "*").
+ *
+ * RETURNS: number of GenVars for which statistics were enabled
+ *          or a negative value on error (no memory, not found or
+ *          statistics compiled out).
+ */
+long
+devGenVarStatsEnable(const char *name);
+
+/*
+ * Reset statistics of all GenVars registered under 'name'
+ * (all if 'name' is NULL or "*").
+ */
+void
+devGenVarStatsReset(const char *name);
+
+/*
+ * Print statistics of GenVars registered under 'name' (all if
+ * NULL or "*"). 'level' zero prints a summary, 1 the p50/p99/max
+ * of every GenVar and 2 the full histograms.
+ */
+void
+devGenVarReport(const char *name, int level);
+
+/*
+ * Add a sample (in ns) to histogram 'metric' (DEV_GEN_VAR_STAT_xxx).
+ */
+void
+devGenVarStatsAdd(DevGenVarStats s, int metric, epicsUInt64 ns);
+
+/*
+ * Estimate the 'q'-quantile (0..1) of a histogram in ns (linear
+ * interpolation within a bucket).
+ *
+ * RETURNS: estimate or zero if the histogram is empty.
+ */
+double
+devGenVarHistQuantile(DevGenVarHist h, double q);
+
 /* Serialize access to underlying variable.
  * ALWAYS use these inlines - implementation of lock may change!
  */
 static __inline__ void
 devGenVarLock(DevGenVar p)
 {
+#ifndef DEV_GEN_VAR_NO_STATS
+DevGenVarStats s = p->stats;
+epicsUInt64    t;
+
+	if ( s && p->mtx ) {
+		t = epicsMonotonicGet();
+		epicsMutexMustLock( p->mtx );
+		/* the lock may nest; only the outermost level counts */
+		if ( 0 == s->depth++ ) {
+			s->tLock = epicsMonotonicGet();
+			devGenVarStatsAdd( s, DEV_GEN_VAR_STAT_LKWT, s->tLock - t );
+		}
+		return;
+	}
+#endif
 	if ( p->mtx )
 		epicsMutexMustLock( p->mtx );
 }
@@ -233,27 +406,161 @@ devGenVarLock(DevGenVar p)
 static __inline__ void
 devGenVarUnlock(DevGenVar p)
 {
+#ifndef DEV_GEN_VAR_NO_STATS
+DevGenVarStats s = p->stats;
+
+	/* depth is zero if stats were enabled while we held the lock */
+	if ( s && p->mtx && s->depth && 0 == --s->depth ) {
+		devGenVarStatsAdd( s, DEV_GEN_VAR_STAT_LKHD, epicsMonotonicGet() - s->tLock );
+	}
+#endif
 	if ( p->mtx )
 		epicsMutexUnlock( p->mtx );
 }
 
+/*
+ * Copy the current value, timestamp, status and severity of 'p'
+ * to its shared-memory slot (see devGenVarShm.h). devGenVarScan()
+ * does this automatically; low-level code which updates a variable
+ * without requesting a scan may call this routine. Acquires the
+ * GenVar's mutex. No-op if 'p' is not exported.
+ */
+void
+devGenVarShmUpdate(DevGenVar p);
+
 static __inline__ void
 devGenVarScan(DevGenVar p)
 {
+	if ( p->shm )
+		devGenVarShmUpdate( p );
+#ifndef DEV_GEN_VAR_NO_STATS
+	/* keep the oldest pending request */
+	if ( p->stats && 0 == p->stats->tScan )
+		p->stats->tScan = epicsMonotonicGet();
+#endif
 	if ( p->scan_p )
 		scanIoRequest( *p->scan_p );
 }
 
-/* EPICS' 'general-purpose' hash table
- * is of limited size :-(
- * Call this *before* iocInit and *before*
- * the first call to devGenVarRegister() in
- * order to configure the table used by
- * devGenVar.
+/*
+ * Sample ring
+ *
+ * A lock-free single-producer/single-consumer ring of 'double' samples
+ * which may be attached to a DevGenVarRec. A producer which updates
+ * the variable at a high rate pushes every sample with
+ * devGenVarRingPush(). No mutex is needed on the producer side.
+ *
+ * Input records select a reduction in the 'signal' part of the INP
+ * link (bits 4..6, see DEV_GEN_VAR_RED_xxx below, i.e., S16 for 'last',
+ * S32 for 'mean' etc.). When such a record processes it drains the
+ * ring and stores the reduced value in the record. If the ring is empty
+ * then the record reads the variable (*data_p) as usual.
+ *
+ * Waveform records drain the ring in bulk (raw history).
+ *
+ * NOTE: The ring has exactly one consumer. If multiple records drain
+ *       the same ring then the DevGenVarRec must have a mutex ('mtx')
+ *       which serializes the consumers (the producer never takes it);
+ *       records are rejected at initialization otherwise. Output records
+ *       must not request a reduction (their readback would drain the ring).
+ */
+
+#define DEV_GEN_VAR_RED_NONE   0    /* no reduction; read *data_p          */
+#define DEV_GEN_VAR_RED_LAST   1    /* most recent sample                  */
+#define DEV_GEN_VAR_RED_MEAN   2    /* arithmetic mean                     */
+#define DEV_GEN_VAR_RED_MIN    3    /* minimum                             */
+#define DEV_GEN_VAR_RED_MAX    4    /* maximum                             */
+#define DEV_GEN_VAR_RED_RMS    5    /* root mean square                    */
+
+#define DEV_GEN_VAR_RED_SHIFT  4    /* position of reduction in link flags */
+
+#define DEV_GEN_VAR_CACHELINE 64
+
+typedef struct DevGenVarRingRec_ {
+	size_t          head;          /* next slot to fill; written by producer only */
+	char            pad0[DEV_GEN_VAR_CACHELINE - sizeof(size_t)];
+	size_t          tail;          /* next slot to drain; written by consumer only */
+	char            pad1[DEV_GEN_VAR_CACHELINE - sizeof(size_t)];
+	size_t          mask;          /* number of slots - 1                         */
+	unsigned long   ovrn;          /* samples dropped because the ring was full   */
+	unsigned        nCons;         /* number of draining records                  */
+	double          buf[];
+} DevGenVarRingRec;
+
+/*
+ * Create a ring of (1<<ldSize) samples and attach to 'p'.
+ * Must be called before iocInit (the records verify that the ring
+ * exists when they initialize).
+ *
+ * RETURNS: zero on success, nonzero on failure (no memory, 'p' already
+ *          has a ring or 'ldSize' out of range 1..24).
+ */
+long
+devGenVarRingCreate(DevGenVar p, unsigned ldSize);
+
+/*
+ * Push a sample (producer side). Never blocks; if the ring is full
+ * the sample is dropped and counted in the 'ovrn' member of the ring.
+ *
+ * RETURNS: zero on success, nonzero if the sample was dropped or
+ *          'p' has no ring.
+ */
+static __inline__ int
+devGenVarRingPush(DevGenVar p, double val)
+{
+DevGenVarRing r = p->ring;
+size_t        h;
+
+	if ( ! r )
+		return -1;
+
+	h = r->head;
+
+	if ( h - epicsAtomicGetSizeT( &r->tail ) > r->mask ) {
+		r->ovrn++;
+		return -1;
+	}
+
+	r->buf[ h & r->mask ] = val;
+
+	/* sample must be visible before the consumer sees the new head */
+	epicsAtomicWriteMemoryBarrier();
+	epicsAtomicSetSizeT( &r->head, h + 1 );
+
+	return 0;
+}
+
+/*
+ * Consumer side: drain all samples from the ring. Up to 'n' of the
+ * most recent samples are copied to 'buf' (oldest first); older
+ * ones are discarded. 'buf' may be NULL (and 'n' zero) to just
+ * flush the ring.
+ *
+ * RETURNS: number of samples copied to 'buf'.
+ */
+unsigned long
+devGenVarRingDrain(DevGenVar p, double *buf, unsigned long n);
+
+/*
+ * Consumer side: drain all samples from the ring and reduce them
+ * according to 'mode' (DEV_GEN_VAR_RED_xxx) into *presult.
+ *
+ * RETURNS: number of samples consumed (*presult is not modified if zero).
+ */
+unsigned long
+devGenVarRingReduce(DevGenVar p, int mode, double *presult);
+
+/* Configure the initial size of the hash table
+ * used by devGenVar for looking up registered
+ * names. The table grows automatically when it
+ * fills up; setting a big enough size avoids
+ * re-hashing while many names are registered.
+ * Call this *before* the first call to
+ * devGenVarRegister().
  * 
  * The 'ldTableSize' argument has to be
  * bigger or equal to 8 and less than or
- * equal to 16.
+ * equal to 24.
  *
  * RETURNS: Zero on success, nonzero
  * on failure (returning the current
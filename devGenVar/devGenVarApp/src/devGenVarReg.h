@@ -0,0 +1,27 @@
+#ifndef DEV_GEN_VAR_REG_H
+#define DEV_GEN_VAR_REG_H
+
+/* Private interface between devGenVar.c and modules which need to walk the registry */
+
+#include "devGenVar.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*DevGenVarRegFn)(const char *name, DevGenVar gv, int n_entries, void *arg);
+
+/* Call 'fn' for each registry entry matching 'name' (all if NULL or "*").
+ * When walking all entries the registry is locked, i.e., 'fn' must not
+ * register anything.
+ *
+ * RETURNS: number of entries visited.
+ */
+int
+devGenVarRegForEach(const char *name, DevGenVarRegFn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,392 @@
+/* Shared-memory export of GenVars */
+
+#include <dbAccess.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsAtomic.h>
+#include <epicsExport.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "devGenVar.h"
+#include "devGenVarShm.h"
+#include "devGenVarReg.h"
+
+#ifdef __linux__
+#define USE_POSIX_SHM
+#endif
+
+#ifdef USE_POSIX_SHM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN(x) (((x) + DEV_GEN_VAR_CACHELINE - 1) & ~(DEV_GEN_VAR_CACHELINE - 1))
+
+typedef struct ExpEntryRec_ {
+	const char *name;
+	DevGenVar   gv;
+	int         n_entries;
+} ExpEntryRec, *ExpEntry;
+
+typedef struct ExpCollectRec_ {
+	ExpEntry    ents;
+	unsigned    n, cap;
+	int         err;
+} ExpCollectRec;
+
+typedef struct ShmExportRec_ {
+	DevGenVar  *gvs;           /* GenVars linked to a slot */
+	unsigned    n_gvs;
+	double      period;
+	struct ShmExportRec_ *next;
+	char        name[1];       /* of the segment */
+} ShmExportRec, *ShmExport;
+
+/* Writers of a slot which do not share the GenVar's mutex (e.g.,
+ * devGenVarScan() from different threads, the refresh thread) are
+ * serialized by one of these (hashed by slot) around the sequence
+ * lock; epicsMutex inherits priority where the OS supports it.
+ */
+#define SLOT_LOCKS_LD 5
+
+static epicsMutexId      slotLocks[1 << SLOT_LOCKS_LD];
+static epicsMutexId      exportsLock;
+static ShmExport         exports;       /* segments exported by this IOC */
+static epicsThreadOnceId shmOnce = EPICS_THREAD_ONCE_INIT;
+
+static void
+shmOnceFn(void *unused)
+{
+unsigned i;
+
+	for ( i = 0; i < sizeof(slotLocks)/sizeof(slotLocks[0]); i++ )
+		slotLocks[i] = epicsMutexMustCreate();
+	exportsLock = epicsMutexMustCreate();
+}
+
+static epicsMutexId
+slotLock(DevGenVarShmSlot s)
+{
+	return slotLocks[ ((uintptr_t)s / sizeof(*s)) & ((1 << SLOT_LOCKS_LD) - 1) ];
+}
+
+/* 'tryOnly': give up (returning nonzero) if another writer holds the slot */
+static int
+shmUpdate(DevGenVar gv, int tryOnly)
+{
+DevGenVarShmSlot s = gv->shm;
+epicsMutexId     l;
+uint32_t         q;
+
+	if ( ! s )
+		return 0;
+
+	if ( gv->mtx )
+		epicsMutexMustLock( gv->mtx );
+
+	l = slotLock( s );
+	if ( tryOnly ) {
+		if ( epicsMutexLockOK != epicsMutexTryLock( l ) ) {
+			if ( gv->mtx )
+				epicsMutexUnlock( gv->mtx );
+			return -1;
+		}
+	} else {
+		epicsMutexMustLock( l );
+	}
+
+	q = s->seq;
+	epicsAtomicSetIntT( (int*)&s->seq, (int)(q + 1) );
+
+	/* odd sequence number must be visible before the data change */
+	epicsAtomicWriteMemoryBarrier();
+
+	s->stat         = gv->stat;
+	s->sevr         = gv->sevr;
+	s->secPastEpoch = gv->ts.secPastEpoch;
+	s->nsec         = gv->ts.nsec;
+	memcpy( &s->val, (const void*)gv->data_p, s->size );
+
+	epicsAtomicWriteMemoryBarrier();
+	epicsAtomicSetIntT( (int*)&s->seq, (int)(q + 2) );
+
+	epicsMutexUnlock( l );
+
+	if ( gv->mtx )
+		epicsMutexUnlock( gv->mtx );
+
+	return 0;
+}
+
+void
+devGenVarShmUpdate(DevGenVar gv)
+{
+	shmUpdate( gv, 0 );
+}
+
+static void
+collectFn(const char *name, DevGenVar gv, int n_entries, void *arg)
+{
+ExpCollectRec *c = arg;
+ExpEntry       n;
+
+	if ( strlen( name ) >= DEV_GEN_VAR_SHM_NAMELEN ) {
+		errlogPrintf("devGenVarShmExport: name '%s' too long; not exported\n", name);
+		return;
+	}
+
+	if ( c->n == c->cap ) {
+		if ( ! (n = realloc( c->ents, sizeof(*n) * (c->cap ? 2*c->cap : 64) )) ) {
+			c->err = 1;
+			return;
+		}
+		c->ents = n;
+		c->cap  = c->cap ? 2*c->cap : 64;
+	}
+
+	c->ents[c->n].name      = name;
+	c->ents[c->n].gv        = gv;
+	c->ents[c->n].n_entries = n_entries;
+	c->n++;
+}
+
+static int
+entCmp(const void *a, const void *b)
+{
+	return strcmp( ((const ExpEntryRec*)a)->name, ((const ExpEntryRec*)b)->name );
+}
+
+static void
+refreshThread(void *arg)
+{
+ShmExport e = arg;
+unsigned  i;
+
+	for ( ;; ) {
+		/* never wait for a (higher-priority) writer; the slot is
+		 * being updated anyways
+		 */
+		for ( i = 0; i < e->n_gvs; i++ )
+			shmUpdate( e->gvs[i], 1 );
+		epicsThreadSleep( e->period );
+	}
+}
+
+long
+devGenVarShmExport(const char *shmName, const char *regName, double period)
+{
+ExpCollectRec         c;
+ShmExport             e   = 0, x;
+DevGenVarShmHdrRec   *h   = 0;
+DevGenVarShmIndexRec *ix;
+DevGenVarShmSlot      sl;
+DevGenVar             gv;
+unsigned              i, j, nSlots, slot;
+size_t                idxOff, slotOff, size = 0;
+long                  vsz;
+int                   fd  = -1;
+long                  rval = -1;
+
+	memset( &c, 0, sizeof(c) );
+
+	if ( ! shmName || ! *shmName ) {
+		errlogPrintf("devGenVarShmExport: need a segment name (e.g., \"/myIoc\")\n");
+		return -1;
+	}
+
+	epicsThreadOnce( &shmOnce, shmOnceFn, 0 );
+
+	/* consumers may have mapped it; it must not shrink under them */
+	epicsMutexMustLock( exportsLock );
+	for ( x = exports; x; x = x->next ) {
+		if ( 0 == strcmp( x->name, shmName ) ) {
+			errlogPrintf("devGenVarShmExport: '%s' has been exported already\n", shmName);
+			goto bail;
+		}
+	}
+
+	devGenVarRegForEach( regName, collectFn, &c );
+
+	if ( c.err ) {
+		errlogPrintf("devGenVarShmExport: no memory\n");
+		goto bail;
+	}
+
+	if ( 0 == c.n ) {
+		errlogPrintf("devGenVarShmExport: nothing registered under '%s'\n", regName ? regName : "*");
+		goto bail;
+	}
+
+	/* index is binary-searched by consumers */
+	qsort( c.ents, c.n, sizeof(c.ents[0]), entCmp );
+
+	for ( i = nSlots = 0; i < c.n; i++ )
+		nSlots += c.ents[i].n_entries;
+
+	idxOff  = ALIGN( sizeof(*h) );
+	slotOff = ALIGN( idxOff + c.n * sizeof(*ix) );
+	size    = slotOff + nSlots * sizeof(*sl);
+
+	if ( ! (e = calloc( 1, sizeof(*e) + strlen( shmName ) )) || ! (e->gvs = malloc( nSlots * sizeof(e->gvs[0]) )) ) {
+		errlogPrintf("devGenVarShmExport: no memory\n");
+		goto bail;
+	}
+	e->period = period;
+	strcpy( e->name, shmName );
+
+	/* A segment left by an earlier run is replaced by a new one rather
+	 * than truncated; consumers still mapping the old one keep it (and
+	 * must re-open to see the new one).
+	 */
+	if ( shm_unlink( shmName ) && ENOENT != errno ) {
+		errlogPrintf("devGenVarShmExport: shm_unlink(%s) failed: %s\n", shmName, strerror(errno));
+		goto bail;
+	}
+
+	if ( (fd = shm_open( shmName, O_CREAT | O_EXCL | O_RDWR, 0644 )) < 0 ) {
+		errlogPrintf("devGenVarShmExport: shm_open(%s) failed: %s\n", shmName, strerror(errno));
+		goto bail;
+	}
+
+	if ( ftruncate( fd, size ) ) {
+		errlogPrintf("devGenVarShmExport: ftruncate() failed: %s\n", strerror(errno));
+		goto bail;
+	}
+
+	if ( MAP_FAILED == (h = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) ) {
+		h = 0;
+		errlogPrintf("devGenVarShmExport: mmap() failed: %s\n", strerror(errno));
+		goto bail;
+	}
+
+	ix = (DevGenVarShmIndexRec*)((char*)h + idxOff);
+	sl = (DevGenVarShmSlot)((char*)h + slotOff);
+
+	for ( i = slot = 0; i < c.n; i++ ) {
+		strcpy( ix[i].name, c.ents[i].name );
+		ix[i].first = slot;
+		ix[i].n     = c.ents[i].n_entries;
+
+		for ( j = 0; j < (unsigned)c.ents[i].n_entries; j++, slot++ ) {
+			gv = c.ents[i].gv + j;
+
+			sl[slot].dbr_t = gv->dbr_t;
+			if ( (vsz = dbValueSize( gv->dbr_t )) > DEV_GEN_VAR_SHM_VALLEN || vsz < 0 )
+				vsz = 0;
+			sl[slot].size  = vsz;
+
+			if ( gv->shm ) {
+				errlogPrintf("devGenVarShmExport: %s[%u] already exported elsewhere; slot not updated\n", c.ents[i].name, j);
+				continue;
+			}
+
+			/* slot must be initialized before devGenVarScan() may use it */
+			epicsAtomicWriteMemoryBarrier();
+			epicsAtomicSetPtrT( (EpicsAtomicPtrT*)&gv->shm, &sl[slot] );
+
+			devGenVarShmUpdate( gv );
+
+			e->gvs[e->n_gvs++] = gv;
+		}
+	}
+
+	h->nIndex   = c.n;
+	h->nSlots   = nSlots;
+	h->indexOff = idxOff;
+	h->slotOff  = slotOff;
+	h->slotSize = sizeof(*sl);
+	h->size     = size;
+	h->version  = DEV_GEN_VAR_SHM_VERSION;
+	/* consumers check the magic number last */
+	epicsAtomicWriteMemoryBarrier();
+	h->magic    = DEV_GEN_VAR_SHM_MAGIC;
+
+	if ( period > 0. ) {
+		epicsThreadMustCreate( "devGenVarShm",
+		                       epicsThreadPriorityLow,
+		                       epicsThreadGetStackSize( epicsThreadStackSmall ),
+		                       refreshThread,
+		                       e );
+	}
+
+	e->next = exports;
+	exports = e;
+	e = 0;
+
+	rval = 0;
+
+bail:
+	epicsMutexUnlock( exportsLock );
+	if ( fd >= 0 )
+		close( fd );
+	if ( rval && h )
+		munmap( h, size );
+	if ( e ) {
+		free( e->gvs );
+		free( e );
+	}
+	free( c.ents );
+	return rval;
+}
+
+#else
+
+void
+devGenVarShmUpdate(DevGenVar gv)
+{
+}
+
+long
+devGenVarShmExport(const char *shmName, const char *regName, double period)
+{
+	errlogPrintf("devGenVarShmExport: not supported on this OS\n");
+	return -1;
+}
+
+#endif
+
+static const iocshArg devGenVarShmExportArg0 = {
+	name:	"shm_name",
+	type:   iocshArgString,
+};
+
+static const iocshArg devGenVarShmExportArg1 = {
+	name:	"reg_name",
+	type:   iocshArgString,
+};
+
+static const iocshArg devGenVarShmExportArg2 = {
+	name:	"period",
+	type:   iocshArgDouble,
+};
+
+static const iocshArg *devGenVarShmExportArgs[] = {
+	&devGenVarShmExportArg0,
+	&devGenVarShmExportArg1,
+	&devGenVarShmExportArg2,
+};
+
+static iocshFuncDef devGenVarShmExportDef = {
+	name: "devGenVarShmExport",
+	nargs: sizeof(devGenVarShmExportArgs)/sizeof(devGenVarShmExportArgs[0]),
+	arg:   devGenVarShmExportArgs,
+};
+
+static void
+devGenVarShmExportCall(const iocshArgBuf *argBuf)
+{
+	devGenVarShmExport( argBuf[0].sval, argBuf[1].sval, argBuf[2].dval );
+}
+
+static void devGenVarShmRegistrar(void)
+{
+	iocshRegister( &devGenVarShmExportDef, devGenVarShmExportCall );
+}
+
+epicsExportRegistrar(devGenVarShmRegistrar);
@@ -0,0 +1,210 @@
+#ifndef DEV_GEN_VAR_SHM_H
+#define DEV_GEN_VAR_SHM_H
+
+/*
+ * Shared-memory export of GenVars.
+ *
+ * devGenVarShmExport() (called by the IOC) copies the value, timestamp,
+ * status and severity of registered GenVars into a POSIX shared-memory
+ * segment. Consumer processes on the same host map the segment and read
+ * the values without any system call (nor Channel Access).
+ *
+ * This header is also used by consumers; it depends on nothing but
+ * the C library. Consumers only use the 'static inline' routines
+ * at the end of this file.
+ *
+ * Layout of the segment:
+ *
+ *   DevGenVarShmHdrRec
+ *   DevGenVarShmIndexRec[nIndex]   (at 'indexOff'; sorted by name)
+ *   DevGenVarShmSlotRec[nSlots]    (at 'slotOff')
+ *
+ * Each registry name (devGenVarRegister()) has an index entry. The
+ * DevGenVarRec's registered under that name (the 'C' number of a
+ * record's link) occupy slots first .. first + n - 1.
+ *
+ * Every slot is protected by a sequence lock: the sequence number is
+ * odd while the slot is being written. A reader copies the slot and
+ * retries if the sequence number was odd or changed while copying.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEV_GEN_VAR_SHM_MAGIC    0x47565348   /* 'GVSH' */
+#define DEV_GEN_VAR_SHM_VERSION  1
+#define DEV_GEN_VAR_SHM_NAMELEN  56
+#define DEV_GEN_VAR_SHM_VALLEN   40           /* MAX_STRING_SIZE */
+
+typedef struct DevGenVarShmHdrRec_ {
+	uint32_t          magic;
+	uint32_t          version;
+	uint32_t          nIndex;        /* number of index entries            */
+	uint32_t          nSlots;        /* number of slots                    */
+	uint32_t          indexOff;      /* offset of index (bytes)            */
+	uint32_t          slotOff;       /* offset of first slot (bytes)       */
+	uint32_t          slotSize;      /* sizeof(DevGenVarShmSlotRec)        */
+	uint32_t          pad;
+	uint64_t          size;          /* total size of the segment          */
+} DevGenVarShmHdrRec;
+
+typedef struct DevGenVarShmIndexRec_ {
+	char              name[DEV_GEN_VAR_SHM_NAMELEN]; /* registry name      */
+	uint32_t          first;         /* first slot                         */
+	uint32_t          n;             /* number of slots                    */
+} DevGenVarShmIndexRec;
+
+typedef struct DevGenVarShmSlotRec_ {
+	volatile uint32_t seq;           /* sequence lock; odd: being written  */
+	uint16_t          dbr_t;         /* EPICS DBR type of 'val'            */
+	uint16_t          size;          /* bytes of 'val' which are used      */
+	uint16_t          stat;
+	uint16_t          sevr;
+	uint32_t          secPastEpoch;  /* timestamp (EPICS epoch)            */
+	uint32_t          nsec;
+	uint32_t          pad;
+	union {
+		char          str[DEV_GEN_VAR_SHM_VALLEN];
+		int8_t        i8;
+		uint8_t       u8;
+		int16_t       i16;
+		uint16_t      u16;
+		int32_t       i32;
+		uint32_t      u32;
+		float         f32;
+		double        f64;
+	}                 val;           /* raw copy of the GenVar's *data_p   */
+} DevGenVarShmSlotRec, *DevGenVarShmSlot;
+
+#ifdef __GNUC__
+
+/*
+ * Consistent copy of a slot. Spins while the slot is being written.
+ */
+static __inline__ void
+devGenVarShmRead(const DevGenVarShmSlotRec *s, DevGenVarShmSlotRec *copy)
+{
+uint32_t a, b;
+
+	do {
+		a = __atomic_load_n( &s->seq, __ATOMIC_ACQUIRE );
+		memcpy( copy, (const void*)s, sizeof(*copy) );
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+		b = __atomic_load_n( &s->seq, __ATOMIC_RELAXED );
+	} while ( (a & 1) || a != b );
+}
+
+/*
+ * Look up slot 'idx' of the GenVars registered under 'name'
+ * (binary search in the index).
+ *
+ * RETURNS: slot or NULL if not found.
+ */
+static __inline__ DevGenVarShmSlot
+devGenVarShmFind(const DevGenVarShmHdrRec *h, const char *name, unsigned idx)
+{
+const DevGenVarShmIndexRec *ix = (const DevGenVarShmIndexRec*)((const char*)h + h->indexOff);
+uint32_t                    lo = 0, hi = h->nIndex, m;
+int                         c;
+
+	while ( lo < hi ) {
+		m = (lo + hi) / 2;
+		if ( 0 == (c = strncmp( name, ix[m].name, DEV_GEN_VAR_SHM_NAMELEN )) ) {
+			if ( idx >= ix[m].n )
+				return 0;
+			return (DevGenVarShmSlot)((char*)h + h->slotOff) + ix[m].first + idx;
+		}
+		if ( c < 0 )
+			hi = m;
+		else
+			lo = m + 1;
+	}
+	return 0;
+}
+
+#endif /* __GNUC__ */
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Map an exported segment (read-only) into the consumer's address space.
+ * 'shmName' is the name passed to devGenVarShmExport().
+ *
+ * RETURNS: header of the mapped segment or NULL on failure.
+ */
+static __inline__ const DevGenVarShmHdrRec *
+devGenVarShmOpen(const char *shmName)
+{
+int                 fd;
+struct stat         st;
+void               *m;
+const DevGenVarShmHdrRec *h;
+
+	if ( (fd = shm_open( shmName, O_RDONLY, 0 )) < 0 )
+		return 0;
+
+	if ( fstat( fd, &st ) || st.st_size < (off_t)sizeof(*h) ) {
+		close( fd );
+		return 0;
+	}
+
+	m = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if ( MAP_FAILED == m )
+		return 0;
+
+	h = (const DevGenVarShmHdrRec*)m;
+
+	if (    DEV_GEN_VAR_SHM_MAGIC   != h->magic
+	     || DEV_GEN_VAR_SHM_VERSION != h->version
+	     || sizeof(DevGenVarShmSlotRec) != h->slotSize
+	     || (uint64_t)st.st_size < h->size ) {
+		munmap( m, st.st_size );
+		return 0;
+	}
+	return h;
+}
+
+static __inline__ void
+devGenVarShmClose(const DevGenVarShmHdrRec *h)
+{
+	munmap( (void*)h, h->size );
+}
+#endif /* __linux__ */
+
+/* IOC side (devGenVar) */
+
+/*
+ * Export all GenVars registered under 'regName' (all if NULL or "*")
+ * to the shared-memory segment 'shmName' (e.g., "/myIoc"). Call this
+ * after the GenVars have been registered. A GenVar can only be exported
+ * to a single segment, and a segment only once. An existing segment
+ * (from an earlier run) is unlinked and replaced.
+ *
+ * Slots are updated
+ *   - by devGenVarScan() and devGenVarShmUpdate() (low-level code),
+ *   - when an output record writes the GenVar,
+ *   - every 'period' seconds by a background thread (if 'period' > 0);
+ *     this covers GenVars which are updated without devGenVarScan().
+ *
+ * Only supported on linux.
+ *
+ * RETURNS: zero on success, nonzero on failure.
+ */
+long
+devGenVarShmExport(const char *shmName, const char *regName, double period);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
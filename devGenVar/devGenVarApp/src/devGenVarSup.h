@@ -160,6 +160,16 @@ devGenVarPut(dbCommon *prec);
 long
 devGenVarPut_nolock(dbCommon *prec);
 
+/*
+ * Notify low-level code that the record wrote/read the GenVar,
+ * i.e., post the GenVar's event and wait set (if present).
+ * devGenVarGet/Put do this already (unless the record suppresses
+ * posting) - use this only if your device support accesses the
+ * variable without these helpers.
+ */
+void
+devGenVarPost(DevGenVar p);
+
 /*
  * Generic get_ioint_info() routine that may be used by device-support
  * modules supporting other records than the ones that come with this
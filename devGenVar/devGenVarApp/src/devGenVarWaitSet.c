@@ -0,0 +1,250 @@
+/* Wait on multiple GenVars */
+
+#include <errlog.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "devGenVar.h"
+#include "devGenVarWaitSet.h"
+
+#ifdef __linux__
+#define USE_EVENTFD
+#endif
+
+#ifdef USE_EVENTFD
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+
+/* max. number of epoll events harvested by a single call */
+#define MAX_EVENTS 64
+#endif
+
+struct DevGenVarWaitNodeRec_ {
+	DevGenVarWaitSet  ws;
+	DevGenVar         gv;
+#ifdef USE_EVENTFD
+	int               fd;
+#else
+	int               pending;
+#endif
+};
+
+struct DevGenVarWaitSetRec_ {
+#ifdef USE_EVENTFD
+	int               epfd;
+#else
+	epicsEventId      evt;
+	int               cursor;      /* where to resume scanning (fairness) */
+#endif
+	DevGenVarWaitNode *nodes;
+	int               n_nodes;
+};
+
+DevGenVarWaitSet
+devGenVarWaitSetCreate(void)
+{
+DevGenVarWaitSet ws;
+
+	if ( ! (ws = calloc( 1, sizeof(*ws) )) ) {
+		errlogPrintf("devGenVarWaitSetCreate: no memory\n");
+		return 0;
+	}
+
+#ifdef USE_EVENTFD
+	if ( (ws->epfd = epoll_create1( EPOLL_CLOEXEC )) < 0 ) {
+		errlogPrintf("devGenVarWaitSetCreate: epoll_create1 failed (errno %i)\n", errno);
+		free( ws );
+		return 0;
+	}
+#else
+	if ( ! (ws->evt = epicsEventCreate( epicsEventEmpty )) ) {
+		errlogPrintf("devGenVarWaitSetCreate: unable to create event\n");
+		free( ws );
+		return 0;
+	}
+#endif
+
+	return ws;
+}
+
+long
+devGenVarWaitSetAdd(DevGenVarWaitSet ws, DevGenVar gv)
+{
+DevGenVarWaitNode node, *nodes;
+#ifdef USE_EVENTFD
+struct epoll_event ev;
+#endif
+
+	if ( ! ws || ! gv || gv->wnode )
+		return -1;
+
+	if ( ! (nodes = realloc( ws->nodes, sizeof(*nodes) * (ws->n_nodes + 1) )) ) {
+		errlogPrintf("devGenVarWaitSetAdd: no memory\n");
+		return -1;
+	}
+	ws->nodes = nodes;
+
+	if ( ! (node = calloc( 1, sizeof(*node) )) ) {
+		errlogPrintf("devGenVarWaitSetAdd: no memory\n");
+		return -1;
+	}
+
+	node->ws = ws;
+	node->gv = gv;
+
+#ifdef USE_EVENTFD
+	if ( (node->fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC )) < 0 ) {
+		errlogPrintf("devGenVarWaitSetAdd: eventfd failed (errno %i)\n", errno);
+		free( node );
+		return -1;
+	}
+
+	ev.events   = EPOLLIN;
+	ev.data.ptr = node;
+
+	if ( epoll_ctl( ws->epfd, EPOLL_CTL_ADD, node->fd, &ev ) ) {
+		errlogPrintf("devGenVarWaitSetAdd: epoll_ctl failed (errno %i)\n", errno);
+		close( node->fd );
+		free( node );
+		return -1;
+	}
+#endif
+
+	ws->nodes[ws->n_nodes++] = node;
+	gv->wnode = node;
+
+	return 0;
+}
+
+#ifdef USE_EVENTFD
+
+void
+devGenVarWaitSetPost(DevGenVarWaitNode node)
+{
+uint64_t one = 1;
+
+	/* may only fail if the counter would overflow -- in which
+	 * case the node is posted already anyways.
+	 */
+	if ( write( node->fd, &one, sizeof(one) ) < 0 ) {
+		/* nothing to do */
+	}
+}
+
+int
+devGenVarWaitSetWait(DevGenVarWaitSet ws, double timeout, DevGenVar *ready, int max)
+{
+struct epoll_event evs[MAX_EVENTS];
+DevGenVarWaitNode  node;
+uint64_t           cnt;
+int                tmo, n, i;
+
+	if ( max <= 0 )
+		return -1;
+
+	if ( max > MAX_EVENTS )
+		max = MAX_EVENTS;
+
+	if ( timeout < 0. )
+		tmo = -1;
+	else
+		/* round up so we don't spin on small timeouts */
+		tmo = (int)(timeout * 1000. + 0.999);
+
+	do {
+		n = epoll_wait( ws->epfd, evs, max, tmo );
+	} while ( n < 0 && EINTR == errno );
+
+	if ( n < 0 ) {
+		errlogPrintf("devGenVarWaitSetWait: epoll_wait failed (errno %i)\n", errno);
+		return -1;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		node = evs[i].data.ptr;
+		/* reset the eventfd counter */
+		if ( read( node->fd, &cnt, sizeof(cnt) ) < 0 ) {
+			/* EAGAIN: nothing pending (should not happen) */
+		}
+		ready[i] = node->gv;
+	}
+
+	return n;
+}
+
+#else
+
+void
+devGenVarWaitSetPost(DevGenVarWaitNode node)
+{
+	epicsAtomicSetIntT( &node->pending, 1 );
+	epicsEventSignal( node->ws->evt );
+}
+
+/* Harvest posted nodes, starting where the last scan left off */
+static int
+harvest(DevGenVarWaitSet ws, DevGenVar *ready, int max)
+{
+int i, j, n = 0;
+
+	for ( i = 0; i < ws->n_nodes && n < max; i++ ) {
+		j = ws->cursor + i;
+		if ( j >= ws->n_nodes )
+			j -= ws->n_nodes;
+		if ( epicsAtomicCmpAndSwapIntT( &ws->nodes[j]->pending, 1, 0 ) ) {
+			ready[n++] = ws->nodes[j]->gv;
+		}
+	}
+
+	if ( ws->n_nodes ) {
+		ws->cursor += i;
+		if ( ws->cursor >= ws->n_nodes )
+			ws->cursor -= ws->n_nodes;
+	}
+
+	return n;
+}
+
+int
+devGenVarWaitSetWait(DevGenVarWaitSet ws, double timeout, DevGenVar *ready, int max)
+{
+epicsUInt64       now, end = 0;
+epicsEventStatus  st;
+int               n;
+
+	if ( max <= 0 )
+		return -1;
+
+	if ( timeout > 0. )
+		end = epicsMonotonicGet() + (epicsUInt64)(timeout * 1.0E9);
+
+	while ( 0 == (n = harvest( ws, ready, max )) ) {
+		/* The event may be left over from nodes harvested by
+		 * a previous call; hence we have to loop.
+		 */
+		if ( timeout < 0. ) {
+			st = epicsEventWait( ws->evt );
+		} else if ( 0. == timeout ) {
+			break;
+		} else {
+			now = epicsMonotonicGet();
+			if ( now >= end )
+				break;
+			st = epicsEventWaitWithTimeout( ws->evt, (double)(end - now) * 1.0E-9 );
+		}
+		if ( epicsEventError == st ) {
+			errlogPrintf("devGenVarWaitSetWait: epicsEventWait failed\n");
+			return -1;
+		}
+	}
+
+	return n;
+}
+
+#endif
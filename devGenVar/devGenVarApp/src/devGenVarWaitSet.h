@@ -0,0 +1,22 @@
+#ifndef DEV_GEN_VAR_WAIT_SET_H
+#define DEV_GEN_VAR_WAIT_SET_H
+
+/* Private interface between devGenVar.c and the wait set implementation */
+
+#include "devGenVar.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DevGenVarWaitNodeRec_ *DevGenVarWaitNode;
+
+/* Mark node as posted and wake up the thread waiting on its set */
+void
+devGenVarWaitSetPost(DevGenVarWaitNode node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+/* Boot-time benchmark: measure init_record throughput of devGenVar.
+ *
+ * Usage: genVarBench <st-script> [n_records]
+ *
+ * Registers 'n_records' GenVars under individual names, writes a
+ * database with one longin record per GenVar to 'genVarBench.db'
+ * and runs the st-script (which must load the dbd, register the
+ * record/device/driver support and load 'genVarBench.db' but NOT
+ * call iocInit -- see 'stBench'). Then iocInit is timed.
+ */
+#include <epicsExit.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+#include <iocInit.h>
+#include <errlog.h>
+
+#include <devGenVar.h>
+
+#include <dbFldTypes.h>
+#include <epicsTypes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DB_NAME "genVarBench.db"
+
+int
+main(int argc, char **argv)
+{
+unsigned long  n = 100000, i;
+DevGenVarRec  *gvs;
+epicsInt32    *vals;
+char           nm[40];
+FILE          *f;
+epicsUInt64    then, now;
+double         dt;
+
+	if ( argc < 2 ) {
+		fprintf(stderr, "Usage: %s <st-script> [n_records]\n", argv[0]);
+		return 1;
+	}
+
+	if ( argc > 2 )
+		n = strtoul( argv[2], 0, 0 );
+
+	gvs  = (DevGenVarRec*)malloc( sizeof(*gvs) * n );
+	vals = (epicsInt32*)  calloc( n, sizeof(*vals) );
+	if ( ! gvs || ! vals ) {
+		fprintf(stderr, "No memory\n");
+		return 1;
+	}
+
+	devGenVarInit( gvs, n );
+
+	then = epicsMonotonicGet();
+	for ( i = 0; i < n; i++ ) {
+		gvs[i].data_p = &vals[i];
+		gvs[i].dbr_t  = DBR_LONG;
+		sprintf( nm, "bench%lu", i );
+		if ( devGenVarRegister( nm, &gvs[i], 1 ) ) {
+			errlogPrintf("devGenVarRegister(%s) failed\n", nm);
+			return 1;
+		}
+	}
+	now  = epicsMonotonicGet();
+	dt   = (double)(now - then) * 1.0E-9;
+	printf("devGenVarRegister: %lu names in %.3fs (%.0f/s)\n", n, dt, (double)n/dt);
+
+	if ( ! (f = fopen( DB_NAME, "w" )) ) {
+		perror("Unable to create " DB_NAME);
+		return 1;
+	}
+	for ( i = 0; i < n; i++ ) {
+		fprintf(f, "record(longin, \"bench:%lu\") {\n", i);
+		fprintf(f, "\tfield(DTYP, \"GenVar\")\n");
+		fprintf(f, "\tfield(INP,  \"#C0S0@bench%lu\")\n", i);
+		fprintf(f, "}\n");
+	}
+	fclose( f );
+
+	iocsh( argv[1] );
+
+	then = epicsMonotonicGet();
+	iocInit();
+	now  = epicsMonotonicGet();
+	dt   = (double)(now - then) * 1.0E-9;
+	printf("iocInit: %lu records in %.3fs (%.0f records/s, %.2fus/record)\n",
+	       n, dt, (double)n/dt, dt*1.0E6/(double)n);
+
+	epicsExit( 0 );
+	return( 0 );
+}
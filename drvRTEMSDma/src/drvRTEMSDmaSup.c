@@ -1,20 +1,37 @@
-/* DMA Routines using the RTEMS VME DMA API */
+/* DMA Routines using the RTEMS VMEDMA API */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <errno.h>
 #include <assert.h>
 
 #include <epicsEvent.h>
 #include <epicsInterrupt.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
 #include <errlog.h>
 #include <devLib.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include <rtems.h>
 
 #include <bsp.h>
 #include <bsp/VMEDMA.h>
 
 #include <drvRTEMSDmaSup.h>
 
+#ifdef HAVE_BSP_VME_TSI148
+#include <bsp/vmeTsi148.h>
+#include <bsp/vmeTsi148DMA.h>
+#endif
+#ifdef HAVE_BSP_VME_UNIVERSE
+#include <bsp/vmeUniverse.h>
+#include <bsp/vmeUniverseDMA.h>
+#endif
+
 #ifndef PCI_DRAM_OFFSET
 #define PCI_DRAM_OFFSET 0
 #endif
@@ -22,49 +39,144 @@
 
 #undef DEBUG
 
-#define DMACHANNEL       0
+/* Tsi148: 2, Universe: 1 -- we use what the BSP lets us attach to */
+#define MAX_CHANNELS     4
 
-static epicsEventId lock=0;
-static DMA_ID inProgress=0;
+#define REQ_IDLE         0
+#define REQ_QUEUED       1
+#define REQ_ACTIVE       2
+#define REQ_SETUP        3			/* (2D) descriptors being set up */
 
 typedef struct dmaRequest {
 		VOIDFUNCPTR				callback;
 		void					*closure;
 		uint32_t				status;
 		uint32_t				mode;
+		uint32_t				busMode;
+		struct dmaRequest		*next;		/* queue */
+		int						priority;
+		int						state;
+		int						channel;
+		void					*pLocal;
+		UINT32					vmeAddr;
+		int						length;
+		int						rows;		/* > 1: descriptor list */
+		epicsUInt64				tQueued;
+#ifdef HAVE_BSP_VMEDMA_LIST
+		DmaDescriptor			*descs;		/* one per row, linked */
+		int						nDescs;
+#endif
 } DmaRequest;
 
+#define MAX_ERR_STATUS	8
+
+/* written by the channel's owner (dispatch, ISR) only */
+typedef struct DmaChannelStats {
+		unsigned long			nXfers;
+		unsigned long			nErrors;
+		epicsUInt64				bytes;
+		epicsUInt64				sumWait;	/* ns queued */
+		epicsUInt64				maxWait;
+		epicsUInt64				sumActive;	/* ns programmed */
+		struct {
+			uint32_t			status;
+			unsigned long		count;
+		}						err[MAX_ERR_STATUS];	/* by raw status */
+		unsigned long			nErrOther;
+} DmaChannelStats;
+
+typedef struct DmaChannel {
+		DMA_ID					inProgress;
+		uint32_t				mode;		/* as programmed                 */
+		uint32_t				busMode;
+		int						valid;		/* 'mode', 'busMode' are programmed */
+		int						aborted;	/* waiting for the IRQ of an aborted transfer */
+		epicsUInt64				tStart;
+		DmaChannelStats			stats;
+} DmaChannel;
+
+static DmaChannel	channels[MAX_CHANNELS];
+static int			nChannels = 0;
+static DMA_ID		queue     = 0;			/* by priority, FIFO within */
+static epicsThreadOnceId initOnce = EPICS_THREAD_ONCE_INIT;
+static epicsUInt64	tInit;
+
+/* channels kept free for requests with priority > 0 */
+int rtemsVmeDmaReservedChannels = 0;
+
 #ifdef DEBUG
 unsigned long vmeDmaLastStatus=0;
 #endif
 
+static void dispatch(void);
+
+static void
+countError(DmaChannelStats *st, uint32_t status)
+{
+int i;
+
+	st->nErrors++;
+	for ( i = 0; i < MAX_ERR_STATUS; i++ ) {
+		if ( 0 == st->err[i].count )
+			st->err[i].status = status;
+		if ( st->err[i].status == status ) {
+			st->err[i].count++;
+			return;
+		}
+	}
+	st->nErrOther++;
+}
+
 static void
 rtemsVmeDmaIsr(void *p)
 {
-unsigned long s=BSP_VMEDmaStatus(DMACHANNEL);
+int				ch = (int)(uintptr_t)p;
+unsigned long	s  = BSP_VMEDmaStatus(ch);
+DMA_ID			req;
 
 #ifdef DEBUG
 	vmeDmaLastStatus=s;
 #endif
 
-	if (inProgress) {
-		inProgress->status = s;
-		if (inProgress->callback)
-				inProgress->callback(inProgress->closure);
-		inProgress = 0;
+	/* late interrupt of an aborted transfer; the channel has been
+	 * reused since (it was idle when checked)
+	 */
+	if ( BSP_VMEDMA_STATUS_BUSY == s )
+		return;
+
+	channels[ch].aborted = 0;
+
+	/* an aborted transfer has been detached already */
+	if ( (req = channels[ch].inProgress) ) {
+		channels[ch].stats.nXfers++;
+		channels[ch].stats.bytes     += req->length;
+		channels[ch].stats.sumActive += epicsMonotonicGet() - channels[ch].tStart;
+		if ( s )
+			countError( &channels[ch].stats, s );
+		channels[ch].inProgress = 0;
+		req->status = s;
+		req->state  = REQ_IDLE;
+		if (req->callback)
+				req->callback(req->closure);
 	}
-	/* yield the driver */
-	epicsEventSignal(lock);
+	/* give the channel to the next request */
+	dispatch();
 }
 
 static void
-rtemsVmeDmaInit(void)
+rtemsVmeDmaInit(void *unused)
 {
-	lock=epicsEventMustCreate( epicsEventFull );
-
-	/* connect and enable DMA interrupt */
-	assert( 0==BSP_VMEDmaInstallISR(DMACHANNEL,rtemsVmeDmaIsr,0) );
+int ch;
 
+	/* connect and enable DMA interrupts of all channels the BSP has */
+	for ( ch = 0; ch < MAX_CHANNELS; ch++ ) {
+		if ( BSP_VMEDmaInstallISR(ch, rtemsVmeDmaIsr, (void*)(uintptr_t)ch) )
+			break;
+	}
+	nChannels = ch;
+	tInit     = epicsMonotonicGet();
+	if ( 0 == nChannels )
+		errlogPrintf("drvRTEMSDma: no DMA channel available\n");
 }
 
 DMA_ID
@@ -73,15 +185,25 @@ rtemsVmeDmaCreate(VOIDFUNCPTR callback, void *context)
 DMA_ID	rval;
 
 	/* lazy init */
-	if (!lock) {
-		rtemsVmeDmaInit();
-	}
+	epicsThreadOnce( &initOnce, rtemsVmeDmaInit, 0 );
+
+	if ( 0 == nChannels || ! (rval = malloc(sizeof(*rval))) )
+		return 0;
 
-	rval = malloc(sizeof(*rval));
 	rval->callback = callback;
 	rval->closure = context;
 	rval->status  = -1;
 	rval->mode    = 0;
+	rval->busMode = 0;
+	rval->next    = 0;
+	rval->priority = 0;
+	rval->state   = REQ_IDLE;
+	rval->channel = -1;
+	rval->rows    = 1;
+#ifdef HAVE_BSP_VMEDMA_LIST
+	rval->descs   = 0;
+	rval->nDescs  = 0;
+#endif
 
 	return rval;
 }
@@ -98,6 +220,13 @@ rtemsVmeDmaStatusRaw(DMA_ID dmaId)
 	return dmaId->status;
 }
 
+STATUS
+rtemsVmeDmaSetPriority(DMA_ID dmaId, int priority)
+{
+	dmaId->priority = priority;
+	return 0;
+}
+
 static __inline__ uint32_t
 dw2mode(int w)
 {
@@ -154,34 +283,220 @@ dw2mode(int w)
  */
 uint32_t rtemsVmeDmaBusMode = BSP_VMEDMA_OPT_THROUGHPUT;
 
+/*
+ * Bus mode by address space and transfer size; entries of 0 (and
+ * address spaces not in the table) use rtemsVmeDmaBusMode. Filled
+ * from iocsh or by rtemsVmeDmaCalibrate() at boot.
+ */
+#define N_BUCKETS	4
+#define MAX_SPACES	8
+
+static const int bucketMax[N_BUCKETS] = { 256, 2048, 16384, 0x7fffffff };
+
+typedef struct BusModeTbl {
+	int			am;
+	uint32_t	busMode[N_BUCKETS];
+} BusModeTbl;
+
+static BusModeTbl	busModeTbl[MAX_SPACES];
+static int			nBusModeTbl = 0;
+
+static int
+sizeBucket(int length)
+{
+int b;
+	for ( b = 0; length > bucketMax[b]; b++ )
+		/* the last bucket takes anything */;
+	return b;
+}
+
+static BusModeTbl *
+findBusModeTbl(int am, int create)
+{
+int i;
+	for ( i = 0; i < nBusModeTbl; i++ ) {
+		if ( busModeTbl[i].am == am )
+			return &busModeTbl[i];
+	}
+	if ( ! create || MAX_SPACES == nBusModeTbl )
+		return 0;
+	busModeTbl[nBusModeTbl].am = am;
+	memset( busModeTbl[nBusModeTbl].busMode, 0, sizeof(busModeTbl[0].busMode) );
+	return &busModeTbl[nBusModeTbl++];
+}
+
+static uint32_t
+selectBusMode(int adrsSpace, int length)
+{
+BusModeTbl *t = findBusModeTbl( adrsSpace & 0x3f, 0 );
+uint32_t   m;
+
+	return ( t && (m = t->busMode[sizeBucket(length)]) ) ? m : rtemsVmeDmaBusMode;
+}
+
+/* use 'busMode' for transfers in 'adrsSpace' of up to 'maxLength'
+ * bytes (i.e., the size bucket containing 'maxLength'); 0 restores
+ * the default
+ */
+int
+rtemsVmeDmaBusModeSet(int adrsSpace, int maxLength, uint32_t busMode)
+{
+BusModeTbl *t;
+
+	if ( ! (t = findBusModeTbl( adrsSpace & 0x3f, 1 )) ) {
+		errlogPrintf("rtemsVmeDmaBusModeSet: too many address spaces\n");
+		return -1;
+	}
+	t->busMode[sizeBucket(maxLength)] = busMode;
+	return 0;
+}
+
+/* insert by priority; caller holds the interrupt lock */
+static void
+enqueue(DMA_ID req)
+{
+DMA_ID *pp;
+
+	for ( pp = &queue; *pp && (*pp)->priority >= req->priority; pp = &(*pp)->next )
+		/* nothing else to do */;
+	req->next  = *pp;
+	*pp        = req;
+	req->state = REQ_QUEUED;
+}
+
+/* the caller owns the channel */
 static STATUS
-rtemsVmeDmaStart(DMA_ID dmaId, uint32_t mode, void *pLocal, UINT32 vmeAddr, int length)
+program(int ch, DMA_ID req)
 {
 STATUS rval;
 
-	dmaId->status = -1;
+	if ( ! channels[ch].valid
+	     || req->mode    != channels[ch].mode
+	     || req->busMode != channels[ch].busMode ) {
+		channels[ch].valid = 0;
+		if ( (rval = BSP_VMEDmaSetup( ch, req->busMode, req->mode, 0 )) )
+			return rval;
+		channels[ch].mode    = req->mode;
+		channels[ch].busMode = req->busMode;
+		channels[ch].valid   = 1;
+	}
 
-	epicsEventWait( lock );
+#ifdef HAVE_BSP_VMEDMA_LIST
+	if ( req->rows > 1 )
+		return BSP_VMEDmaListStart( rtemsVmeDmaListController( ch ), req->descs[0] );
+#endif
 
-	if ( mode != dmaId->mode ) {
-		rval = BSP_VMEDmaSetup( DMACHANNEL, rtemsVmeDmaBusMode, mode, 0 );
-		if ( rval ) {
-			epicsEventSignal( lock );
-			return rval;
-		}
-		dmaId->mode = mode;
+	return BSP_VMEDmaStart( ch, LOCAL2PCI(req->pLocal), req->vmeAddr, req->length );
+}
+
+/* an aborted channel may be reused once its engine is idle;
+ * caller holds the interrupt lock
+ */
+static int
+channelIdle(int ch)
+{
+	if ( channels[ch].inProgress )
+		return 0;
+	if ( channels[ch].aborted ) {
+		if ( BSP_VMEDMA_STATUS_BUSY == BSP_VMEDmaStatus(ch) )
+			return 0;
+		channels[ch].aborted = 0;
 	}
+	return 1;
+}
+
+/*
+ * Start queued requests on idle channels; called from task
+ * and ISR context. The engine is programmed under the interrupt
+ * lock so that an abort can't detach the request in between.
+ */
+static void
+dispatch(void)
+{
+int      key, ch, idle, nIdle, reserved;
+DMA_ID   req;
+STATUS   rval;
 
-	inProgress = dmaId;
+	reserved = rtemsVmeDmaReservedChannels;
+	if ( reserved > nChannels - 1 )
+		reserved = nChannels - 1;
 
-	rval = BSP_VMEDmaStart( DMACHANNEL, LOCAL2PCI(pLocal), vmeAddr, length );
+	for (;;) {
+		key = epicsInterruptLock();
 
-	if ( rval ) {
-		inProgress = 0;
-		epicsEventSignal( lock );
+		if ( ! (req = queue) ) {
+			epicsInterruptUnlock(key);
+			return;
+		}
+
+		for ( ch = 0, idle = -1, nIdle = 0; ch < nChannels; ch++ ) {
+			if ( channelIdle(ch) ) {
+				if ( idle < 0 )
+					idle = ch;
+				nIdle++;
+			}
+		}
+
+		/* low-priority requests leave the reserved channels alone */
+		if ( idle < 0 || (req->priority <= 0 && nIdle <= reserved) ) {
+			epicsInterruptUnlock(key);
+			return;
+		}
+
+		queue        = req->next;
+		req->state   = REQ_ACTIVE;
+		req->channel = idle;
+		channels[idle].inProgress = req;
+		channels[idle].tStart     = epicsMonotonicGet();
+		channels[idle].stats.sumWait += channels[idle].tStart - req->tQueued;
+		if ( channels[idle].tStart - req->tQueued > channels[idle].stats.maxWait )
+			channels[idle].stats.maxWait = channels[idle].tStart - req->tQueued;
+
+		if ( (rval = program(idle, req)) ) {
+			/* fails like a transfer */
+			countError( &channels[idle].stats, (uint32_t)-1 );
+			channels[idle].inProgress = 0;
+			req->state  = REQ_IDLE;
+			req->status = -1;
+		}
+
+		epicsInterruptUnlock(key);
+
+		if ( rval && req->callback )
+			req->callback(req->closure);
 	}
-	
-	return rval;
+}
+
+/*
+ * Queue a request; it is started as soon as a channel is available
+ * (errors starting the engine are reported through the callback).
+ */
+static STATUS
+rtemsVmeDmaStart(DMA_ID dmaId, uint32_t mode, uint32_t busMode, void *pLocal, UINT32 vmeAddr, int length, int rows)
+{
+int         key;
+epicsUInt64 now = epicsMonotonicGet();
+
+	key = epicsInterruptLock();
+	/* 2D requests were claimed when their descriptors were set up */
+	if ( (rows > 1 ? REQ_SETUP : REQ_IDLE) != dmaId->state ) {
+		epicsInterruptUnlock(key);
+		return EBUSY;
+	}
+	dmaId->rows    = rows;
+	dmaId->status  = -1;
+	dmaId->mode    = mode;
+	dmaId->busMode = busMode;
+	dmaId->pLocal  = pLocal;
+	dmaId->vmeAddr = vmeAddr;
+	dmaId->length  = length;
+	dmaId->tQueued = now;
+	enqueue(dmaId);
+	epicsInterruptUnlock(key);
+
+	dispatch();
+
+	return 0;
 }
 
 STATUS
@@ -190,7 +505,7 @@ rtemsVmeDmaFromVme(DMA_ID dmaId, void *pLocal, UINT32 vmeAddr,
 {
 uint32_t mode = adrsSpace | dw2mode( dataWidth );
 
-	return rtemsVmeDmaStart(dmaId, mode, pLocal, vmeAddr, length);
+	return rtemsVmeDmaStart(dmaId, mode, selectBusMode(adrsSpace, length), pLocal, vmeAddr, length, 1);
 
 }
 
@@ -200,5 +515,545 @@ rtemsVmeDmaToVme(DMA_ID dmaId, UINT32 vmeAddr, int adrsSpace,
 {
 uint32_t mode = adrsSpace | dw2mode( dataWidth ) | BSP_VMEDMA_MODE_PCI2VME;
 
-	return rtemsVmeDmaStart(dmaId, mode, pLocal, vmeAddr, length);
+	return rtemsVmeDmaStart(dmaId, mode, selectBusMode(adrsSpace, length), pLocal, vmeAddr, length, 1);
+}
+
+#ifdef HAVE_BSP_VMEDMA_LIST
+/*
+ * The descriptor list class and the address BSP_VMEDmaListStart()
+ * wants for a channel depend on the bridge (which a BSP such as
+ * beatnik only knows at run time). rtemsVmeDmaListSelect() sets both
+ * for a bridge the BSP has; the first transfer picks the bridge found
+ * unless it has been selected (or set by hand) before. Without them
+ * 2D transfers are declined.
+ */
+VMEDmaListClass rtemsVmeDmaListClass = 0;
+volatile void *(*rtemsVmeDmaListController)(int channel) = 0;
+static int      listProbed = 0;
+
+#ifdef HAVE_BSP_VME_TSI148
+/* the Tsi148 wants its register base with the channel in the low bits */
+static volatile void *
+tsi148ListController(int channel)
+{
+	return (volatile void*)( (uintptr_t)vmeTsi148RegBase | channel );
+}
+#endif
+
+#ifdef HAVE_BSP_VME_UNIVERSE
+/* the Universe has a single channel */
+static volatile void *
+universeListController(int channel)
+{
+	return vmeUniverse0BaseAddr;
+}
+#endif
+
+int
+rtemsVmeDmaListSelect(const char *bridge)
+{
+int any = ( ! bridge || ! *bridge || ! strcmp( bridge, "auto" ) );
+
+	if ( bridge && ! strcmp( bridge, "none" ) ) {
+		rtemsVmeDmaListClass      = 0;
+		rtemsVmeDmaListController = 0;
+		return 0;
+	}
+#ifdef HAVE_BSP_VME_TSI148
+	if ( (any || ! strcmp( bridge, "tsi148" )) && vmeTsi148RegBase ) {
+		rtemsVmeDmaListClass      = vmeTsi148DmaListClass;
+		rtemsVmeDmaListController = tsi148ListController;
+		return 0;
+	}
+#endif
+#ifdef HAVE_BSP_VME_UNIVERSE
+	if ( (any || ! strcmp( bridge, "universe" )) && vmeUniverse0BaseAddr ) {
+		rtemsVmeDmaListClass      = vmeUniverseDmaListClass;
+		rtemsVmeDmaListController = universeListController;
+		return 0;
+	}
+#endif
+	errlogPrintf("rtemsVmeDmaListSelect: no %s bridge with descriptor lists\n",
+		any ? "supported" : bridge);
+	return -1;
 }
+
+/* a list of 'rows' descriptors; the request must be ours (REQ_SETUP) */
+static int
+listAlloc(DMA_ID req, int rows)
+{
+DmaDescriptor d;
+int           i;
+
+	/* usually the same geometry over and over */
+	if ( req->nDescs == rows )
+		return 0;
+
+	if ( req->descs ) {
+		BSP_VMEDmaListDestroy( req->descs[0] );
+		free( req->descs );
+		req->descs  = 0;
+		req->nDescs = 0;
+	}
+
+	if ( ! (req->descs = malloc( rows * sizeof(req->descs[0]) )) )
+		return -1;
+
+	for ( i = 0; i < rows; i++ ) {
+		if ( ! (d = BSP_VMEDmaListDescriptorNew( rtemsVmeDmaListClass )) ) {
+			if ( i > 0 )
+				BSP_VMEDmaListDestroy( req->descs[0] );
+			free( req->descs );
+			req->descs = 0;
+			return -1;
+		}
+		if ( i > 0 )
+			BSP_VMEDmaListDescriptorEnq( req->descs[i-1], d );
+		req->descs[i] = d;
+	}
+	req->nDescs = rows;
+	return 0;
+}
+#else
+int
+rtemsVmeDmaListSelect(const char *bridge)
+{
+	errlogPrintf("rtemsVmeDmaListSelect: the BSP has no descriptor lists\n");
+	return -1;
+}
+#endif
+
+/*
+ * One descriptor per row; the engine walks the list and interrupts
+ * once at the end.
+ */
+STATUS
+rtemsVmeDmaFromVme2D(DMA_ID dmaId, void *pLocal, int localStride, UINT32 vmeAddr,
+	int vmeStride, int adrsSpace, int rowBytes, int rows, int dataWidth)
+{
+#ifdef HAVE_BSP_VMEDMA_LIST
+uint32_t mode = adrsSpace | dw2mode( dataWidth );
+int      key, i;
+STATUS   rval;
+
+	if ( ! rtemsVmeDmaListClass || ! rtemsVmeDmaListController ) {
+		if ( ! listProbed ) {
+			listProbed = 1;
+			rtemsVmeDmaListSelect( 0 );
+		}
+		if ( ! rtemsVmeDmaListClass || ! rtemsVmeDmaListController )
+			return ENOTSUP;
+	}
+
+	if ( rows < 2 )
+		return rtemsVmeDmaFromVme(dmaId, pLocal, vmeAddr, adrsSpace, rowBytes, dataWidth);
+
+	/* the descriptors may only be touched while the request is idle */
+	key = epicsInterruptLock();
+	if ( REQ_IDLE != dmaId->state ) {
+		epicsInterruptUnlock(key);
+		return EBUSY;
+	}
+	dmaId->state = REQ_SETUP;
+	epicsInterruptUnlock(key);
+
+	rval = listAlloc( dmaId, rows ) ? ENOMEM : 0;
+
+	for ( i = 0; 0 == rval && i < rows; i++ ) {
+		if ( BSP_VMEDmaListDescriptorSetup( dmaId->descs[i], BSP_VMEDMA_MSK_ALL, mode,
+		                                    LOCAL2PCI( (char*)pLocal + i * localStride ),
+		                                    vmeAddr + i * vmeStride, rowBytes ) )
+			rval = EINVAL;
+	}
+
+	if ( rval ) {
+		dmaId->state = REQ_IDLE;
+		return rval;
+	}
+
+	return rtemsVmeDmaStart(dmaId, mode, selectBusMode(adrsSpace, rowBytes * rows), pLocal,
+	                        vmeAddr, rowBytes * rows, rows);
+#else
+	/* the BSP has no descriptor lists; epicsDma goes row by row */
+	return ENOTSUP;
+#endif
+}
+
+/*
+ * The VMEDMA API has no way to stop the engine. While it is busy the
+ * request stays attached (its buffer and descriptors are still in use)
+ * and -1 is returned; the callback is called when the transfer does
+ * terminate. Otherwise (queued, or terminated with the interrupt not
+ * yet handled) the request is detached -- its callback won't be called
+ * -- and the channel is re-programmed before it is used again; it is
+ * left alone until the engine is seen idle so that a late completion
+ * can't be mistaken for that of the next transfer.
+ */
+STATUS
+rtemsVmeDmaAbort(DMA_ID dmaId)
+{
+int    key, ch;
+DMA_ID *pp;
+
+	key = epicsInterruptLock();
+	switch ( dmaId->state ) {
+		case REQ_QUEUED:
+			for ( pp = &queue; *pp != dmaId; pp = &(*pp)->next )
+				/* nothing else to do */;
+			*pp = dmaId->next;
+			break;
+
+		case REQ_ACTIVE:
+			ch = dmaId->channel;
+			if ( BSP_VMEDMA_STATUS_BUSY == BSP_VMEDmaStatus(ch) ) {
+				epicsInterruptUnlock(key);
+				return -1;
+			}
+			channels[ch].aborted    = 1;
+			channels[ch].inProgress = 0;
+			channels[ch].valid      = 0;
+			break;
+
+		default:
+			/* not started or completed already */
+			epicsInterruptUnlock(key);
+			return 0;
+	}
+	dmaId->state  = REQ_IDLE;
+	dmaId->status = -1;
+	epicsInterruptUnlock(key);
+
+	dispatch();
+
+	return 0;
+}
+
+/*
+ * Calibration: time reads of each size bucket from a slave in every
+ * bus mode and keep the fastest one for the address space. Small
+ * buckets are dominated by latency, large ones by throughput.
+ */
+#define CAL_REPEAT	10
+#define CAL_TIMEOUT	1.0
+#define CAL_ALIGN	32			/* cache line */
+
+static const struct {
+	uint32_t	busMode;
+	const char	*name;
+} calModes[] = {
+	{ BSP_VMEDMA_OPT_LOWLATENCY, "lowLatency" },
+	{ BSP_VMEDMA_OPT_THROUGHPUT, "throughput" },
+	{ BSP_VMEDMA_OPT_SHAREDBUS,  "sharedBus"  },
+	{ BSP_VMEDMA_OPT_DEFAULT,    "default"    },
+};
+#define N_CAL_MODES	(sizeof(calModes)/sizeof(calModes[0]))
+
+static void
+calCallback(void *event)
+{
+	epicsEventSignal( (epicsEventId)event );
+}
+
+static int
+calXfer(DMA_ID req, epicsEventId ev, uint32_t mode, uint32_t busMode,
+	void *buf, UINT32 vmeAddr, int length)
+{
+	if ( rtemsVmeDmaStart( req, mode, busMode, buf, vmeAddr, length, 1 ) )
+		return -1;
+	if ( epicsEventWaitOK != epicsEventWaitWithTimeout( ev, CAL_TIMEOUT ) ) {
+		/* the abort fails while the engine is busy: then the buffer
+		 * belongs to it (-2)
+		 */
+		if ( rtemsVmeDmaAbort( req ) )
+			return -2;
+		/* the engine is idle; don't let a completion which raced with
+		 * the abort end the next wait early
+		 */
+		epicsEventTryWait( ev );
+		return -1;
+	}
+	return req->status ? -1 : 0;
+}
+
+/*
+ * If 'write' is set a pattern is written to the slave first (which
+ * must then be memory) and modes which return corrupted data (cf.
+ * above) are rejected.
+ */
+int
+rtemsVmeDmaCalibrate(UINT32 vmeAddr, int adrsSpace, int maxLength, int dataWidth, int write)
+{
+char			*mem = 0, *ref = 0, *buf;
+epicsEventId	ev   = 0;
+DMA_ID			req  = 0;
+uint32_t		mode = adrsSpace | dw2mode( dataWidth );
+uint32_t		best;
+epicsUInt64		t0, t, tMode, tBest;
+int				b, m, i, len, ok, st, rval = -1;
+
+	if ( maxLength <= 0 ) {
+		errlogPrintf("rtemsVmeDmaCalibrate: invalid maxLength\n");
+		return -1;
+	}
+
+	if (   ! (mem = malloc( maxLength + CAL_ALIGN ))
+	    || ! (ref = malloc( maxLength ))
+	    || ! (ev  = epicsEventCreate( epicsEventEmpty ))
+	    || ! (req = rtemsVmeDmaCreate( (VOIDFUNCPTR)calCallback, ev )) ) {
+		errlogPrintf("rtemsVmeDmaCalibrate: no memory or no DMA channel\n");
+		goto bail;
+	}
+	buf = (char*)(((uintptr_t)mem + CAL_ALIGN - 1) & ~(uintptr_t)(CAL_ALIGN - 1));
+
+	if ( write ) {
+		for ( i = 0; i < maxLength; i++ )
+			ref[i] = (char)(i ^ (i >> 8));
+		memcpy( buf, ref, maxLength );
+		rtems_cache_flush_multiple_data_lines( buf, maxLength );
+		if ( (st = calXfer( req, ev, mode | BSP_VMEDMA_MODE_PCI2VME, rtemsVmeDmaBusMode, buf, vmeAddr, maxLength )) ) {
+			errlogPrintf("rtemsVmeDmaCalibrate: writing the pattern failed\n");
+			if ( st < -1 )
+				goto wedged;
+			goto bail;
+		}
+	}
+
+	printf("%10s", "bytes");
+	for ( m = 0; m < N_CAL_MODES; m++ )
+		printf(" %10s", calModes[m].name);
+	printf("  [us]\n");
+
+	for ( b = 0; b < N_BUCKETS && (0 == b || bucketMax[b-1] < maxLength); b++ ) {
+		len   = bucketMax[b] < maxLength ? bucketMax[b] : maxLength;
+		best  = 0;
+		tBest = 0;
+		printf("%10d", len);
+		for ( m = 0; m < N_CAL_MODES; m++ ) {
+			tMode = 0;
+			ok    = 1;
+			for ( i = 0; ok && i < CAL_REPEAT; i++ ) {
+				memset( buf, 0, len );
+				rtems_cache_flush_multiple_data_lines( buf, len );
+				t0 = epicsMonotonicGet();
+				st = calXfer( req, ev, mode, calModes[m].busMode, buf, vmeAddr, len );
+				t  = epicsMonotonicGet() - t0;
+				if ( st < -1 )
+					goto wedged;
+				ok = ! st;
+				rtems_cache_invalidate_multiple_data_lines( buf, len );
+				if ( ok && write && memcmp( buf, ref, len ) )
+					ok = 0;
+				if ( 0 == i || t < tMode )
+					tMode = t;
+			}
+			if ( ! ok ) {
+				printf(" %10s", "failed");
+				continue;
+			}
+			printf(" %10.1f", (double)tMode * 1.0E-3);
+			if ( ! best || tMode < tBest ) {
+				best  = calModes[m].busMode;
+				tBest = tMode;
+			}
+		}
+		printf("\n");
+		if ( best )
+			rtemsVmeDmaBusModeSet( adrsSpace, len, best );
+	}
+	rval = 0;
+
+bail:
+	/* a handle can't be destroyed once created */
+	free( mem );
+	free( ref );
+	return rval;
+
+wedged:
+	printf("\n");
+	errlogPrintf("rtemsVmeDmaCalibrate: DMA engine wedged; its buffer is not freed\n");
+	free( ref );
+	return -1;
+}
+
+void
+rtemsVmeDmaBusModeReport(int level)
+{
+int i, b;
+
+	epicsThreadOnce( &initOnce, rtemsVmeDmaInit, 0 );
+
+	printf("drvRTEMSDma: %d channel(s), %d reserved; default bus mode %lu\n",
+		nChannels, rtemsVmeDmaReservedChannels, (unsigned long)rtemsVmeDmaBusMode);
+	if ( 0 == nBusModeTbl )
+		return;
+	printf("%6s", "AM");
+	for ( b = 0; b < N_BUCKETS - 1; b++ )
+		printf(" %6s%-5d", "<=", bucketMax[b]);
+	printf(" %11s\n", "larger");
+	for ( i = 0; i < nBusModeTbl; i++ ) {
+		printf("  0x%02x", busModeTbl[i].am);
+		for ( b = 0; b < N_BUCKETS; b++ )
+			printf(" %11lu", (unsigned long)selectBusMode( busModeTbl[i].am, bucketMax[b] ));
+		printf("\n");
+	}
+}
+
+void
+rtemsVmeDmaReport(int level)
+{
+int             ch, i, nq, key;
+DMA_ID          r;
+DmaChannelStats st;
+double          up, act;
+
+	epicsThreadOnce( &initOnce, rtemsVmeDmaInit, 0 );
+
+	key = epicsInterruptLock();
+	for ( nq = 0, r = queue; r; r = r->next )
+		nq++;
+	epicsInterruptUnlock(key);
+
+	up = (double)(epicsMonotonicGet() - tInit) * 1.0E-9;
+	printf("drvRTEMSDma: %d channel(s), %d request(s) queued\n", nChannels, nq);
+	printf("%4s %10s %12s %8s %10s %10s %6s %8s\n",
+		"chan", "xfers", "bytes", "errors", "avgWt[us]", "maxWt[us]", "busy%", "MB/s");
+	for ( ch = 0; ch < nChannels; ch++ ) {
+		st  = channels[ch].stats;
+		act = (double)st.sumActive * 1.0E-9;
+		printf("%4d %10lu %12.0f %8lu %10.1f %10.1f %6.1f %8.2f\n",
+			ch, st.nXfers, (double)st.bytes, st.nErrors,
+			st.nXfers ? (double)st.sumWait / st.nXfers * 1.0E-3 : 0.,
+			(double)st.maxWait * 1.0E-3,
+			up > 0. ? 100. * act / up : 0.,
+			act > 0. ? (double)st.bytes / act * 1.0E-6 : 0.);
+		if ( level > 0 ) {
+			for ( i = 0; i < MAX_ERR_STATUS && st.err[i].count; i++ )
+				printf("     status 0x%08lx: %lu\n",
+					(unsigned long)st.err[i].status, st.err[i].count);
+			if ( st.nErrOther )
+				printf("     other status: %lu\n", st.nErrOther);
+		}
+	}
+	if ( level > 1 )
+		rtemsVmeDmaBusModeReport( level );
+}
+
+static const iocshArg rtemsVmeDmaReportArg0 = { "level", iocshArgInt };
+
+static const iocshArg *rtemsVmeDmaReportArgs[] = {
+	&rtemsVmeDmaReportArg0,
+};
+
+static const iocshFuncDef rtemsVmeDmaReportDef = {
+	"rtemsVmeDmaReport",
+	sizeof(rtemsVmeDmaReportArgs)/sizeof(rtemsVmeDmaReportArgs[0]),
+	rtemsVmeDmaReportArgs
+};
+
+static void
+rtemsVmeDmaReportCall(const iocshArgBuf *args)
+{
+	rtemsVmeDmaReport( args[0].ival );
+}
+
+static const iocshArg rtemsVmeDmaBusModeSetArg0 = { "adrsSpace", iocshArgInt };
+static const iocshArg rtemsVmeDmaBusModeSetArg1 = { "maxLength", iocshArgInt };
+static const iocshArg rtemsVmeDmaBusModeSetArg2 = { "busMode",   iocshArgInt };
+
+static const iocshArg *rtemsVmeDmaBusModeSetArgs[] = {
+	&rtemsVmeDmaBusModeSetArg0,
+	&rtemsVmeDmaBusModeSetArg1,
+	&rtemsVmeDmaBusModeSetArg2,
+};
+
+static const iocshFuncDef rtemsVmeDmaBusModeSetDef = {
+	"rtemsVmeDmaBusModeSet",
+	sizeof(rtemsVmeDmaBusModeSetArgs)/sizeof(rtemsVmeDmaBusModeSetArgs[0]),
+	rtemsVmeDmaBusModeSetArgs
+};
+
+static void
+rtemsVmeDmaBusModeSetCall(const iocshArgBuf *args)
+{
+	rtemsVmeDmaBusModeSet( args[0].ival, args[1].ival, (uint32_t)args[2].ival );
+}
+
+/* A32 addresses don't fit an iocshArgInt */
+static const iocshArg rtemsVmeDmaCalibrateArg0 = { "vmeAddr",   iocshArgString };
+static const iocshArg rtemsVmeDmaCalibrateArg1 = { "adrsSpace", iocshArgInt };
+static const iocshArg rtemsVmeDmaCalibrateArg2 = { "maxLength", iocshArgInt };
+static const iocshArg rtemsVmeDmaCalibrateArg3 = { "dataWidth", iocshArgInt };
+static const iocshArg rtemsVmeDmaCalibrateArg4 = { "write",     iocshArgInt };
+
+static const iocshArg *rtemsVmeDmaCalibrateArgs[] = {
+	&rtemsVmeDmaCalibrateArg0,
+	&rtemsVmeDmaCalibrateArg1,
+	&rtemsVmeDmaCalibrateArg2,
+	&rtemsVmeDmaCalibrateArg3,
+	&rtemsVmeDmaCalibrateArg4,
+};
+
+static const iocshFuncDef rtemsVmeDmaCalibrateDef = {
+	"rtemsVmeDmaCalibrate",
+	sizeof(rtemsVmeDmaCalibrateArgs)/sizeof(rtemsVmeDmaCalibrateArgs[0]),
+	rtemsVmeDmaCalibrateArgs
+};
+
+static void
+rtemsVmeDmaCalibrateCall(const iocshArgBuf *args)
+{
+	if ( ! args[0].sval ) {
+		errlogPrintf("usage: rtemsVmeDmaCalibrate <vmeAddr> <adrsSpace> <maxLength> <dataWidth> <write>\n");
+		return;
+	}
+	rtemsVmeDmaCalibrate( (UINT32)strtoul( args[0].sval, 0, 0 ),
+		args[1].ival, args[2].ival, args[3].ival, args[4].ival );
+}
+
+static const iocshArg rtemsVmeDmaBusModeReportArg0 = { "level", iocshArgInt };
+
+static const iocshArg *rtemsVmeDmaBusModeReportArgs[] = {
+	&rtemsVmeDmaBusModeReportArg0,
+};
+
+static const iocshFuncDef rtemsVmeDmaBusModeReportDef = {
+	"rtemsVmeDmaBusModeReport",
+	sizeof(rtemsVmeDmaBusModeReportArgs)/sizeof(rtemsVmeDmaBusModeReportArgs[0]),
+	rtemsVmeDmaBusModeReportArgs
+};
+
+static void
+rtemsVmeDmaBusModeReportCall(const iocshArgBuf *args)
+{
+	rtemsVmeDmaBusModeReport( args[0].ival );
+}
+
+static const iocshArg rtemsVmeDmaListSelectArg0 = { "tsi148|universe|auto|none", iocshArgString };
+
+static const iocshArg *rtemsVmeDmaListSelectArgs[] = {
+	&rtemsVmeDmaListSelectArg0,
+};
+
+static const iocshFuncDef rtemsVmeDmaListSelectDef = {
+	"rtemsVmeDmaListSelect",
+	sizeof(rtemsVmeDmaListSelectArgs)/sizeof(rtemsVmeDmaListSelectArgs[0]),
+	rtemsVmeDmaListSelectArgs
+};
+
+static void
+rtemsVmeDmaListSelectCall(const iocshArgBuf *args)
+{
+	rtemsVmeDmaListSelect( args[0].sval );
+}
+
+static void
+drvRTEMSDmaRegistrar(void)
+{
+	iocshRegister( &rtemsVmeDmaBusModeSetDef,    rtemsVmeDmaBusModeSetCall );
+	iocshRegister( &rtemsVmeDmaCalibrateDef,     rtemsVmeDmaCalibrateCall );
+	iocshRegister( &rtemsVmeDmaBusModeReportDef, rtemsVmeDmaBusModeReportCall );
+	iocshRegister( &rtemsVmeDmaReportDef,        rtemsVmeDmaReportCall );
+	iocshRegister( &rtemsVmeDmaListSelectDef,    rtemsVmeDmaListSelectCall );
+}
+
+epicsExportRegistrar(drvRTEMSDmaRegistrar);
@@ -24,6 +24,42 @@ rtemsVmeDmaStatus(DMA_ID dmaId);
 uint32_t
 rtemsVmeDmaStatusRaw(DMA_ID dmaId);
 
+/* Requests are queued and dispatched to any idle DMA channel of the
+ * bridge, higher priority first (FIFO among equal priorities); the
+ * default priority is 0. Takes effect at the next start.
+ */
+STATUS
+rtemsVmeDmaSetPriority(DMA_ID dmaId, int priority);
+
+/* number of channels which requests with priority <= 0 may not use
+ * (at least one channel is always left to them); set before iocInit
+ */
+extern int rtemsVmeDmaReservedChannels;
+
+/* Bus mode (BSP_VMEDMA_OPT_xxx) for transfers in 'adrsSpace' of up to
+ * 'maxLength' bytes (size buckets: 256, 2k, 16k, larger); 0 restores
+ * the default (rtemsVmeDmaBusMode).
+ */
+int
+rtemsVmeDmaBusModeSet(int adrsSpace, int maxLength, uint32_t busMode);
+
+/* Time reads from a slave at 'vmeAddr' in each bus mode and size
+ * bucket up to 'maxLength' and set the fastest. With 'write' a pattern
+ * is written first (overwriting slave memory!) and modes returning
+ * wrong data are rejected.
+ */
+int
+rtemsVmeDmaCalibrate(UINT32 vmeAddr, int adrsSpace, int maxLength, int dataWidth, int write);
+
+void
+rtemsVmeDmaBusModeReport(int level);
+
+/* per-channel transfers, bytes, errors (level > 0: by raw status),
+ * queueing time, utilization and throughput
+ */
+void
+rtemsVmeDmaReport(int level);
+
 STATUS
 rtemsVmeDmaFromVme(DMA_ID dmaId, void *pLocal, UINT32 vmeAddr,
 	int adrsSpace, int length, int dataWidth);
@@ -32,4 +68,41 @@ STATUS
 rtemsVmeDmaToVme(DMA_ID dmaId, UINT32 vmeAddr, int adrsSpace,
     void *pLocal, int length, int dataWidth);
 
+/* Read 'rows' rows of 'rowBytes' (at 'vmeStride' on VME, 'localStride'
+ * in memory) with a single descriptor list. Available on BSPs with
+ * bspVmeDmaList.h (built with HAVE_BSP_VMEDMA_LIST) once a bridge is
+ * selected (see rtemsVmeDmaListSelect()).
+ * RETURNS: 0, ENOTSUP if lists are not available, EBUSY, ENOMEM
+ */
+STATUS
+rtemsVmeDmaFromVme2D(DMA_ID dmaId, void *pLocal, int localStride, UINT32 vmeAddr,
+	int vmeStride, int adrsSpace, int rowBytes, int rows, int dataWidth);
+
+/* Use the descriptor lists of bridge "tsi148" or "universe"; NULL or
+ * "auto" takes the one the BSP found, "none" turns lists off. Done by
+ * the first 2D transfer unless called (or the variables below set)
+ * before. RETURNS: 0, -1 if there is no such bridge
+ */
+int
+rtemsVmeDmaListSelect(const char *bridge);
+
+#ifdef HAVE_BSP_VMEDMA_LIST
+#include <bsp/bspVmeDmaList.h>
+
+/* set by rtemsVmeDmaListSelect(); other bridges can be hooked up here */
+/* the bridge's list class (e.g., vmeTsi148DmaListClass) */
+extern VMEDmaListClass rtemsVmeDmaListClass;
+
+/* the 'controller' argument of BSP_VMEDmaListStart() for a channel */
+extern volatile void *(*rtemsVmeDmaListController)(int channel);
+#endif
+
+/* abandon a transfer (e.g., after a timeout); the callback is not
+ * called. RETURNS: 0, -1 if the engine is still busy (the engine can't
+ * be stopped; the buffer is in use until the callback is called when
+ * the transfer terminates)
+ */
+STATUS
+rtemsVmeDmaAbort(DMA_ID dmaId);
+
 #endif